@@ -0,0 +1,588 @@
+#include "benchmark/benchmark.h"
+#include "ssdDriver.h"
+#include "deviceScan.h"
+#include "ssdHost.h"
+#include "powerLossHarness.h"
+
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+using namespace std::filesystem;
+
+namespace {
+	vector<vector<string>> makeMixedBuffer()
+	{
+		return {
+			{ "W", "3", "0x12345678" },
+			{ "E", "10", "4" },
+			{ "W", "20", "0xCAFEBABE" },
+			{ "E", "40", "10" },
+		};
+	}
+
+	struct MemoryDevice {
+		shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+		shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+		SSDContext ctx{ nand, output };
+		SSDDriver ssdDriver{ ctx, make_shared<MemoryBufferStore>() };
+	};
+
+	string scratchDir(const string& name)
+	{
+		string dirPath = (temp_directory_path() / ("ssd_bench_" + name)).string();
+		remove_all(dirPath);
+		create_directories(dirPath);
+		return dirPath;
+	}
+}
+
+// Merging an erase into a buffer that already holds overlapping erases and
+// writes; the buffer is reset every iteration.
+static void BM_MergeAlgorithm(benchmark::State& state)
+{
+	MemoryDevice device;
+	CommandBufferManager& manager = device.ssdDriver.commandBufferManager;
+	vector<vector<string>> buffer = makeMixedBuffer();
+	vector<string> args = { "E", "12", "8" };
+
+	for (auto _ : state) {
+		manager.setBuffer(buffer);
+		manager.mergeAlgorithm(args);
+		benchmark::DoNotOptimize(manager.getBuffer().data());
+	}
+}
+BENCHMARK(BM_MergeAlgorithm);
+
+// Fast read lookup: Arg(1) hits the newest entry, Arg(0) misses the whole buffer.
+static void BM_GetCommand(benchmark::State& state)
+{
+	MemoryDevice device;
+	CommandBufferManager& manager = device.ssdDriver.commandBufferManager;
+	vector<vector<string>> buffer = makeMixedBuffer();
+	buffer.push_back({ "W", "60", "0x0000BEEF" });
+	manager.setBuffer(buffer);
+	vector<string> args = { "R", state.range(0) ? "60" : "99" };
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(manager.getCommand(args));
+	}
+}
+BENCHMARK(BM_GetCommand)->Arg(0)->Arg(1);
+
+// Flushing a full buffer: Arg(0) into memory, Arg(1) into the text image.
+static void BM_FlushCommand(benchmark::State& state)
+{
+	string dirPath = scratchDir("flush");
+	SSDContext ctx = state.range(0) ?
+		SSDContext(SSDConfig::inDirectory(dirPath)) :
+		SSDContext(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	vector<vector<string>> buffer = makeMixedBuffer();
+	buffer.push_back({ "W", "60", "0x0000BEEF" });
+
+	for (auto _ : state) {
+		FlushCommand(ctx, buffer).execute();
+	}
+	state.SetItemsProcessed(state.iterations() * buffer.size());
+	remove_all(dirPath);
+}
+BENCHMARK(BM_FlushCommand)->Arg(0)->Arg(1);
+
+// argv parsing, validation and dispatch of a read that hits the buffer.
+static void BM_ParseAndDispatch(benchmark::State& state)
+{
+	MemoryDevice device;
+	device.ssdDriver.run(vector<string>{ "W", "7", "0x00000007" });
+	const char* argv[] = { "ssd.exe", "R", "7" };
+
+	for (auto _ : state) {
+		device.ssdDriver.run(3, const_cast<char**>(argv));
+	}
+}
+BENCHMARK(BM_ParseAndDispatch);
+
+// What every CLI invocation pays before running its command.
+static void BM_ColdStart(benchmark::State& state)
+{
+	string dirPath = scratchDir("cold_start");
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	{
+		SSDDriver ssdDriver(config);
+		for (int addr = 0; addr < 5; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+	}
+
+	for (auto _ : state) {
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "R", "0" });
+	}
+	remove_all(dirPath);
+}
+BENCHMARK(BM_ColdStart)->Unit(benchmark::kMicrosecond);
+
+// Buffered writes on the text image under each durability level.
+static void BM_DurabilityWrite(benchmark::State& state)
+{
+	DurabilityLevel level = (DurabilityLevel)state.range(0);
+	string dirPath = scratchDir("durability");
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	config.durability = level;
+	SSDDriver ssdDriver(config);
+	int addr = 0;
+
+	for (auto _ : state) {
+		ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+		addr = (addr + 1) % 100;
+	}
+	ssdDriver.syncPending();
+	state.counters["syncs"] = (double)ssdDriver.getDurability().getSyncCount();
+	state.SetLabel(DurabilityPolicy::toString(level));
+	remove_all(dirPath);
+}
+BENCHMARK(BM_DurabilityWrite)
+	->Arg((int)DurabilityLevel::None)
+	->Arg((int)DurabilityLevel::SyncOnFlush)
+	->Arg((int)DurabilityLevel::SyncPerCommand)
+	->Arg((int)DurabilityLevel::GroupCommit)
+	->Unit(benchmark::kMicrosecond);
+
+// NAND reads through the driver under each verification mode.
+static void BM_ReadVerify(benchmark::State& state)
+{
+	VerifyMode mode = (VerifyMode)state.range(0);
+	shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+	SSDContext ctx(nand, make_shared<MemoryOutputSink>());
+	if (mode != VerifyMode::Off) ctx.integrity = make_shared<IntegrityStore>(nand, "", 100, mode);
+	SSDDriver ssdDriver(ctx, make_shared<MemoryBufferStore>());
+	for (int addr = 0; addr < 100; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+	ssdDriver.run(vector<string>{ "F" });
+	int addr = 0;
+
+	for (auto _ : state) {
+		ssdDriver.run(vector<string>{ "R", to_string(addr) });
+		addr = (addr + 1) % 100;
+	}
+	state.SetLabel(IntegrityStore::toString(mode));
+}
+BENCHMARK(BM_ReadVerify)
+	->Arg((int)VerifyMode::Off)
+	->Arg((int)VerifyMode::EveryRead)
+	->Arg((int)VerifyMode::Sampled)
+	->Arg((int)VerifyMode::Scrub);
+
+shared_ptr<NandStorage> makeEngineStorage(IoEngine ioEngine, const string& fileName, int lbaCount)
+{
+	if (ioEngine == IoEngine::Uring) return make_shared<UringNandStorage>(fileName, lbaCount);
+	if (ioEngine == IoEngine::Mmap) return make_shared<MmapNandStorage>(fileName, lbaCount);
+	return make_shared<FileNandStorage>(fileName, lbaCount);
+}
+
+const char* engineName(IoEngine ioEngine)
+{
+	return ioEngine == IoEngine::Uring ? "uring" : ioEngine == IoEngine::Mmap ? "mmap" : "fstream";
+}
+
+// Write five LBAs and flush, through the driver, per I/O engine.
+static void BM_EngineFlush(benchmark::State& state)
+{
+	IoEngine ioEngine = (IoEngine)state.range(0);
+	string dirPath = scratchDir("engine_flush");
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	config.ioEngine = ioEngine;
+	SSDDriver ssdDriver(config);
+	int addr = 0;
+
+	for (auto _ : state) {
+		for (int i = 0; i < 5; ++i, addr = (addr + 7) % 100) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+	state.SetLabel(engineName(ioEngine));
+	remove_all(dirPath);
+}
+BENCHMARK(BM_EngineFlush)->Arg((int)IoEngine::Stream)->Arg((int)IoEngine::Mmap)->Arg((int)IoEngine::Uring)
+	->Unit(benchmark::kMicrosecond);
+
+// Scattered writes then one commit on a large image: the batch io_uring keeps in flight.
+static void BM_EngineWriteBatch(benchmark::State& state)
+{
+	const int lbaCount = 1 << 16;
+	IoEngine ioEngine = (IoEngine)state.range(0);
+	string dirPath = scratchDir("engine_write");
+	shared_ptr<NandStorage> nand = makeEngineStorage(ioEngine, dirPath + "/image.txt", lbaCount);
+	int addr = 0;
+
+	for (auto _ : state) {
+		for (int i = 0; i < 1024; ++i, addr = (addr + 4099) % lbaCount) nand->write(addr, "0xCAFEBABE");
+		nand->commit();
+	}
+	state.SetItemsProcessed(state.iterations() * 1024);
+	state.SetLabel(engineName(ioEngine));
+	nand.reset();
+	remove_all(dirPath);
+}
+BENCHMARK(BM_EngineWriteBatch)->Arg((int)IoEngine::Stream)->Arg((int)IoEngine::Mmap)->Arg((int)IoEngine::Uring)
+	->Unit(benchmark::kMicrosecond);
+
+// Whole-image range read of a large image, per I/O engine.
+static void BM_EngineReadRange(benchmark::State& state)
+{
+	const int lbaCount = 1 << 16;
+	IoEngine ioEngine = (IoEngine)state.range(0);
+	string dirPath = scratchDir("engine_read");
+	shared_ptr<NandStorage> nand = makeEngineStorage(ioEngine, dirPath + "/image.txt", lbaCount);
+	for (int addr = 0; addr < lbaCount; addr += 5) nand->write(addr, "0xCAFEBABE");
+	nand->commit();
+	vector<uint32_t> values(lbaCount);
+
+	for (auto _ : state) {
+		nand->readRange(0, lbaCount, values.data());
+		benchmark::DoNotOptimize(values.data());
+	}
+	state.SetBytesProcessed(state.iterations() * 10 * (int64_t)lbaCount);
+	state.SetLabel(engineName(ioEngine));
+	nand.reset();
+	remove_all(dirPath);
+}
+BENCHMARK(BM_EngineReadRange)->Arg((int)IoEngine::Stream)->Arg((int)IoEngine::Mmap)->Arg((int)IoEngine::Uring)
+	->Unit(benchmark::kMicrosecond);
+
+// 1024 writes then one commit on a large image, text cells against O_DIRECT
+// pages, with the writes clustered (stride 1) or one per page (stride 4099).
+static void BM_PagedWriteBatch(benchmark::State& state)
+{
+	const int lbaCount = 1 << 16;
+	bool paged = state.range(0) != 0;
+	int stride = (int)state.range(1);
+	string dirPath = scratchDir("paged_write");
+	shared_ptr<NandStorage> nand;
+	if (paged) nand = make_shared<PagedNandStorage>(dirPath + "/image.img", lbaCount);
+	else nand = make_shared<FileNandStorage>(dirPath + "/image.txt", lbaCount);
+	int addr = 0;
+
+	for (auto _ : state) {
+		for (int i = 0; i < 1024; ++i, addr = (addr + stride) % lbaCount) nand->write(addr, "0xCAFEBABE");
+		nand->commit();
+		nand->sync();
+	}
+	state.SetItemsProcessed(state.iterations() * 1024);
+	state.SetLabel(paged ? "paged" : "text");
+	nand.reset();
+	remove_all(dirPath);
+}
+BENCHMARK(BM_PagedWriteBatch)->ArgsProduct({ { 0, 1 }, { 1, 4099 } })->Unit(benchmark::kMicrosecond);
+
+// Polling S on a file-backed device: the report comes from counters only.
+static void BM_HealthPoll(benchmark::State& state)
+{
+	string dirPath = scratchDir("health_poll");
+	SSDDriver ssdDriver(SSDConfig::inDirectory(dirPath));
+	for (int addr = 0; addr < 100; addr += 3) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+	ssdDriver.run(vector<string>{ "F" });
+
+	for (auto _ : state) ssdDriver.run(vector<string>{ "S" });
+	remove_all(dirPath);
+}
+BENCHMARK(BM_HealthPoll)->Unit(benchmark::kMicrosecond);
+
+// Latency of a read queued right behind a flush on a file-backed device, by
+// I/O scheduling policy.
+static void BM_ReadBehindFlush(benchmark::State& state)
+{
+	IoScheduler scheduler;
+	scheduler.policy = (IoSchedule)state.range(0);
+	string dirPath = scratchDir("read_behind_flush");
+	SSDHost host(1, [&](int) {
+		SSDConfig config = SSDConfig::inDirectory(dirPath);
+		config.durability = DurabilityLevel::SyncOnFlush;
+		return make_unique<SSDDriver>(config);
+	}, scheduler);
+	int addr = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (int i = 0; i < 5; ++i, addr = (addr + 7) % 100) host.write(0, addr, "0x12345678");
+		host.waitIdle();
+		host.flush(0);
+		state.ResumeTiming();
+
+		benchmark::DoNotOptimize(host.read(0, 99).wait());
+
+		state.PauseTiming();
+		host.waitIdle();
+		state.ResumeTiming();
+	}
+	state.SetLabel(scheduler.policy == IoSchedule::Fifo ? "fifo" :
+		scheduler.policy == IoSchedule::Deadline ? "deadline" : "weighted");
+	remove_all(dirPath);
+}
+BENCHMARK(BM_ReadBehindFlush)
+	->Arg((int)IoSchedule::Fifo)->Arg((int)IoSchedule::Deadline)->Arg((int)IoSchedule::WeightedFair)
+	->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// Latency of a small tenant's writes to LBAs 90-99 while another tenant
+// bursts writes into LBAs 0-89 of a file-backed device that syncs on flush:
+// Arg(0) one shared buffer, Arg(1) the tenants in namespaces of their own.
+static void BM_TenantWriteDuringBurst(benchmark::State& state)
+{
+	string dirPath = scratchDir("tenant_write");
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	config.durability = DurabilityLevel::SyncOnFlush;
+	if (state.range(0)) NamespaceLayout::parse("90,10:8", config.namespaces);
+	SSDDriver ssdDriver(config);
+	int addr = 0;
+	int tenantAddr = 90;
+	int flushes = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (int i = 0; i < 5; ++i, addr = (addr + 7) % 90) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+		state.ResumeTiming();
+
+		size_t buffered = ssdDriver.bufferedCommands().size();
+		ssdDriver.run(vector<string>{ "W", to_string(tenantAddr), "0x0000BEEF" });
+		tenantAddr = tenantAddr == 99 ? 90 : tenantAddr + 1;
+		if (ssdDriver.bufferedCommands().size() <= buffered) flushes++;
+	}
+	state.counters["flushes_per_write"] = benchmark::Counter((double)flushes, benchmark::Counter::kAvgIterations);
+	state.SetLabel(state.range(0) ? "namespaces" : "shared");
+	remove_all(dirPath);
+}
+BENCHMARK(BM_TenantWriteDuringBurst)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Sequential writes and flushes on a zoned device, by image: Arg(0) the text
+// image, Arg(1) the zone logs. Zones are reset once full.
+static void BM_ZonedSequentialWrite(benchmark::State& state)
+{
+	string dirPath = scratchDir("zoned_write");
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	config.zoneSize = ZoneTable::DEFAULT_ZONE_SIZE;
+	if (state.range(0)) config.imageFormat = ImageFormat::Zoned;
+	SSDDriver ssdDriver(config);
+	int zone = 0;
+	int written = 0;
+
+	for (auto _ : state) {
+		if (written == config.zoneSize) {
+			ssdDriver.run(vector<string>{ "ZRESET", to_string(zone) });
+			written = 0;
+		}
+		ssdDriver.run(vector<string>{ "ZAPPEND", to_string(zone), "0x12345678" });
+		if (++written == config.zoneSize) zone = (zone + 1) % 10;
+	}
+	state.SetLabel(state.range(0) ? "zone logs" : "text");
+	remove_all(dirPath);
+}
+BENCHMARK(BM_ZonedSequentialWrite)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Simulated cost of a 3:1 write/read mix on the mlc profile, by buffer
+// capacity and channel count (two dies per channel); the counters are
+// virtual-clock figures, the time is the host's.
+static void BM_SimulatedWriteReadMix(benchmark::State& state)
+{
+	SSDContext context(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	NandTiming timing;
+	timing.channels = (int)state.range(1);
+	timing.diesPerChannel = 2;
+	context.timing = make_shared<NandTimingModel>(timing);
+	vector<SSDNamespace> layout;
+	NamespaceLayout::parse("100:" + to_string(state.range(0)), layout);
+	SSDDriver ssdDriver(context, make_shared<MemoryBufferStore>(), layout);
+	int addr = 0;
+
+	for (auto _ : state) {
+		for (int i = 0; i < 3; ++i, addr = (addr + 7) % 100) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+		ssdDriver.run(vector<string>{ "R", to_string((addr + 50) % 100) });
+	}
+	double simulatedSec = ssdDriver.getTimingModel()->now().count() / 1e6;
+	uint64_t commands = ssdDriver.getTimingModel()->getCommandCount();
+	state.counters["sim_kiops"] = simulatedSec > 0 ? commands / simulatedSec / 1000 : 0;
+	state.counters["sim_avg_us"] = commands > 0 ? simulatedSec * 1e6 / commands : 0;
+}
+BENCHMARK(BM_SimulatedWriteReadMix)->ArgsProduct({ { 1, 5, 8 }, { 1, 4 } })->Unit(benchmark::kMicrosecond);
+
+// Scattered writes of four interleaved patterns, committed every 64, on a
+// large image: Arg(0) text, Arg(1) compressed, Arg(2) dedup.
+static void BM_PatternWriteCommit(benchmark::State& state)
+{
+	const int lbaCount = 1 << 16;
+	const char* patterns[] = { "0x00FF00FF", "0xDEADBEEF", "0xA5A5A5A5", "0x12345678" };
+	string dirPath = scratchDir("pattern_write");
+	string fileName = (path(dirPath) / "ssd_nand.txt").string();
+	unique_ptr<NandStorage> nand;
+	if (state.range(0) == 0) nand = make_unique<FileNandStorage>(fileName, lbaCount);
+	if (state.range(0) == 1) nand = make_unique<CompressedNandStorage>(fileName, lbaCount);
+	if (state.range(0) == 2) nand = make_unique<DedupNandStorage>(fileName, lbaCount);
+	for (int addr = 0; addr < lbaCount; ++addr) nand->write(addr, patterns[addr % 4]);
+	nand->commit();
+	int addr = 0;
+	int pattern = 0;
+
+	for (auto _ : state) {
+		for (int i = 0; i < 64; ++i, addr = (addr + 4099) % lbaCount) nand->write(addr, patterns[pattern++ % 4]);
+		nand->commit();
+	}
+	state.counters["image_bytes"] = (double)file_size(fileName);
+	state.SetLabel(state.range(0) == 0 ? "text" : state.range(0) == 1 ? "compressed" : "dedup");
+	nand.reset();
+	remove_all(dirPath);
+}
+BENCHMARK(BM_PatternWriteCommit)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+// Whole-device export and import of a large paged image through a file:
+// Arg(0) text, Arg(1) binary.
+static void BM_ImageExport(benchmark::State& state)
+{
+	const int lbaCount = 1 << 18;
+	string dirPath = scratchDir("image_export");
+	PagedNandStorage nand((path(dirPath) / "ssd_nand.txt").string(), lbaCount);
+	for (int addr = 0; addr < lbaCount; addr += 3) nand.write(addr, "0xCAFEBABE");
+	nand.commit();
+	string target = (path(dirPath) / "image").string();
+
+	for (auto _ : state) {
+		ofstream out(target, ios::binary | ios::trunc);
+		ImageStream::exportImage(nand, {}, out, state.range(0) == 1, lbaCount);
+	}
+	state.SetBytesProcessed(state.iterations() * (int64_t)file_size(target));
+	state.SetLabel(state.range(0) ? "binary" : "text");
+	remove_all(dirPath);
+}
+BENCHMARK(BM_ImageExport)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+static void BM_ImageImport(benchmark::State& state)
+{
+	const int lbaCount = 1 << 18;
+	string dirPath = scratchDir("image_import");
+	PagedNandStorage nand((path(dirPath) / "ssd_nand.txt").string(), lbaCount);
+	for (int addr = 0; addr < lbaCount; addr += 3) nand.write(addr, "0xCAFEBABE");
+	string source = (path(dirPath) / "image").string();
+	{
+		ofstream out(source, ios::binary | ios::trunc);
+		ImageStream::exportImage(nand, {}, out, state.range(0) == 1, lbaCount);
+	}
+
+	for (auto _ : state) {
+		ifstream in(source, ios::binary);
+		vector<uint32_t> values;
+		ImageStream::importImage(in, state.range(0) == 1, lbaCount, values);
+		nand.writeRange(0, lbaCount, values.data());
+		nand.commit();
+	}
+	state.SetBytesProcessed(state.iterations() * (int64_t)file_size(source));
+	state.SetLabel(state.range(0) ? "binary" : "text");
+	remove_all(dirPath);
+}
+BENCHMARK(BM_ImageImport)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Whole-device CRC32C of a large memory device, by worker count.
+static void BM_DeviceChecksum(benchmark::State& state)
+{
+	const int lbaCount = 1 << 18;
+	MemoryNandStorage nand(lbaCount);
+	for (int addr = 0; addr < lbaCount; addr += 3) nand.write(addr, "0xCAFEBABE");
+	DeviceScanner scanner(lbaCount, (int)state.range(0));
+	uint32_t crc;
+
+	for (auto _ : state) {
+		scanner.checksum(nand, {}, crc);
+		benchmark::DoNotOptimize(crc);
+	}
+	state.SetBytesProcessed(state.iterations() * 4 * (int64_t)lbaCount);
+	state.counters["workers"] = scanner.getWorkerCount();
+}
+BENCHMARK(BM_DeviceChecksum)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int injectPowerLoss(int argc, char* argv[])
+{
+	string dirPath = argc >= 3 ? argv[2] : "power_loss";
+	vector<vector<string>> workload;
+	for (int addr = 0; addr < 12; ++addr) workload.push_back({ "W", to_string(addr * 7 % 100), "0x0000" + to_string(1000 + addr) });
+	workload.push_back({ "E", "10", "5" });
+	workload.push_back({ "F" });
+
+	for (ImageFormat imageFormat : { ImageFormat::Text, ImageFormat::Compressed }) {
+		PowerLossHarness harness(dirPath, imageFormat);
+		for (const char* point : { FaultInjector::BUFFER_BEFORE_RENAME, FaultInjector::FLUSH_BEFORE_COMMAND,
+			FaultInjector::IMAGE_BEFORE_INDEX_SWITCH }) {
+			for (int skipHits = 0; skipHits < 12; skipHits += 3) {
+				PowerLossReport report = harness.run(workload, point, skipHits);
+				cout << (imageFormat == ImageFormat::Text ? "text" : "compressed") << " skip=" << skipHits
+					<< " " << report.toString() << endl;
+			}
+		}
+		for (const RecoveryTiming& timing : harness.measureRecovery()) {
+			cout << "recovery image=" << timing.imageFormat << " buffer=" << timing.bufferEntries
+				<< fixed << setprecision(2) << " time=" << timing.recoveryUs << "us" << endl;
+		}
+	}
+	remove_all(dirPath);
+	return 0;
+}
+
+double medianUs(vector<double>& samples)
+{
+	sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+int benchmarkStartup(int argc, char* argv[])
+{
+	string dirPath = argc >= 3 ? argv[2] : "startup_bench";
+	int iterations = argc >= 4 ? max(1, atoi(argv[3])) : 1000;
+	SSDConfig config = SSDConfig::inDirectory(dirPath);
+	vector<vector<string>> fullBuffer;
+	for (int addr = 0; addr < 5; ++addr) fullBuffer.push_back({ "W", to_string(addr), "0x12345678" });
+
+	remove_all(dirPath);
+	create_directories(dirPath);
+	DirectoryBufferStore(config.bufferPath).save(fullBuffer);
+
+	vector<double> manifestLoad, legacyLoad, coldStart;
+	for (int i = 0; i < iterations; ++i) {
+		vector<vector<string>> buffer;
+		steady_clock::time_point start = steady_clock::now();
+		DirectoryBufferStore(config.bufferPath).load(buffer);
+		manifestLoad.push_back(duration<double, micro>(steady_clock::now() - start).count());
+
+		start = steady_clock::now();
+		{
+			SSDDriver ssdDriver(config);
+			ssdDriver.run(vector<string>{ "R", "0" });
+		}
+		coldStart.push_back(duration<double, micro>(steady_clock::now() - start).count());
+	}
+
+	string legacyPath = (path(dirPath) / "legacy").string();
+	for (int i = 0; i < iterations; ++i) {
+		remove_all(legacyPath);
+		create_directories(legacyPath);
+		for (int slot = 0; slot < 5; ++slot) ofstream(path(legacyPath) / (to_string(slot + 1) + "_W_" + to_string(slot) + "_0x12345678"));
+
+		vector<vector<string>> buffer;
+		steady_clock::time_point start = steady_clock::now();
+		DirectoryBufferStore(legacyPath).load(buffer);
+		legacyLoad.push_back(duration<double, micro>(steady_clock::now() - start).count());
+	}
+	remove_all(dirPath);
+
+	cout << fixed << setprecision(2)
+		<< "manifest load median=" << medianUs(manifestLoad) << "us" << endl
+		<< "legacy scan+migrate median=" << medianUs(legacyLoad) << "us" << endl
+		<< "cold start (driver + R) median=" << medianUs(coldStart) << "us" << endl;
+	return 0;
+}
+
+// Besides the benchmarks, the power-loss harness and the cold start
+// comparison run as modes of their own.
+int main(int argc, char* argv[])
+{
+	if (argc >= 2 && string(argv[1]) == "--power-loss") return injectPowerLoss(argc, argv);
+	if (argc >= 2 && string(argv[1]) == "--startup-bench") return benchmarkStartup(argc, argv);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
\ No newline at end of file
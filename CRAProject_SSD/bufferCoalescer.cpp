@@ -0,0 +1,57 @@
+#include "bufferCoalescer.h"
+
+vector<vector<string>> BufferCoalescer::coalesce(const vector<vector<string>>& buffer) {
+    map<int, string> finalState = replay(buffer);
+
+    vector<vector<string>> result;
+    vector<vector<string>> writes;
+    vector<pair<int, string>> run;
+    for (const auto& cell : finalState) {
+        if (!run.empty() && run.back().first + 1 != cell.first) {
+            coverErasedRun(run, result);
+            run.clear();
+        }
+        run.push_back(cell);
+        if (cell.second != ERASED) writes.push_back({ "W", to_string(cell.first), cell.second });
+    }
+    coverErasedRun(run, result);
+
+    result.insert(result.end(), writes.begin(), writes.end());
+    return result;
+}
+
+map<int, string> BufferCoalescer::replay(const vector<vector<string>>& buffer) {
+    map<int, string> finalState;
+    for (const vector<string>& command : buffer) {
+        if (command[0] == "W") {
+            finalState[stoi(command[1])] = command[2];
+        }
+        else if (command[0] == "E") {
+            int addr = stoi(command[1]);
+            int size = stoi(command[2]);
+            for (int offset = 0; offset < size; offset++) finalState[addr + offset] = ERASED;
+        }
+    }
+    return finalState;
+}
+
+// Greedy interval cover over one run of touched LBAs: each erase starts at
+// the first uncovered erased LBA and ends at the last erased LBA that still
+// fits in ERASE_SIZE_MAX.
+void BufferCoalescer::coverErasedRun(const vector<pair<int, string>>& run, vector<vector<string>>& result) {
+    size_t idx = 0;
+    while (idx < run.size()) {
+        if (run[idx].second != ERASED) {
+            idx++;
+            continue;
+        }
+
+        int start = run[idx].first;
+        int lastErased = start;
+        while (idx < run.size() && run[idx].first < start + ERASE_SIZE_MAX) {
+            if (run[idx].second == ERASED) lastErased = run[idx].first;
+            idx++;
+        }
+        result.push_back({ "E", to_string(start), to_string(lastErased - start + 1) });
+    }
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class BufferCoalescer {
+public:
+    static constexpr int ERASE_SIZE_MAX = 10;
+
+    // Replays the buffer into a final per-LBA state and rebuilds the smallest
+    // equivalent command list: erases first, with written LBAs folded into the
+    // erase ranges around them, then the surviving writes.
+    static vector<vector<string>> coalesce(const vector<vector<string>>& buffer);
+
+private:
+    static constexpr const char* ERASED = "";
+
+    static map<int, string> replay(const vector<vector<string>>& buffer);
+    static void coverErasedRun(const vector<pair<int, string>>& run, vector<vector<string>>& result);
+};
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "bufferStore.h"
+
+bool DirectoryBufferStore::load(vector<vector<string>>& buffer) {
+    string manifest(MANIFEST_SIZE, '\0');
+    ifstream ifs(manifestPath, ios::binary);
+    if (ifs.is_open()) {
+        ifs.read(&manifest[0], MANIFEST_SIZE);
+        return ifs.gcount() == MANIFEST_SIZE && decode(manifest, buffer);
+    }
+    return migrateLegacyFiles(buffer);
+}
+
+bool DirectoryBufferStore::save(const vector<vector<string>>& buffer) {
+    string manifest;
+    if (!encode(buffer, manifest)) return false;
+
+    error_code ec;
+    create_directories(dirPath, ec);
+    string tempPath = manifestPath + ".tmp";
+    {
+        ofstream ofs(tempPath, ios::binary | ios::trunc);
+        ofs.write(manifest.data(), manifest.size());
+        if (!ofs.good()) return false;
+    }
+    FaultInjector::hit(FaultInjector::BUFFER_BEFORE_RENAME);
+
+    rename(tempPath, manifestPath, ec);
+    return !ec;
+}
+
+bool DirectoryBufferStore::sync() {
+    if (exists(manifestPath) && !syncFile(manifestPath)) return false;
+    return syncDirectory(dirPath);
+}
+
+bool DirectoryBufferStore::saveSnapshot(const string& name, const vector<vector<string>>& buffer) {
+    error_code ec;
+    create_directories(snapshotDir(), ec);
+    if (ec) return false;
+
+    ofstream ofs(snapshotDir() / name, ios::trunc);
+    for (const vector<string>& command : buffer) {
+        ofs << joinStrings(command, " ") << "\n";
+    }
+    return ofs.good();
+}
+
+bool DirectoryBufferStore::loadSnapshot(const string& name, vector<vector<string>>& buffer) {
+    ifstream ifs(snapshotDir() / name);
+    if (!ifs.is_open()) return false;
+
+    buffer.clear();
+    string line;
+    while (getline(ifs, line)) {
+        if (!line.empty()) buffer.push_back(split(line, ' '));
+    }
+    return true;
+}
+
+shared_ptr<BufferStore> DirectoryBufferStore::forNamespace(int nsid) {
+    path p = path(dirPath).lexically_normal();
+    if (!p.has_filename()) p = p.parent_path();
+    return make_shared<DirectoryBufferStore>(p.string() + ".ns" + to_string(nsid));
+}
+
+path DirectoryBufferStore::snapshotDir() const {
+    path p = path(dirPath).lexically_normal();
+    if (!p.has_filename()) p = p.parent_path();
+    return path(p.string() + ".snapshots");
+}
+
+vector<vector<string>> DirectoryBufferStore::parseFileNames(const vector<string>& fileNames) {
+    vector<vector<string>> result;
+    for (const string& fileName : fileNames) {
+        vector<string> splitName = split(fileName);
+        if (splitName.size() < 2) continue;
+        splitName.erase(splitName.begin());
+
+        if (splitName[0] == "empty") continue;
+
+        result.push_back(splitName);
+    }
+    return result;
+}
+
+bool DirectoryBufferStore::migrateLegacyFiles(vector<vector<string>>& buffer) {
+    buffer.clear();
+    error_code ec;
+    if (!exists(dirPath, ec)) {
+        create_directories(dirPath, ec);
+        return !ec;
+    }
+
+    map<int, path> slots;
+    for (const auto& entry : directory_iterator(dirPath, ec)) {
+        if (!entry.is_regular_file()) continue;
+        string fileName = entry.path().filename().string();
+        vector<string> splitName = split(fileName);
+        if (splitName.size() < 2 || splitName[0].empty() ||
+            splitName[0].find_first_not_of("0123456789") != string::npos) continue;
+        slots[stoi(splitName[0])] = entry.path();
+    }
+    if (ec) return false;
+    if (slots.empty()) return true;
+
+    vector<string> fileNames;
+    for (const auto& slot : slots) fileNames.push_back(slot.second.filename().string());
+    buffer = parseFileNames(fileNames);
+    if (!save(buffer)) return false;
+
+    for (const auto& slot : slots) remove(slot.second, ec);
+    return true;
+}
+
+bool DirectoryBufferStore::encode(const vector<vector<string>>& buffer, string& manifest) const {
+    if (buffer.size() > SLOT_COUNT) return false;
+
+    manifest.assign(MAGIC, 4);
+    Codec::putFixed(manifest, VERSION, 4);
+    Codec::putFixed(manifest, buffer.size(), 4);
+    for (const vector<string>& command : buffer) {
+        if (command.size() != 3 || (command[0] != "W" && command[0] != "E")) return false;
+        if (command[0] == "W" && !Codec::isValue(command[2])) return false;
+
+        uint64_t lba, payload;
+        try {
+            lba = stoul(command[1]);
+            payload = command[0] == "W" ? Codec::parseValue(command[2]) : stoul(command[2]);
+        }
+        catch (const exception&) {
+            return false;
+        }
+        manifest.push_back(command[0][0]);
+        Codec::putFixed(manifest, lba, 4);
+        Codec::putFixed(manifest, payload, 4);
+    }
+    manifest.resize(MANIFEST_SIZE, '\0');
+    return true;
+}
+
+bool DirectoryBufferStore::decode(const string& manifest, vector<vector<string>>& buffer) {
+    if (manifest.compare(0, 4, MAGIC, 4) != 0) return false;
+
+    size_t pos = 4;
+    uint64_t version, count;
+    if (!Codec::getFixed(manifest, pos, version, 4) || version != VERSION) return false;
+    if (!Codec::getFixed(manifest, pos, count, 4) || count > SLOT_COUNT) return false;
+
+    buffer.clear();
+    for (uint64_t slot = 0; slot < count; ++slot) {
+        char command = manifest[pos++];
+        uint64_t lba, payload;
+        Codec::getFixed(manifest, pos, lba, 4);
+        Codec::getFixed(manifest, pos, payload, 4);
+        if (command == 'W') buffer.push_back({ "W", to_string(lba), Codec::formatValue((uint32_t)payload) });
+        else if (command == 'E') buffer.push_back({ "E", to_string(lba), to_string(payload) });
+        else return false;
+    }
+    return true;
+}
+
+vector<string> DirectoryBufferStore::split(const string& str, char delimiter) {
+    vector<string> tokens;
+    string token;
+    stringstream ss(str);
+
+    while (getline(ss, token, delimiter)) {
+        tokens.push_back(token);
+    }
+
+    return tokens;
+}
+
+string DirectoryBufferStore::joinStrings(const vector<string>& vec, const string& delimiter) {
+    string result;
+    for (size_t i = 0; i < vec.size(); ++i) {
+        result += vec[i];
+        if (i != vec.size() - 1) {
+            result += delimiter;
+        }
+    }
+    return result;
+}
+
+bool MemoryBufferStore::load(vector<vector<string>>& buffer) {
+    buffer = saved;
+    return true;
+}
+
+bool MemoryBufferStore::save(const vector<vector<string>>& buffer) {
+    saved = buffer;
+    return true;
+}
+
+bool MemoryBufferStore::saveSnapshot(const string& name, const vector<vector<string>>& buffer) {
+    snapshots[name] = buffer;
+    return true;
+}
+
+bool MemoryBufferStore::loadSnapshot(const string& name, vector<vector<string>>& buffer) {
+    auto snapshot = snapshots.find(name);
+    if (snapshot == snapshots.end()) return false;
+
+    buffer = snapshot->second;
+    return true;
+}
+
+shared_ptr<BufferStore> MemoryBufferStore::forNamespace(int nsid) {
+    shared_ptr<BufferStore>& store = namespaces[nsid];
+    if (!store) store = make_shared<MemoryBufferStore>();
+    return store;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <filesystem>
+#include <stdexcept>
+
+#include "durability.h"
+#include "faultInjection.h"
+#include "codec.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+class BufferStore {
+public:
+    virtual ~BufferStore() = default;
+    virtual bool load(vector<vector<string>>& buffer) = 0;
+    virtual bool save(const vector<vector<string>>& buffer) = 0;
+    virtual bool sync() { return true; }
+    virtual bool saveSnapshot(const string& name, const vector<vector<string>>& buffer) = 0;
+    virtual bool loadSnapshot(const string& name, vector<vector<string>>& buffer) = 0;
+
+    // Where namespace nsid (1 and up) keeps its buffer; namespace 0 uses this store.
+    virtual shared_ptr<BufferStore> forNamespace(int nsid) = 0;
+};
+
+// The buffer is kept in a single fixed-size manifest inside dirPath:
+//   "SSDB", u32 version, u32 count, then SLOT_COUNT slots of
+//   { u8 command, u32 lba, u32 payload }   payload = value for W, size for E
+// Loading is one read of MANIFEST_SIZE bytes. Saves write a temp file and
+// rename it over the manifest, so a crash leaves the old or the new buffer.
+// Directories in the older one-file-per-command layout are migrated on the
+// first load.
+class DirectoryBufferStore : public BufferStore {
+public:
+    static constexpr int SLOT_COUNT = 8;
+    static constexpr int SLOT_SIZE = 9;
+    static constexpr int HEADER_SIZE = 12;
+    static constexpr int MANIFEST_SIZE = HEADER_SIZE + SLOT_COUNT * SLOT_SIZE;
+
+    explicit DirectoryBufferStore(const string& dirPath)
+        : dirPath(dirPath), manifestPath((path(dirPath) / MANIFEST_NAME).string()) {
+    }
+
+    bool load(vector<vector<string>>& buffer) override;
+    bool save(const vector<vector<string>>& buffer) override;
+    bool sync() override;
+
+    // Snapshots live next to the buffer directory, one command per line.
+    bool saveSnapshot(const string& name, const vector<vector<string>>& buffer) override;
+
+    bool loadSnapshot(const string& name, vector<vector<string>>& buffer) override;
+
+    // "<dirPath>.ns<nsid>", with its snapshots next to it.
+    shared_ptr<BufferStore> forNamespace(int nsid) override;
+
+private:
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'B' };
+    static constexpr const char* MANIFEST_NAME = "manifest";
+    static constexpr uint32_t VERSION = 1;
+
+    string dirPath;
+    string manifestPath;
+
+    path snapshotDir() const;
+    vector<vector<string>> parseFileNames(const vector<string>& fileNames);
+
+    // Old layout: one empty file per slot named "<slot>_<command args>",
+    // e.g. "1_W_5_0x12345678" or "3_empty".
+    bool migrateLegacyFiles(vector<vector<string>>& buffer);
+
+    bool encode(const vector<vector<string>>& buffer, string& manifest) const;
+    static bool decode(const string& manifest, vector<vector<string>>& buffer);
+
+    vector<string> split(const string& str, char delimiter = '_');
+
+    string joinStrings(const vector<string>& vec, const string& delimiter = "_");
+};
+
+class MemoryBufferStore : public BufferStore {
+public:
+    bool load(vector<vector<string>>& buffer) override;
+    bool save(const vector<vector<string>>& buffer) override;
+    bool saveSnapshot(const string& name, const vector<vector<string>>& buffer) override;
+    bool loadSnapshot(const string& name, vector<vector<string>>& buffer) override;
+    shared_ptr<BufferStore> forNamespace(int nsid) override;
+
+private:
+    vector<vector<string>> saved;
+    map<string, vector<vector<string>>> snapshots;
+    map<int, shared_ptr<BufferStore>> namespaces;
+};
\ No newline at end of file
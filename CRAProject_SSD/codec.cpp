@@ -0,0 +1,85 @@
+#include "codec.h"
+
+#include <sstream>
+#include <iomanip>
+
+void Codec::putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool Codec::getVarint(const string& in, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        unsigned char byte = in[pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool Codec::getVarint(istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+void Codec::putFixed(string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((char)((value >> (8 * i)) & 0xFF));
+}
+
+bool Codec::getFixed(const string& in, size_t& pos, uint64_t& value, int bytes) {
+    if (pos + bytes > in.size()) return false;
+    value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (uint64_t)(unsigned char)in[pos++] << (8 * i);
+    return true;
+}
+
+bool Codec::getFixed(istream& in, uint64_t& value, int bytes) {
+    value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (uint64_t)(byte & 0xFF) << (8 * i);
+    }
+    return true;
+}
+
+bool Codec::isValue(const string& text) {
+    if (text.size() != 10 || text.find("0x") != 0) return false;
+    const string valid = "0123456789ABCDEF";
+    for (int i = 2; i < 10; ++i) {
+        if (valid.find(text[i]) == string::npos) return false;
+    }
+    return true;
+}
+
+uint32_t Codec::parseValue(const string& text) {
+    return (uint32_t)stoul(text.substr(2), nullptr, 16);
+}
+
+bool Codec::tryParseValue(const string& text, uint32_t& value) {
+    if (text.size() != 10 || text[0] != '0' || text[1] != 'x') return false;
+    value = 0;
+    for (int i = 2; i < 10; ++i) {
+        char digit = text[i];
+        if (digit >= '0' && digit <= '9') value = (value << 4) | (uint32_t)(digit - '0');
+        else if (digit >= 'A' && digit <= 'F') value = (value << 4) | (uint32_t)(digit - 'A' + 10);
+        else return false;
+    }
+    return true;
+}
+
+string Codec::formatValue(uint32_t value) {
+    stringstream ss;
+    ss << "0x" << uppercase << hex << setw(8) << setfill('0') << value;
+    return ss.str();
+}
\ No newline at end of file
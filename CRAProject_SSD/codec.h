@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <istream>
+#include <cstdint>
+
+using namespace std;
+
+class Codec {
+public:
+    static void putVarint(string& out, uint64_t value);
+    static bool getVarint(const string& in, size_t& pos, uint64_t& value);
+    static bool getVarint(istream& in, uint64_t& value);
+
+    static void putFixed(string& out, uint64_t value, int bytes);
+    static bool getFixed(const string& in, size_t& pos, uint64_t& value, int bytes);
+    static bool getFixed(istream& in, uint64_t& value, int bytes);
+
+    // LBA values are "0x" followed by eight upper-case hex digits.
+    static bool isValue(const string& text);
+    static uint32_t parseValue(const string& text);
+
+    // isValue and parseValue in one pass.
+    static bool tryParseValue(const string& text, uint32_t& value);
+    static string formatValue(uint32_t value);
+};
\ No newline at end of file
@@ -1,152 +1,235 @@
-#include <vector>
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <filesystem>
-
-#include "ssdContext.cpp"
-
-using namespace std;
-using namespace std::filesystem;
-
-class Command {
-public:
-    virtual ~Command() = default;
-    virtual void execute() = 0;
-
-    const int LBA_MAX = 100;
-};
-
-class WriteCommand : public Command {
-public:
-    WriteCommand(SSDContext& context, int addr, const string& value)
-        : ctx(context), addr(addr), value(value) {
+#include "command.h"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+void Command::recordZeros(SSDContext& ctx, int addr, int size) {
+    ctx.health->recordZeros(addr, size);
+    if (!ctx.integrity) return;
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) ctx.integrity->record(addr + offsetIdx, 0);
+}
+
+void Command::useBinaryMode([[maybe_unused]] FILE* stream) {
+#if defined(_WIN32)
+    _setmode(_fileno(stream), _O_BINARY);
+#endif
+}
+
+void WriteCommand::execute() {
+    if (checkInvalidInputForWrite() < 0) return ctx.handleError();
+    if (!ctx.nand->write(addr, value)) return ctx.handleError();
+    if (ctx.timing) ctx.timing->program(addr);
+    uint32_t parsed = Codec::parseValue(value);
+    if (ctx.integrity) ctx.integrity->record(addr, parsed);
+    ctx.health->recordValue(addr, parsed);
+}
+
+int WriteCommand::checkInvalidInputForWrite() {
+    const string valid = "0123456789ABCDEF";
+    if (addr < 0 || addr >= LBA_MAX) return -1;
+    if (value.find("0x") != 0 || value.size() != 10) return -1;
+
+    for (int i = 2; i < 10; ++i) {
+        if (valid.find(value[i]) == string::npos) return -1;
     }
-
-    void execute() override {
-        if (checkInvalidInputForWrite() < 0) return ctx.handleError();
-        if (!ctx.openOrCreateNand(ios::in | ios::out)) return ctx.handleError();
-
-        streampos offset = 10 * addr;
-        ctx.nand.seekp(offset);
-        ctx.nand << value;
-        ctx.nand.close();
+    return 0;
+}
+
+void ReadCommand::execute() {
+    if (addr < 0 || addr >= LBA_MAX) return ctx.handleError();
+    string output;
+    if (!ctx.nand->read(addr, output)) return ctx.handleError();
+    if (ctx.timing) ctx.timing->read(addr);
+    if (ctx.integrity && !ctx.integrity->check(addr, output)) return ctx.handleCorruption();
+
+    ctx.output->write(output);
+}
+
+void EraseCommand::execute() {
+    if ((addr < 0 || addr >= LBA_MAX) ||
+        (addr + eraseSize > LBA_MAX)) {
+        return ctx.handleError();
     }
 
-private:
-    SSDContext& ctx;
-    int addr;
-    string value;
-
-    int checkInvalidInputForWrite() {
-        const string valid = "0123456789ABCDEF";
-        if (addr < 0 || addr >= LBA_MAX) return -1;
-        if (value.find("0x") != 0 || value.size() != 10) return -1;
+    bool erased = (ctx.eraseMode == EraseMode::Deallocate) ?
+        ctx.nand->deallocate(addr, eraseSize) : ctx.nand->erase(addr, eraseSize);
+    if (!erased) return ctx.handleError();
+    if (ctx.timing) ctx.timing->erase(addr, eraseSize);
+    recordZeros(ctx, addr, eraseSize);
+}
+
+void DeallocateCommand::execute() {
+    if ((addr < 0 || addr >= LBA_MAX) ||
+        (size < 0 || addr + size > LBA_MAX)) {
+        return ctx.handleError();
+    }
 
-        for (int i = 2; i < 10; ++i) {
-            if (valid.find(value[i]) == string::npos) return -1;
+    if (!ctx.nand->deallocate(addr, size)) return ctx.handleError();
+    if (ctx.timing) ctx.timing->erase(addr, size);
+    recordZeros(ctx, addr, size);
+    if (!ctx.nand->commit()) return ctx.handleError();
+    if (ctx.integrity && !ctx.integrity->commit()) return ctx.handleError();
+}
+
+void FlushCommand::execute() {
+    executeSlice((int)cmdbuffer.size());
+}
+
+bool FlushCommand::executeSlice(int count) {
+    size_t end = min(applied + (size_t)max(count, 0), cmdbuffer.size());
+    for (size_t i = applied; i < end; i++) {
+        FaultInjector::hit(FaultInjector::FLUSH_BEFORE_COMMAND);
+        if (cmdbuffer[i][0] == "W") {
+            int addr = stoi(cmdbuffer[i][1]);
+            unique_ptr<Command> cmd = make_unique<WriteCommand>(ctx, addr, cmdbuffer[i][2]);
+            cmd->execute();
+        }
+        else if (cmdbuffer[i][0] == "E") {
+            int addr = stoi(cmdbuffer[i][1]);
+            unique_ptr<Command> cmd = make_unique<EraseCommand>(ctx, addr, cmdbuffer[i][2]);
+            cmd->execute();
         }
-        return 0;
     }
-};
-
-class FastReadCommand : public Command {
-public:
-    FastReadCommand(SSDContext& context, string& value)
-        : ctx(context), value(value) {
+    applied = end;
+    if (applied < cmdbuffer.size()) return false;
+
+    if (!ctx.nand->commit()) ctx.handleError();
+    else if (ctx.integrity && !ctx.integrity->commit()) ctx.handleError();
+    return true;
+}
+
+void CloneCommand::execute() {
+    SSDConfig target = SSDConfig::inDirectory(targetDir);
+    error_code ec;
+    create_directories(targetDir, ec);
+    if (ec) return ctx.handleError();
+
+    if (!ctx.nand->cloneSnapshot(name, target.nandPath)) return ctx.handleError();
+    if (ctx.zones && !ctx.zones->cloneSnapshot(name, target.nandPath + ".zones")) return ctx.handleError();
+    if (!layout.empty() && !NamespaceLayout::save(target.nandPath + ".namespaces", layout)) return ctx.handleError();
+    shared_ptr<BufferStore> targetBuffer = make_shared<DirectoryBufferStore>(target.bufferPath);
+    for (size_t nsid = 0; nsid < buffers.size(); nsid++) {
+        shared_ptr<BufferStore> store = nsid == 0 ? targetBuffer : targetBuffer->forNamespace((int)nsid);
+        vector<vector<string>> existing;
+        if (!store->load(existing) || !store->save(buffers[nsid])) return ctx.handleError();
     }
-
-    void execute() override {
-        ctx.overwriteTextToFile("ssd_output.txt", value);
+}
+
+void ChecksumCommand::execute() {
+    uint32_t crc;
+    if (!DeviceScanner(LBA_MAX).checksum(*ctx.nand, cmdbuffer, crc)) return ctx.handleError();
+    ctx.output->write(Codec::formatValue(crc));
+}
+
+void CompareCommand::execute() {
+    if (!is_directory(targetDir)) return ctx.handleError();
+    SSDConfig target = SSDConfig::detectInDirectory(targetDir);
+    shared_ptr<NandStorage> targetNand = SSDContext::makeNandStorage(target);
+    vector<vector<string>> targetBuffer;
+    if (!loadBuffers(target, targetBuffer)) return ctx.handleError();
+
+    vector<int> mismatched;
+    if (!DeviceScanner(LBA_MAX).compare(*ctx.nand, cmdbuffer, *targetNand, targetBuffer, mismatched)) {
+        return ctx.handleError();
     }
-
-private:
-    SSDContext& ctx;
-    string value;
-};
-
-class ReadCommand : public Command {
-public:
-    ReadCommand(SSDContext& context, int addr)
-        : ctx(context), addr(addr) {
+    if (mismatched.empty()) return ctx.output->write("MATCH");
+    ctx.output->write("MISMATCH " + to_string(mismatched.size()) + " " + to_string(mismatched[0]));
+}
+
+bool CompareCommand::loadBuffers(const SSDConfig& target, vector<vector<string>>& buffer) {
+    vector<SSDNamespace> layout;
+    NamespaceLayout::load(target.nandPath + ".namespaces", layout);
+    shared_ptr<BufferStore> store = make_shared<DirectoryBufferStore>(target.bufferPath);
+    if (!store->load(buffer)) return false;
+
+    for (int nsid = 1; nsid < (int)layout.size(); nsid++) {
+        vector<vector<string>> namespaceBuffer;
+        if (!store->forNamespace(nsid)->load(namespaceBuffer)) return false;
+        buffer.insert(buffer.end(), namespaceBuffer.begin(), namespaceBuffer.end());
     }
-
-    void execute() override {
-        if (addr < 0 || addr >= LBA_MAX) return ctx.handleError();
-        if (!ctx.openOrCreateNand(ios::in)) return ctx.handleError();
-
-        string readResult(10, '\0');
-        streampos offset = 10 * addr;
-
-        ctx.nand.seekp(offset);
-        ctx.nand.read(&readResult[0], 10);
-        streamsize bytesRead = ctx.nand.gcount();
-        ctx.nand.close();
-
-        string output = (bytesRead == 0) ? "0x00000000" : readResult;
-        ctx.overwriteTextToFile("ssd_output.txt", output);
+    return true;
+}
+
+void RollbackCommand::execute() {
+    if (ctx.zones && !ctx.zones->hasSnapshot(name)) return ctx.handleError();
+    if (!ctx.nand->loadSnapshot(name)) return ctx.handleError();
+    if (ctx.zones && !ctx.zones->loadSnapshot(name)) return ctx.handleError();
+    if (ctx.integrity && !ctx.integrity->rebuild()) return ctx.handleError();
+    if (!ctx.health->rebuildUsage()) return ctx.handleError();
+    if (!restoreBuffers()) return ctx.handleError();
+}
+
+void ScrubCommand::execute() {
+    if (!ctx.integrity) return ctx.handleError();
+
+    vector<int> corrupt;
+    if (!ctx.integrity->scrub(cmdbuffer, LBA_MAX, corrupt)) return ctx.handleError();
+    if (corrupt.empty()) return ctx.output->write("CLEAN");
+    ctx.output->write("CORRUPT " + to_string(corrupt.size()) + " " + to_string(corrupt[0]));
+}
+
+void HealthCommand::execute() {
+    string statistics = log == ctx.health ? ctx.nand->statistics() : "";
+    ctx.output->write(statistics.empty() ? log->report() : log->report() + " " + statistics);
+}
+
+void ZoneCommand::execute() {
+    if (!ctx.zones || zone < 0 || zone >= ctx.zones->getZoneCount()) return ctx.handleError();
+
+    if (action == "ZRESET") {
+        int addr = ctx.zones->zoneStart(zone);
+        int size = ctx.zones->zoneCapacity(zone);
+        if (!ctx.nand->deallocate(addr, size)) return ctx.handleError();
+        if (ctx.timing) ctx.timing->erase(addr, size);
+        recordZeros(ctx, addr, size);
+        if (!ctx.nand->commit()) return ctx.handleError();
+        if (ctx.integrity && !ctx.integrity->commit()) return ctx.handleError();
+        if (!ctx.zones->reset(zone)) return ctx.handleError();
+        return;
     }
 
-private:
-    SSDContext& ctx;
-    int addr;
-};
+    bool changed = false;
+    if (action == "ZOPEN") changed = ctx.zones->open(zone);
+    else if (action == "ZCLOSE") changed = ctx.zones->close(zone);
+    else if (action == "ZFINISH") changed = ctx.zones->finish(zone);
+    if (!changed) ctx.handleError();
+}
 
-class EraseCommand : public Command {
-public:
-    EraseCommand(SSDContext& context, int addr, string size)
-        : ctx(context), addr(addr) {
-        eraseSize = atoi(size.c_str());
+void ExportCommand::execute() {
+    if (ctx.timing) {
+        for (int addr = 0; addr < LBA_MAX; addr++) ctx.timing->read(addr);
     }
-    void execute() override {
-        if ((addr < 0 || addr >= LBA_MAX) ||
-            (addr + eraseSize > LBA_MAX) ||
-            (!ctx.openOrCreateNand(ios::in | ios::out))) {
-            ctx.handleError();
-        }
 
-        for (int offsetIdx = 0; offsetIdx < eraseSize; offsetIdx++) {
-            streampos offsetBase = 10 * (addr + offsetIdx);
-            ctx.nand.seekp(offsetBase);
-            ctx.nand << "0x00000000";
-        }
-        ctx.nand.close();
-    }
-private:
-    SSDContext& ctx;
-    int addr;
-    int eraseSize;
-};
-
-class FlushCommand : public Command {
-public:
-    FlushCommand(SSDContext& context,const vector<vector<string>>& buffer)
-        : ctx(context), cmdbuffer(buffer) {
-    }
-    void execute() override {
-        for (int i = 0; i < cmdbuffer.size(); i++) {
-            if (cmdbuffer[i][0] == "W") {
-                int addr = stoi(cmdbuffer[i][1]);
-                unique_ptr<Command> cmd = make_unique<WriteCommand>(ctx, addr, cmdbuffer[i][2]);
-                cmd->execute();
-            }
-            else if (cmdbuffer[i][0] == "E") {
-                int addr = stoi(cmdbuffer[i][1]);
-                unique_ptr<Command> cmd = make_unique<EraseCommand>(ctx, addr, cmdbuffer[i][2]);
-                cmd->execute();
-            }
-        }
-        cmdbuffer.clear();
+    if (target == "-") {
+        if (binary) useBinaryMode(stdout);
+        if (!ImageStream::exportImage(*ctx.nand, cmdbuffer, cout, binary, LBA_MAX)) return ctx.handleError();
         return;
     }
 
-private:
-    vector<vector<string>> cmdbuffer;
-    SSDContext& ctx;
-};
-
-class NoopCommand : public Command
-{
-public:
-    void execute() override {}
-};
\ No newline at end of file
+    ofstream out(target, ios::binary | ios::trunc);
+    if (!out.is_open() || !ImageStream::exportImage(*ctx.nand, cmdbuffer, out, binary, LBA_MAX)) return ctx.handleError();
+}
+
+void ImportCommand::execute() {
+    ifstream file;
+    if (source != "-") file.open(source, ios::binary);
+    else if (binary) useBinaryMode(stdin);
+    istream& in = source == "-" ? cin : file;
+    if (source != "-" && !file.is_open()) return ctx.handleError();
+
+    vector<uint32_t> values;
+    if (!ImageStream::importImage(in, binary, LBA_MAX, values)) return ctx.handleError();
+    if (!ctx.nand->writeRange(0, LBA_MAX, values.data()) || !ctx.nand->commit()) return ctx.handleError();
+    for (int addr = 0; addr < LBA_MAX; addr++) {
+        if (ctx.integrity) ctx.integrity->record(addr, values[addr]);
+        ctx.health->recordValue(addr, values[addr]);
+        if (ctx.timing) ctx.timing->program(addr);
+    }
+    if (ctx.integrity && !ctx.integrity->commit()) return ctx.handleError();
+    discardBuffers();
+}
\ No newline at end of file
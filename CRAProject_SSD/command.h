@@ -0,0 +1,318 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdio>
+#include <functional>
+
+#include "ssdContext.h"
+#include "bufferStore.h"
+#include "faultInjection.h"
+#include "deviceScan.h"
+#include "imageStream.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+class Command {
+public:
+    virtual ~Command() = default;
+    virtual void execute() = 0;
+
+    static constexpr int LBA_MAX = 100;
+
+protected:
+    // Erased and deallocated LBAs read as zero.
+    static void recordZeros(SSDContext& ctx, int addr, int size);
+
+    // Stops Windows from translating line ends in binary data on stdin/stdout.
+    static void useBinaryMode(FILE* stream);
+};
+
+class WriteCommand : public Command {
+public:
+    WriteCommand(SSDContext& context, int addr, const string& value)
+        : ctx(context), addr(addr), value(value) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    int addr;
+    string value;
+
+    int checkInvalidInputForWrite();
+};
+
+class FastReadCommand : public Command {
+public:
+    FastReadCommand(SSDContext& context, string& value)
+        : ctx(context), value(value) {
+    }
+
+    void execute() override {
+        ctx.output->write(value);
+    }
+
+private:
+    SSDContext& ctx;
+    string value;
+};
+
+class ReadCommand : public Command {
+public:
+    ReadCommand(SSDContext& context, int addr)
+        : ctx(context), addr(addr) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    int addr;
+};
+
+class EraseCommand : public Command {
+public:
+    EraseCommand(SSDContext& context, int addr, string size)
+        : ctx(context), addr(addr) {
+        eraseSize = atoi(size.c_str());
+    }
+    void execute() override;
+private:
+    SSDContext& ctx;
+    int addr;
+    int eraseSize;
+};
+
+class DeallocateCommand : public Command {
+public:
+    DeallocateCommand(SSDContext& context, int addr, int size)
+        : ctx(context), addr(addr), size(size) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    int addr;
+    int size;
+};
+
+class FlushCommand : public Command {
+public:
+    FlushCommand(SSDContext& context,const vector<vector<string>>& buffer)
+        : ctx(context), cmdbuffer(buffer) {
+    }
+    void execute() override;
+
+    // Applies the next count buffered commands, and commits once all of them
+    // are applied; true at that point.
+    bool executeSlice(int count);
+
+    const vector<vector<string>>& getBuffer() const {
+        return cmdbuffer;
+    }
+
+private:
+    vector<vector<string>> cmdbuffer;
+    SSDContext& ctx;
+    size_t applied = 0;
+};
+
+class SnapshotCommand : public Command {
+public:
+    SnapshotCommand(SSDContext& context, const string& name)
+        : ctx(context), name(name) {
+    }
+
+    void execute() override {
+        if (!ctx.nand->saveSnapshot(name)) return ctx.handleError();
+        if (ctx.zones && !ctx.zones->saveSnapshot(name)) return ctx.handleError();
+    }
+
+private:
+    SSDContext& ctx;
+    string name;
+};
+
+class RollbackCommand : public Command {
+public:
+    RollbackCommand(SSDContext& context, const string& name, const function<bool()>& restoreBuffers)
+        : ctx(context), name(name), restoreBuffers(restoreBuffers) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    string name;
+    function<bool()> restoreBuffers;
+};
+
+// Materializes a snapshot as an independent device in targetDir, laid out
+// like SSDConfig::inDirectory so a driver can be opened on it directly.
+// buffers holds one snapshot buffer per namespace of layout (just one when
+// the layout is empty); the clone is split the same way.
+class CloneCommand : public Command {
+public:
+    CloneCommand(SSDContext& context, const string& name, const string& targetDir,
+        const vector<vector<vector<string>>>& buffers, const vector<SSDNamespace>& layout = {})
+        : ctx(context), name(name), targetDir(targetDir), buffers(buffers), layout(layout) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    string name;
+    string targetDir;
+    vector<vector<vector<string>>> buffers;
+    vector<SSDNamespace> layout;
+};
+
+// Writes the CRC32C of the whole device, buffered commands included.
+class ChecksumCommand : public Command {
+public:
+    ChecksumCommand(SSDContext& context, const vector<vector<string>>& buffer)
+        : ctx(context), cmdbuffer(buffer) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    vector<vector<string>> cmdbuffer;
+};
+
+// Compares the device with the one in targetDir (as laid out by
+// SSDConfig::inDirectory), both with their buffers applied. Writes "MATCH",
+// or "MISMATCH <count> <first lba>".
+class CompareCommand : public Command {
+public:
+    CompareCommand(SSDContext& context, const vector<vector<string>>& buffer, const string& targetDir)
+        : ctx(context), cmdbuffer(buffer), targetDir(targetDir) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    vector<vector<string>> cmdbuffer;
+    string targetDir;
+
+    // The buffers of every namespace of the device at target, in one list.
+    static bool loadBuffers(const SSDConfig& target, vector<vector<string>>& buffer);
+};
+
+// Verifies every LBA against its CRC; writes "CLEAN", or
+// "CORRUPT <count> <first lba>". Needs verification to be on.
+class ScrubCommand : public Command {
+public:
+    ScrubCommand(SSDContext& context, const vector<vector<string>>& buffer)
+        : ctx(context), cmdbuffer(buffer) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    vector<vector<string>> cmdbuffer;
+};
+
+// Writes the device statistics kept by HealthLog as "key=value" pairs, or
+// those of one namespace when given its log.
+class HealthCommand : public Command {
+public:
+    explicit HealthCommand(SSDContext& context)
+        : HealthCommand(context, context.health) {
+    }
+
+    HealthCommand(SSDContext& context, shared_ptr<HealthLog> log)
+        : ctx(context), log(log) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    shared_ptr<HealthLog> log;
+};
+
+// ZOPEN, ZCLOSE, ZFINISH or ZRESET of one zone; a reset also deallocates
+// the zone's LBAs.
+class ZoneCommand : public Command {
+public:
+    ZoneCommand(SSDContext& context, const string& action, int zone)
+        : ctx(context), action(action), zone(zone) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    string action;
+    int zone;
+};
+
+// Writes ZoneTable::report().
+class ZoneReportCommand : public Command {
+public:
+    explicit ZoneReportCommand(SSDContext& context)
+        : ctx(context) {
+    }
+
+    void execute() override {
+        if (!ctx.zones) return ctx.handleError();
+        ctx.output->write(ctx.zones->report());
+    }
+
+private:
+    SSDContext& ctx;
+};
+
+class NoopCommand : public Command
+{
+public:
+    void execute() override {}
+};
+
+// Streams the whole device, buffered commands included, to target ("-" for
+// stdout) in the ImageStream text or binary form.
+class ExportCommand : public Command {
+public:
+    ExportCommand(SSDContext& context, const vector<vector<string>>& buffer, const string& target, bool binary)
+        : ctx(context), cmdbuffer(buffer), target(target), binary(binary) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    vector<vector<string>> cmdbuffer;
+    string target;
+    bool binary;
+};
+
+// Replaces the whole device with the image streamed from source ("-" for
+// stdin), commits it and then calls discardBuffers, as the import overwrote
+// every LBA the buffered commands would have written. The stream is read
+// and checked in full first, so a bad one leaves the device untouched.
+class ImportCommand : public Command {
+public:
+    ImportCommand(SSDContext& context, const string& source, bool binary, const function<void()>& discardBuffers)
+        : ctx(context), source(source), binary(binary), discardBuffers(discardBuffers) {
+    }
+
+    void execute() override;
+
+private:
+    SSDContext& ctx;
+    string source;
+    bool binary;
+    function<void()> discardBuffers;
+};
\ No newline at end of file
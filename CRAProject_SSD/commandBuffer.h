@@ -0,0 +1,109 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#include "ssdContext.h"
+#include "bufferStore.h"
+#include "bufferCoalescer.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+class CommandBufferManager {
+public:
+    CommandBufferManager(SSDContext context, shared_ptr<BufferStore> bufferStore,
+        int capacity = SSDNamespace::DEFAULT_BUFFER_CAPACITY)
+        : ctx(context), store(bufferStore), capacity(capacity) {
+        if (!store->load(buffer)) ctx.handleError();
+    }
+
+    ~CommandBufferManager() = default;
+
+    CommandBufferManager(const CommandBufferManager&) = delete;
+    CommandBufferManager& operator=(const CommandBufferManager&) = delete;
+    CommandBufferManager(CommandBufferManager&&) = delete;
+    CommandBufferManager& operator=(CommandBufferManager&&) = delete;
+
+    void addCommandBuffer(vector<vector<string>>& buffer, const vector<string>& args) {
+        buffer.push_back(args);
+    }
+
+    string getCommand(vector<string>& args);
+
+    // The value the newest W or E in entries gives addr, or "" if none does.
+    static string lookup(const vector<vector<string>>& entries, int addr);
+
+    void writeCommandBuffer(const vector<vector<string>>& bufferInput) {
+        if (!store->save(bufferInput)) return ctx.handleError();
+    }
+
+    bool sync() {
+        return store->sync();
+    }
+
+    void setOutput(shared_ptr<OutputSink> output) {
+        ctx.output = output;
+    }
+
+    // Also counts merges in the statistics of the namespace this buffer serves.
+    void setNamespaceHealth(shared_ptr<HealthLog> health) {
+        namespaceHealth = health;
+    }
+
+    int getCapacity() const {
+        return capacity;
+    }
+
+    void eraseAll(void);
+    bool pushCommandBuffer(vector<string> args);
+
+    // A flush leaves the old buffer persisted until its commands are on the
+    // NAND, so a crash mid-flush replays them instead of losing them.
+    void completeFlush()
+    {
+        writeCommandBuffer(buffer);
+    }
+
+    // Drops buffered writes that a deallocate makes obsolete. Buffered erases
+    // are kept: they only ever produce zeros, which is what a deallocated LBA
+    // reads as anyway.
+    void discardRange(int addr, int size);
+
+    bool saveSnapshot(const string& name) {
+        return store->saveSnapshot(name, buffer);
+    }
+
+    bool readSnapshot(const string& name, vector<vector<string>>& snapshot) {
+        return store->loadSnapshot(name, snapshot);
+    }
+
+    bool restore(const vector<vector<string>>& snapshot);
+    void mergeAlgorithm(vector<string> args);
+    bool mergeBuffer(int targetStart, int targetEnd, int& newStart, int& newEnd, vector<string>& command);
+    void setBuffer(const vector<vector<string>>& inputBuffer);
+
+    vector<vector<string>>& getBuffer()
+    {
+        return buffer;
+    }
+
+    vector<vector<string>>& getFlushBuffer()
+    {
+        return flushBuffer;
+    }
+
+private:
+    SSDContext ctx;
+    shared_ptr<BufferStore> store;
+    int capacity;
+    shared_ptr<HealthLog> namespaceHealth;
+    vector<vector<string>> buffer;
+    vector<vector<string>> flushBuffer;
+};
\ No newline at end of file
@@ -0,0 +1,467 @@
+#include "compressedNandStorage.h"
+#include "faultInjection.h"
+
+bool CompressedNandStorage::read(int addr, string& value) {
+    if (addr < 0 || addr >= lbaCount) return false;
+    vector<uint32_t>* cells = loadChunk(addr / CHUNK_LBAS);
+    if (cells == nullptr) return false;
+
+    value = Codec::formatValue((*cells)[addr % CHUNK_LBAS]);
+    return true;
+}
+
+bool CompressedNandStorage::write(int addr, const string& value) {
+    if (addr < 0 || addr >= lbaCount || !Codec::isValue(value)) return false;
+    vector<uint32_t>* cells = loadChunk(addr / CHUNK_LBAS);
+    if (cells == nullptr) return false;
+
+    (*cells)[addr % CHUNK_LBAS] = Codec::parseValue(value);
+    dirty.insert(addr / CHUNK_LBAS);
+    return true;
+}
+
+bool CompressedNandStorage::erase(int addr, int size) {
+    if (addr < 0 || addr + size > lbaCount) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        vector<uint32_t>* cells = loadChunk((addr + offsetIdx) / CHUNK_LBAS);
+        if (cells == nullptr) return false;
+        (*cells)[(addr + offsetIdx) % CHUNK_LBAS] = 0;
+        dirty.insert((addr + offsetIdx) / CHUNK_LBAS);
+    }
+    return true;
+}
+
+bool CompressedNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || addr + count > lbaCount) return false;
+
+    for (int lba = addr; lba < addr + count;) {
+        vector<uint32_t>* cells = loadChunk(lba / CHUNK_LBAS);
+        if (cells == nullptr) return false;
+        int chunkEnd = min(addr + count, (lba / CHUNK_LBAS + 1) * CHUNK_LBAS);
+        copy(cells->begin() + lba % CHUNK_LBAS, cells->begin() + (chunkEnd - 1) % CHUNK_LBAS + 1, values + (lba - addr));
+        lba = chunkEnd;
+    }
+    return true;
+}
+
+bool CompressedNandStorage::writeRange(int addr, int count, const uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount) return false;
+
+    for (int lba = addr; lba < addr + count;) {
+        vector<uint32_t>* cells = loadChunk(lba / CHUNK_LBAS);
+        if (cells == nullptr) return false;
+        int chunkEnd = min(addr + count, (lba / CHUNK_LBAS + 1) * CHUNK_LBAS);
+        copy(values + (lba - addr), values + (chunkEnd - addr), cells->begin() + lba % CHUNK_LBAS);
+        dirty.insert(lba / CHUNK_LBAS);
+        lba = chunkEnd;
+    }
+    return true;
+}
+
+bool CompressedNandStorage::isImage(const string& fileName) {
+    ifstream image(fileName, ios::binary);
+    char magic[4] = {};
+    image.read(magic, 4);
+    return image.gcount() == 4 && equal(magic, magic + 4, MAGIC);
+}
+
+bool CompressedNandStorage::commit() {
+    if (dirty.empty()) return true;
+    if (!open()) return false;
+    if (!imageExists) return rewriteImage();
+
+    fstream image(fileName, ios::in | ios::out | ios::binary);
+    if (!image.is_open()) return false;
+
+    image.seekp(0, ios::end);
+    uint64_t offset = (uint64_t)image.tellp();
+    for (int chunk : dirty) {
+        string blob = encode(cache[chunk]);
+        index[chunk] = { blob.empty() ? 0 : (uint32_t)offset, (uint32_t)blob.size() };
+        image.write(blob.data(), blob.size());
+        offset += blob.size();
+    }
+
+    image.flush();
+    if (!switchIndex(image)) return false;
+    image.close();
+    if (image.fail()) return false;
+    dirty.clear();
+
+    return compactIfNeeded(offset);
+}
+
+bool CompressedNandStorage::sync() {
+    if (!commit()) return false;
+    if (!exists(fileName)) return true;
+    return syncFile(fileName);
+}
+
+bool CompressedNandStorage::saveSnapshot(const string& name) {
+    if (!commit() || !open()) return false;
+
+    snapshots[name] = index;
+    return writeCatalog();
+}
+
+bool CompressedNandStorage::loadSnapshot(const string& name) {
+    if (!open()) return false;
+    auto snapshot = snapshots.find(name);
+    if (snapshot == snapshots.end()) return false;
+
+    index = snapshot->second;
+    cache.clear();
+    dirty.clear();
+    if (!imageExists) return true;
+
+    fstream image(fileName, ios::in | ios::out | ios::binary);
+    return image.is_open() && switchIndex(image);
+}
+
+bool CompressedNandStorage::removeSnapshot(const string& name) {
+    if (!open() || snapshots.erase(name) == 0) return false;
+
+    return writeCatalog();
+}
+
+bool CompressedNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    if (!commit() || !open()) return false;
+    auto snapshot = snapshots.find(name);
+    if (snapshot == snapshots.end()) return false;
+
+    error_code ec;
+    remove(targetPath, ec);
+    if (!imageExists) return true;
+    if (!copy_file(fileName, targetPath, ec)) return false;
+
+    CompressedNandStorage target(targetPath, lbaCount);
+    if (!target.loadSnapshot(name)) return false;
+    target.snapshots.clear();
+    return target.rewriteImage();
+}
+
+int CompressedNandStorage::storedChunkCount() {
+    if (!open()) return 0;
+    int stored = 0;
+    for (const ChunkEntry& entry : index) {
+        if (entry.length > 0) stored++;
+    }
+    return stored;
+}
+
+bool CompressedNandStorage::open() {
+    if (opened) return !openFailed;
+    opened = true;
+    index.assign(chunkCount, { 0, 0 });
+
+    ifstream image(fileName, ios::binary);
+    if (!image.is_open() || image.peek() == EOF) return true;
+    imageExists = true;
+    openFailed = !readHeader(image) || !image.seekg(indexOffset(activeIndex)) || !readIndex(image, index) || !readCatalog(image);
+    return !openFailed;
+}
+
+bool CompressedNandStorage::readHeader(ifstream& image) {
+    string header(HEADER_SIZE, '\0');
+    image.read(&header[0], HEADER_SIZE);
+    if (image.gcount() != HEADER_SIZE || header.compare(0, 4, MAGIC, 4) != 0) return false;
+
+    size_t pos = 4;
+    uint64_t version, storedLbaCount, storedChunkLbas, storedActiveIndex, catalogOffset, catalogLength;
+    if (!Codec::getFixed(header, pos, version, 4) || version != VERSION) return false;
+    if (!Codec::getFixed(header, pos, storedLbaCount, 4) || (int)storedLbaCount != lbaCount) return false;
+    if (!Codec::getFixed(header, pos, storedChunkLbas, 4) || storedChunkLbas != CHUNK_LBAS) return false;
+    if (!Codec::getFixed(header, pos, storedActiveIndex, 4) || storedActiveIndex > 1) return false;
+    if (!Codec::getFixed(header, pos, catalogOffset, 4) || !Codec::getFixed(header, pos, catalogLength, 4)) return false;
+
+    activeIndex = (int)storedActiveIndex;
+    catalog = { (uint32_t)catalogOffset, (uint32_t)catalogLength };
+    return true;
+}
+
+bool CompressedNandStorage::readIndex(istream& in, vector<ChunkEntry>& entries) {
+    string indexBytes(chunkCount * 8, '\0');
+    in.read(&indexBytes[0], indexBytes.size());
+    if ((size_t)in.gcount() != indexBytes.size()) return false;
+
+    size_t pos = 0;
+    return decodeIndex(indexBytes, pos, entries);
+}
+
+bool CompressedNandStorage::decodeIndex(const string& in, size_t& pos, vector<ChunkEntry>& entries) {
+    entries.assign(chunkCount, { 0, 0 });
+    for (ChunkEntry& entry : entries) {
+        uint64_t offset, length;
+        if (!Codec::getFixed(in, pos, offset, 4) || !Codec::getFixed(in, pos, length, 4)) return false;
+        entry = { (uint32_t)offset, (uint32_t)length };
+    }
+    return true;
+}
+
+bool CompressedNandStorage::readCatalog(ifstream& image) {
+    snapshots.clear();
+    if (catalog.length == 0) return true;
+
+    string bytes(catalog.length, '\0');
+    image.seekg(catalog.offset);
+    image.read(&bytes[0], bytes.size());
+    if ((size_t)image.gcount() != bytes.size()) return false;
+
+    size_t pos = 0;
+    uint64_t count;
+    if (!Codec::getVarint(bytes, pos, count)) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t nameLength;
+        if (!Codec::getVarint(bytes, pos, nameLength) || pos + nameLength > bytes.size()) return false;
+        string name = bytes.substr(pos, nameLength);
+        pos += nameLength;
+        if (!decodeIndex(bytes, pos, snapshots[name])) return false;
+    }
+    return true;
+}
+
+bool CompressedNandStorage::switchIndex(fstream& image) {
+    string indexBytes = encodeIndex(index);
+    image.seekp(indexOffset(1 - activeIndex));
+    image.write(indexBytes.data(), indexBytes.size());
+    image.flush();
+    FaultInjector::hit(FaultInjector::IMAGE_BEFORE_INDEX_SWITCH);
+
+    activeIndex = 1 - activeIndex;
+    string header = encodeHeader();
+    image.seekp(0);
+    image.write(header.data(), header.size());
+    image.flush();
+    if (image.good()) return true;
+
+    activeIndex = 1 - activeIndex;
+    return false;
+}
+
+bool CompressedNandStorage::writeCatalog() {
+    if (!imageExists) return rewriteImage();
+
+    fstream image(fileName, ios::in | ios::out | ios::binary);
+    if (!image.is_open()) return false;
+
+    string bytes = encodeCatalog();
+    image.seekp(0, ios::end);
+    uint64_t offset = (uint64_t)image.tellp();
+    image.write(bytes.data(), bytes.size());
+    catalog = { bytes.empty() ? 0 : (uint32_t)offset, (uint32_t)bytes.size() };
+
+    string header = encodeHeader();
+    image.seekp(0);
+    image.write(header.data(), header.size());
+    image.close();
+    if (image.fail()) return false;
+
+    return compactIfNeeded(offset + bytes.size());
+}
+
+vector<uint32_t>* CompressedNandStorage::loadChunk(int chunk) {
+    auto cached = cache.find(chunk);
+    if (cached != cache.end()) return &cached->second;
+    if (!open()) return nullptr;
+
+    vector<uint32_t> cells(CHUNK_LBAS, 0);
+    if (!readChunk(index[chunk], cells)) return nullptr;
+
+    if (cache.size() >= CACHE_CHUNKS_MAX) evictClean();
+    return &(cache[chunk] = move(cells));
+}
+
+bool CompressedNandStorage::readChunk(const ChunkEntry& entry, vector<uint32_t>& cells) {
+    if (entry.length == 0) return true;
+
+    string blob;
+    return readBlob(entry, blob) && decode(blob, cells);
+}
+
+bool CompressedNandStorage::readBlob(const ChunkEntry& entry, string& blob) {
+    ifstream image(fileName, ios::binary);
+    blob.assign(entry.length, '\0');
+    image.seekg(entry.offset);
+    image.read(&blob[0], entry.length);
+    return (uint32_t)image.gcount() == entry.length;
+}
+
+void CompressedNandStorage::evictClean() {
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (dirty.count(it->first) == 0) it = cache.erase(it);
+        else ++it;
+    }
+}
+
+uint64_t CompressedNandStorage::liveBytes() const {
+    map<uint32_t, uint32_t> referenced;
+    for (const ChunkEntry& entry : index) {
+        if (entry.length > 0) referenced[entry.offset] = entry.length;
+    }
+    for (const auto& snapshot : snapshots) {
+        for (const ChunkEntry& entry : snapshot.second) {
+            if (entry.length > 0) referenced[entry.offset] = entry.length;
+        }
+    }
+
+    uint64_t live = catalog.length;
+    for (const auto& blob : referenced) live += blob.second;
+    return live;
+}
+
+bool CompressedNandStorage::compactIfNeeded(uint64_t fileBytes) {
+    uint64_t garbageBytes = fileBytes - dataOffset() - liveBytes();
+    if (garbageBytes > COMPACT_MIN_BYTES && garbageBytes > liveBytes()) return rewriteImage();
+    return true;
+}
+
+bool CompressedNandStorage::rewriteImage() {
+    vector<string> blobs;
+    map<uint32_t, uint32_t> relocated;
+    uint64_t offset = dataOffset();
+    auto place = [&](ChunkEntry& entry, const string& blob) {
+        if (blob.empty()) {
+            entry = { 0, 0 };
+            return;
+        }
+        entry = { (uint32_t)offset, (uint32_t)blob.size() };
+        blobs.push_back(blob);
+        offset += blob.size();
+    };
+    auto relocate = [&](ChunkEntry& entry) {
+        if (entry.length == 0) return true;
+        auto moved = relocated.find(entry.offset);
+        if (moved != relocated.end()) {
+            entry.offset = moved->second;
+            return true;
+        }
+
+        string blob;
+        if (!readBlob(entry, blob)) return false;
+        relocated[entry.offset] = (uint32_t)offset;
+        place(entry, blob);
+        return true;
+    };
+
+    vector<ChunkEntry> newIndex = index;
+    map<string, vector<ChunkEntry>> newSnapshots = snapshots;
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        if (dirty.count(chunk) > 0 || !imageExists) {
+            auto cached = cache.find(chunk);
+            if (cached != cache.end()) place(newIndex[chunk], encode(cached->second));
+            else newIndex[chunk] = { 0, 0 };
+        }
+        else if (!relocate(newIndex[chunk])) {
+            return false;
+        }
+    }
+    for (auto& snapshot : newSnapshots) {
+        for (ChunkEntry& entry : snapshot.second) {
+            if (imageExists && !relocate(entry)) return false;
+            if (!imageExists) entry = { 0, 0 };
+        }
+    }
+
+    vector<ChunkEntry> oldIndex = index;
+    map<string, vector<ChunkEntry>> oldSnapshots = snapshots;
+    int oldActiveIndex = activeIndex;
+    index = newIndex;
+    snapshots = newSnapshots;
+    activeIndex = 0;
+    string catalogBytes = encodeCatalog();
+    catalog = { catalogBytes.empty() ? 0 : (uint32_t)offset, (uint32_t)catalogBytes.size() };
+
+    string tempName = fileName + ".tmp";
+    bool written = false;
+    {
+        ofstream image(tempName, ios::binary | ios::trunc);
+        string header = encodeHeader();
+        string indexBytes = encodeIndex(index);
+        image.write(header.data(), header.size());
+        image.write(indexBytes.data(), indexBytes.size());
+        image.write(indexBytes.data(), indexBytes.size());
+        for (const string& blob : blobs) image.write(blob.data(), blob.size());
+        image.write(catalogBytes.data(), catalogBytes.size());
+        written = image.is_open() && image.good();
+    }
+
+    error_code ec;
+    if (written) rename(tempName, fileName, ec);
+    if (!written || ec) {
+        index = oldIndex;
+        snapshots = oldSnapshots;
+        activeIndex = oldActiveIndex;
+        return false;
+    }
+
+    imageExists = true;
+    dirty.clear();
+    return true;
+}
+
+string CompressedNandStorage::encodeHeader() const {
+    string header(MAGIC, 4);
+    Codec::putFixed(header, VERSION, 4);
+    Codec::putFixed(header, lbaCount, 4);
+    Codec::putFixed(header, CHUNK_LBAS, 4);
+    Codec::putFixed(header, activeIndex, 4);
+    Codec::putFixed(header, catalog.offset, 4);
+    Codec::putFixed(header, catalog.length, 4);
+    return header;
+}
+
+string CompressedNandStorage::encodeIndex(const vector<ChunkEntry>& entries) {
+    string indexBytes;
+    for (const ChunkEntry& entry : entries) {
+        Codec::putFixed(indexBytes, entry.offset, 4);
+        Codec::putFixed(indexBytes, entry.length, 4);
+    }
+    return indexBytes;
+}
+
+string CompressedNandStorage::encodeCatalog() const {
+    if (snapshots.empty()) return "";
+
+    string bytes;
+    Codec::putVarint(bytes, snapshots.size());
+    for (const auto& snapshot : snapshots) {
+        Codec::putVarint(bytes, snapshot.first.size());
+        bytes += snapshot.first;
+        bytes += encodeIndex(snapshot.second);
+    }
+    return bytes;
+}
+
+string CompressedNandStorage::encode(const vector<uint32_t>& cells) {
+    bool allZero = true;
+    for (uint32_t cell : cells) allZero = allZero && cell == 0;
+    if (allZero) return "";
+
+    string rle(1, MODE_RLE);
+    for (size_t idx = 0; idx < cells.size();) {
+        size_t run = 1;
+        while (idx + run < cells.size() && cells[idx + run] == cells[idx]) run++;
+        Codec::putVarint(rle, run);
+        Codec::putFixed(rle, cells[idx], 4);
+        idx += run;
+    }
+    if (rle.size() < 1 + cells.size() * 4) return rle;
+
+    string raw(1, MODE_RAW);
+    for (uint32_t cell : cells) Codec::putFixed(raw, cell, 4);
+    return raw;
+}
+
+bool CompressedNandStorage::decode(const string& blob, vector<uint32_t>& cells) {
+    if (blob.empty()) return false;
+    size_t pos = 1;
+    size_t filled = 0;
+    while (pos < blob.size() && filled < cells.size()) {
+        uint64_t run = 1, value;
+        if (blob[0] == MODE_RLE && !Codec::getVarint(blob, pos, run)) return false;
+        if (!Codec::getFixed(blob, pos, value, 4) || filled + run > cells.size()) return false;
+        for (uint64_t i = 0; i < run; i++) cells[filled++] = (uint32_t)value;
+    }
+    return filled == cells.size() && pos == blob.size();
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <map>
+#include <set>
+#include <filesystem>
+#include <cstdint>
+
+#include "nandStorage.h"
+#include "codec.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// Chunked image layout:
+//   header   "SSDC", u32 version, u32 lbaCount, u32 chunkLbas,
+//            u32 activeIndex, u32 catalogOffset, u32 catalogLength
+//   index    two slots of one { u32 offset, u32 length } per chunk, length 0 =
+//            all-zero chunk; activeIndex names the live one
+//   data     encoded chunks, appended on rewrite; copies no index refers to
+//            any more stay behind as garbage until the image is compacted
+//   catalog  varint count, then per snapshot: varint name length, name and
+//            a chunk index in the same form as above
+// An encoded chunk is a mode byte followed by raw u32 values (MODE_RAW) or
+// (varint run, u32 value) pairs (MODE_RLE), whichever is smaller. Encoded
+// chunks are never modified in place, so snapshots share them with the live
+// index and with each other. A new index goes into the inactive slot and only
+// the header write that follows switches to it, so a crash at any point
+// leaves either the old or the new index live.
+class CompressedNandStorage : public NandStorage {
+public:
+    static constexpr int CHUNK_LBAS = 16;
+
+    explicit CompressedNandStorage(const string& fileName, int lbaCount = 100)
+        : fileName(fileName), lbaCount(lbaCount), chunkCount((lbaCount + CHUNK_LBAS - 1) / CHUNK_LBAS) {
+    }
+
+    ~CompressedNandStorage() override {
+        commit();
+    }
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool writeRange(int addr, int count, const uint32_t* values) override;
+
+    // Zero chunks are elided, so a deallocated LBA is simply a zero LBA.
+    bool deallocate(int addr, int size) override {
+        return erase(addr, size);
+    }
+
+    // Writes every dirty chunk once, appended after the live data, then
+    // switches to a new index.
+    bool commit() override;
+
+    bool sync() override;
+
+    // A snapshot is a copy of the chunk index; the chunks themselves are shared.
+    bool saveSnapshot(const string& name) override;
+
+    bool loadSnapshot(const string& name) override;
+    bool removeSnapshot(const string& name) override;
+
+    // The clone gets the snapshot as its live index and nothing else, written
+    // out compacted.
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+    int storedChunkCount();
+
+    static bool isImage(const string& fileName);
+
+private:
+    struct ChunkEntry {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'C' };
+    static constexpr uint32_t VERSION = 3;
+    static constexpr int HEADER_SIZE = 28;
+    static constexpr char MODE_RAW = 0;
+    static constexpr char MODE_RLE = 1;
+    static constexpr uint64_t COMPACT_MIN_BYTES = 4096;
+    static constexpr size_t CACHE_CHUNKS_MAX = 4096;
+
+    string fileName;
+    int lbaCount;
+    int chunkCount;
+    bool opened = false;
+    bool openFailed = false;
+    bool imageExists = false;
+    vector<ChunkEntry> index;
+    int activeIndex = 0;
+    map<string, vector<ChunkEntry>> snapshots;
+    ChunkEntry catalog = { 0, 0 };
+    map<int, vector<uint32_t>> cache;
+    set<int> dirty;
+
+    bool open();
+    bool readHeader(ifstream& image);
+    bool readIndex(istream& in, vector<ChunkEntry>& entries);
+    bool decodeIndex(const string& in, size_t& pos, vector<ChunkEntry>& entries);
+    bool readCatalog(ifstream& image);
+
+    // Writes the live index into the inactive slot, then points the header at it.
+    bool switchIndex(fstream& image);
+
+    uint64_t indexOffset(int slot) const {
+        return HEADER_SIZE + (uint64_t)slot * chunkCount * 8;
+    }
+
+    uint64_t dataOffset() const {
+        return indexOffset(2);
+    }
+
+    // Appends a new catalog and points the header at it.
+    bool writeCatalog();
+
+    vector<uint32_t>* loadChunk(int chunk);
+    bool readChunk(const ChunkEntry& entry, vector<uint32_t>& cells);
+    bool readBlob(const ChunkEntry& entry, string& blob);
+    void evictClean();
+    uint64_t liveBytes() const;
+    bool compactIfNeeded(uint64_t fileBytes);
+
+    // Writes a garbage-free image next to the old one and swaps it in. Dirty
+    // chunks are encoded from the cache; every other referenced chunk is
+    // copied once, so sharing between the index and snapshots survives.
+    bool rewriteImage();
+
+    string encodeHeader() const;
+    static string encodeIndex(const vector<ChunkEntry>& entries);
+    string encodeCatalog() const;
+    static string encode(const vector<uint32_t>& cells);
+    static bool decode(const string& blob, vector<uint32_t>& cells);
+};
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "dedupNandStorage.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+DedupNandStorage::DedupNandStorage(const string& fileName, int lbaCount, int codeBits)
+    : fileName(fileName), lbaCount(lbaCount), codeBits(codeBits == 2 || codeBits == 8 ? codeBits : DEFAULT_CODE_BITS) {
+}
+
+DedupNandStorage::~DedupNandStorage() {
+    commit();
+}
+
+bool DedupNandStorage::read(int addr, string& value) {
+    if (addr < 0 || addr >= lbaCount || !load()) return false;
+
+    value = Codec::formatValue(valueAt(addr));
+    return true;
+}
+
+bool DedupNandStorage::write(int addr, const string& value) {
+    uint32_t parsed;
+    if (addr < 0 || addr >= lbaCount || !Codec::tryParseValue(value, parsed) || !load()) return false;
+
+    assign(addr, parsed);
+    return true;
+}
+
+bool DedupNandStorage::erase(int addr, int size) {
+    if (addr < 0 || size < 0 || addr + size > lbaCount || !load()) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) assign(addr + offsetIdx, 0);
+    return true;
+}
+
+bool DedupNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount || !load()) return false;
+
+    for (int offset = 0; offset < count; offset++) values[offset] = valueAt(addr + offset);
+    return true;
+}
+
+bool DedupNandStorage::writeRange(int addr, int count, const uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount || !load()) return false;
+
+    for (int offset = 0; offset < count; offset++) assign(addr + offset, values[offset]);
+    return true;
+}
+
+bool DedupNandStorage::commit() {
+    if (!load()) return false;
+    if (dirtyBlocks.empty() && !dictionaryDirty && !spillDirty) return true;
+    if (!imageExists) return writeAll();
+
+    fstream image(fileName, ios::in | ios::out | ios::binary);
+    if (!image.is_open()) return false;
+
+    if (dictionaryDirty) {
+        string encoded = encodeDictionary();
+        image.seekp(HEADER_SIZE);
+        image.write(encoded.data(), encoded.size());
+        bytesWritten += encoded.size();
+    }
+    for (int block : dirtyBlocks) {
+        size_t first = (size_t)block * BLOCK_BYTES;
+        size_t length = min((size_t)BLOCK_BYTES, codeBytes() - first);
+        image.seekp(codesOffset() + first);
+        image.write((const char*)codes.data() + first, length);
+        bytesWritten += length;
+    }
+    if (spillDirty) {
+        string encoded = encodeSpill();
+        image.seekp(codesOffset() + codeBytes());
+        image.write(encoded.data(), encoded.size());
+        string header = encodeHeader();
+        image.seekp(0);
+        image.write(header.data(), header.size());
+        bytesWritten += encoded.size() + header.size();
+    }
+    image.close();
+    if (image.fail()) return false;
+
+    error_code ec;
+    if (spillDirty) resize_file(fileName, codesOffset() + codeBytes() + 8 * spill.size(), ec);
+    if (ec) return false;
+
+    dirtyBlocks.clear();
+    dictionaryDirty = false;
+    spillDirty = false;
+    return true;
+}
+
+bool DedupNandStorage::sync() {
+    if (!commit()) return false;
+    return !exists(fileName) || syncFile(fileName);
+}
+
+bool DedupNandStorage::saveSnapshot(const string& name) {
+    if (!commit()) return false;
+
+    error_code ec;
+    create_directories(snapshotDir(), ec);
+    if (ec) return false;
+    if (!exists(fileName)) return (bool)ofstream(snapshotDir() / name, ios::trunc);
+    copy_file(fileName, snapshotDir() / name, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool DedupNandStorage::loadSnapshot(const string& name) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    close();
+    error_code ec;
+    copy_file(snapshotPath, fileName, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool DedupNandStorage::removeSnapshot(const string& name) {
+    error_code ec;
+    return remove(snapshotDir() / name, ec) && !ec;
+}
+
+bool DedupNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    error_code ec;
+    copy_file(snapshotPath, targetPath, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+string DedupNandStorage::statistics() {
+    if (!load()) return "";
+
+    uint64_t mapped = spill.size();
+    for (int count : references) mapped += count;
+    size_t stored = slotOf.size() + spill.size();
+    stringstream ss;
+    ss << fixed << setprecision(2)
+        << "patterns=" << slotOf.size() << "/" << slotCount()
+        << " spilled=" << spill.size()
+        << " dedup=" << (stored == 0 ? 0 : (double)mapped / stored) << "x"
+        << " image=" << imageBytes() << "/" << 4 * (uint64_t)lbaCount
+        << " committed=" << bytesWritten;
+    return ss.str();
+}
+
+int DedupNandStorage::patternCount() {
+    return load() ? (int)slotOf.size() : 0;
+}
+
+int DedupNandStorage::spilledCount() {
+    return load() ? (int)spill.size() : 0;
+}
+
+uint64_t DedupNandStorage::imageBytes() {
+    return load() ? codesOffset() + codeBytes() + 8 * spill.size() : 0;
+}
+
+bool DedupNandStorage::isImage(const string& fileName) {
+    ifstream ifs(fileName, ios::binary);
+    char magic[4];
+    return ifs.read(magic, 4) && equal(magic, magic + 4, MAGIC);
+}
+
+int DedupNandStorage::codeAt(int addr) const {
+    size_t bit = (size_t)addr * codeBits;
+    return (codes[bit / 8] >> (bit % 8)) & spillCode();
+}
+
+void DedupNandStorage::setCode(int addr, int code) {
+    size_t bit = (size_t)addr * codeBits;
+    uint8_t& byte = codes[bit / 8];
+    uint8_t updated = (uint8_t)((byte & ~(spillCode() << (bit % 8))) | (code << (bit % 8)));
+    if (updated == byte) return;
+
+    byte = updated;
+    dirtyBlocks.insert((int)(bit / 8 / BLOCK_BYTES));
+}
+
+uint32_t DedupNandStorage::valueAt(int addr) const {
+    int code = codeAt(addr);
+    if (code == 0) return 0;
+    if (code == spillCode()) return spill.at(addr);
+    return dictionary[code - 1];
+}
+
+void DedupNandStorage::assign(int addr, uint32_t value) {
+    int old = codeAt(addr);
+    if (old == spillCode()) {
+        spill.erase(addr);
+        spillDirty = true;
+    }
+    else if (old > 0 && --references[old - 1] == 0) {
+        slotOf.erase(dictionary[old - 1]);
+    }
+
+    int code = 0;
+    if (value != 0) {
+        auto slot = slotOf.find(value);
+        if (slot != slotOf.end()) code = slot->second + 1;
+        for (int free = 0; code == 0 && (int)slotOf.size() < slotCount() && free < slotCount(); free++) {
+            if (references[free] > 0) continue;
+            dictionary[free] = value;
+            slotOf[value] = free;
+            dictionaryDirty = true;
+            code = free + 1;
+        }
+        if (code == 0) {
+            spill[addr] = value;
+            spillDirty = true;
+            code = spillCode();
+        }
+        else {
+            references[code - 1]++;
+        }
+    }
+    setCode(addr, code);
+}
+
+bool DedupNandStorage::load() {
+    if (loaded) return valid;
+
+    loaded = true;
+    imageExists = false;
+    ifstream ifs(fileName, ios::binary);
+    string header(HEADER_SIZE, '\0');
+    bool empty = !ifs.is_open() || ifs.peek() == ifstream::traits_type::eof();
+    if (!empty) {
+        size_t pos = 4;
+        uint64_t version, count, bits, spillCount;
+        if (!ifs.read(&header[0], HEADER_SIZE) || header.compare(0, 4, MAGIC, 4) != 0) return valid = false;
+        Codec::getFixed(header, pos, version, 4);
+        Codec::getFixed(header, pos, count, 4);
+        Codec::getFixed(header, pos, bits, 4);
+        Codec::getFixed(header, pos, spillCount, 4);
+        if (version != VERSION || (int)count != lbaCount || (bits != 2 && bits != 4 && bits != 8)) return valid = false;
+        codeBits = (int)bits;
+
+        string encoded(4 * (size_t)slotCount() + codeBytes() + 8 * spillCount, '\0');
+        if (!ifs.read(&encoded[0], encoded.size())) return valid = false;
+
+        pos = 0;
+        dictionary.assign(slotCount(), 0);
+        for (uint32_t& pattern : dictionary) {
+            uint64_t parsed;
+            Codec::getFixed(encoded, pos, parsed, 4);
+            pattern = (uint32_t)parsed;
+        }
+        codes.assign(encoded.begin() + pos, encoded.begin() + pos + codeBytes());
+        pos += codeBytes();
+        spill.clear();
+        for (uint64_t entry = 0; entry < spillCount; entry++) {
+            uint64_t addr, value;
+            Codec::getFixed(encoded, pos, addr, 4);
+            Codec::getFixed(encoded, pos, value, 4);
+            if ((int)addr >= lbaCount) return valid = false;
+            spill[(int)addr] = (uint32_t)value;
+        }
+        imageExists = true;
+    }
+    else {
+        dictionary.assign(slotCount(), 0);
+        codes.assign(codeBytes(), 0);
+        spill.clear();
+    }
+
+    references.assign(slotCount(), 0);
+    slotOf.clear();
+    for (int addr = 0; addr < lbaCount; addr++) {
+        int code = codeAt(addr);
+        if (code == spillCode() && spill.count(addr) == 0) return valid = false;
+        if (code > 0 && code != spillCode() && references[code - 1]++ == 0) slotOf[dictionary[code - 1]] = code - 1;
+    }
+    dirtyBlocks.clear();
+    dictionaryDirty = false;
+    spillDirty = false;
+    return valid = true;
+}
+
+void DedupNandStorage::close() {
+    loaded = false;
+}
+
+bool DedupNandStorage::writeAll() {
+    string encoded = encodeHeader() + encodeDictionary();
+    encoded.append((const char*)codes.data(), codes.size());
+    encoded += encodeSpill();
+
+    ofstream ofs(fileName, ios::binary | ios::trunc);
+    ofs.write(encoded.data(), encoded.size());
+    ofs.close();
+    if (ofs.fail()) return false;
+
+    bytesWritten += encoded.size();
+    imageExists = true;
+    dirtyBlocks.clear();
+    dictionaryDirty = false;
+    spillDirty = false;
+    return true;
+}
+
+string DedupNandStorage::encodeHeader() const {
+    string header(MAGIC, 4);
+    Codec::putFixed(header, VERSION, 4);
+    Codec::putFixed(header, lbaCount, 4);
+    Codec::putFixed(header, codeBits, 4);
+    Codec::putFixed(header, spill.size(), 4);
+    return header;
+}
+
+string DedupNandStorage::encodeDictionary() const {
+    string encoded;
+    for (uint32_t pattern : dictionary) Codec::putFixed(encoded, pattern, 4);
+    return encoded;
+}
+
+string DedupNandStorage::encodeSpill() const {
+    string encoded;
+    for (const auto& entry : spill) {
+        Codec::putFixed(encoded, entry.first, 4);
+        Codec::putFixed(encoded, entry.second, 4);
+    }
+    return encoded;
+}
\ No newline at end of file
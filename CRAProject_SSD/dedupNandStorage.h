@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// Deduplicated image layout:
+//   header      "SSDD", u32 version, u32 lbaCount, u32 codeBits, u32 spillCount
+//   dictionary  (1 << codeBits) - 2 u32 patterns
+//   codes       codeBits per LBA, packed from the low bits of each byte
+//   spill       spillCount { u32 addr, u32 value }, sorted by addr
+// Code 0 is the zero value, codes 1 to (1 << codeBits) - 2 name a dictionary
+// slot and the all-ones code marks an LBA whose value found no free slot and
+// was spilled raw. A slot no code refers to is free for the next new pattern.
+// Everything is loaded on first use; commit() writes only the code blocks
+// that changed, and the dictionary and spill list when they did.
+class DedupNandStorage : public NandStorage {
+public:
+    static constexpr int DEFAULT_CODE_BITS = 4;
+
+    // codeBits is 2, 4 or 8; an existing image keeps the width it was
+    // created with.
+    DedupNandStorage(const string& fileName, int lbaCount = 100, int codeBits = DEFAULT_CODE_BITS);
+    ~DedupNandStorage() override;
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool writeRange(int addr, int count, const uint32_t* values) override;
+    bool commit() override;
+    bool sync() override;
+
+    bool saveSnapshot(const string& name) override;
+    bool loadSnapshot(const string& name) override;
+    bool removeSnapshot(const string& name) override;
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+    // "patterns=<used>/<slots> spilled=<LBAs> dedup=<LBAs per stored value>x
+    //  image=<bytes>/<bytes as raw u32s> committed=<bytes written>"
+    string statistics() override;
+
+    int patternCount();
+    int spilledCount();
+    uint64_t imageBytes();
+
+    // Bytes commit() has written since the storage was opened.
+    uint64_t committedBytes() const {
+        return bytesWritten;
+    }
+
+    static bool isImage(const string& fileName);
+
+private:
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'D' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int HEADER_SIZE = 20;
+    static constexpr int BLOCK_BYTES = 512;
+
+    string fileName;
+    int lbaCount;
+    int codeBits;
+    bool loaded = false;
+    bool valid = false;
+    bool imageExists = false;
+    vector<uint8_t> codes;
+    vector<uint32_t> dictionary;
+    vector<int> references;
+    unordered_map<uint32_t, int> slotOf;
+    map<int, uint32_t> spill;
+    set<int> dirtyBlocks;
+    bool dictionaryDirty = false;
+    bool spillDirty = false;
+    uint64_t bytesWritten = 0;
+
+    path snapshotDir() const {
+        return path(fileName + ".snapshots");
+    }
+
+    int slotCount() const {
+        return (1 << codeBits) - 2;
+    }
+
+    int spillCode() const {
+        return (1 << codeBits) - 1;
+    }
+
+    size_t codeBytes() const {
+        return ((size_t)lbaCount * codeBits + 7) / 8;
+    }
+
+    size_t codesOffset() const {
+        return HEADER_SIZE + 4 * (size_t)slotCount();
+    }
+
+    int codeAt(int addr) const;
+    void setCode(int addr, int code);
+    uint32_t valueAt(int addr) const;
+
+    // Drops addr's reference to its slot or spilled value, then stores value.
+    void assign(int addr, uint32_t value);
+
+    bool load();
+    void close();
+    bool writeAll();
+    string encodeHeader() const;
+    string encodeDictionary() const;
+    string encodeSpill() const;
+};
\ No newline at end of file
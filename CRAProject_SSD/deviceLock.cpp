@@ -0,0 +1,50 @@
+#include "deviceLock.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if defined(_WIN32)
+DeviceLock::DeviceLock(const string& fileName, Mode mode) {
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    handle = file;
+
+    OVERLAPPED region = {};
+    DWORD flags = mode == Mode::Exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+    held = LockFileEx(file, flags, 0, MAXDWORD, MAXDWORD, &region) != 0;
+}
+
+DeviceLock::~DeviceLock() {
+    if (handle == nullptr) return;
+    if (held) {
+        OVERLAPPED region = {};
+        UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &region);
+    }
+    CloseHandle(handle);
+}
+#else
+DeviceLock::DeviceLock(const string& fileName, Mode mode) {
+    fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+
+    int operation = mode == Mode::Exclusive ? LOCK_EX : LOCK_SH;
+    int result;
+    do {
+        result = flock(fd, operation);
+    } while (result != 0 && errno == EINTR);
+    held = result == 0;
+}
+
+DeviceLock::~DeviceLock() {
+    if (fd < 0) return;
+    if (held) flock(fd, LOCK_UN);
+    close(fd);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+// An advisory lock on a lock file, held for the object's lifetime; the
+// constructor blocks until it is granted. Any number of Shared holders or one
+// Exclusive holder at a time, across processes and within one. The lock file
+// is created on demand and never removed. If it cannot be opened the lock is
+// not held and nothing blocks.
+class DeviceLock {
+public:
+    enum class Mode {
+        Shared,
+        Exclusive,
+    };
+
+    DeviceLock(const string& fileName, Mode mode);
+    ~DeviceLock();
+
+    DeviceLock(const DeviceLock&) = delete;
+    DeviceLock& operator=(const DeviceLock&) = delete;
+
+    bool isHeld() const {
+        return held;
+    }
+
+private:
+#if defined(_WIN32)
+    void* handle = nullptr;
+#else
+    int fd = -1;
+#endif
+    bool held = false;
+};
\ No newline at end of file
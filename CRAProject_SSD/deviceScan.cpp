@@ -0,0 +1,202 @@
+#include "deviceScan.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SSD_CRC32C_X86
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SSD_TARGET_SSE42
+#else
+#define SSD_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+uint32_t Crc32c::extend(uint32_t crc, const uint8_t* data, size_t length) {
+    static const bool accelerated = hardwareAccelerated();
+    return accelerated ? extendHardware(crc, data, length) : extendSoftware(crc, data, length);
+}
+
+uint32_t Crc32c::combine(uint32_t crcA, uint32_t crcB, uint64_t lengthB) {
+    // Appending lengthB zero bytes to A is a linear map over GF(2); apply it
+    // by repeated squaring of the one-zero-bit operator, as zlib does.
+    auto times = [](const uint32_t* matrix, uint32_t vec) {
+        uint32_t sum = 0;
+        for (; vec; vec >>= 1, matrix++) {
+            if (vec & 1) sum ^= *matrix;
+        }
+        return sum;
+    };
+    auto square = [&](uint32_t* result, const uint32_t* matrix) {
+        for (int n = 0; n < 32; n++) result[n] = times(matrix, matrix[n]);
+    };
+
+    if (lengthB == 0) return crcA;
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = POLY;
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+    square(even, odd);
+    square(odd, even);
+
+    do {
+        square(even, odd);
+        if (lengthB & 1) crcA = times(even, crcA);
+        lengthB >>= 1;
+        if (lengthB == 0) break;
+        square(odd, even);
+        if (lengthB & 1) crcA = times(odd, crcA);
+        lengthB >>= 1;
+    } while (lengthB);
+    return crcA ^ crcB;
+}
+
+bool Crc32c::hardwareAccelerated() {
+#if defined(SSD_CRC32C_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#elif defined(SSD_CRC32C_X86)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return false;
+#endif
+}
+
+uint32_t Crc32c::extendSoftware(uint32_t crc, const uint8_t* data, size_t length) {
+    static const vector<uint32_t> table = [] {
+        vector<uint32_t> entries(256);
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            uint32_t value = byte;
+            for (int bit = 0; bit < 8; bit++) value = (value >> 1) ^ (POLY & (0u - (value & 1)));
+            entries[byte] = value;
+        }
+        return entries;
+    }();
+
+    uint32_t state = ~crc;
+    for (size_t idx = 0; idx < length; idx++) {
+        state = table[(state ^ data[idx]) & 0xFF] ^ (state >> 8);
+    }
+    return ~state;
+}
+
+#if defined(SSD_CRC32C_X86)
+SSD_TARGET_SSE42 uint32_t Crc32c::extendHardware(uint32_t crc, const uint8_t* data, size_t length) {
+    uint64_t state = ~crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t tail = (uint32_t)state;
+    for (; length > 0; data++, length--) tail = _mm_crc32_u8(tail, *data);
+    return ~tail;
+}
+#else
+uint32_t Crc32c::extendHardware(uint32_t crc, const uint8_t* data, size_t length) {
+    return extendSoftware(crc, data, length);
+}
+#endif
+
+DeviceScanner::DeviceScanner(int lbaCount, int workerCount)
+    : lbaCount(lbaCount) {
+    int requested = workerCount > 0 ? workerCount : (int)thread::hardware_concurrency();
+    this->workerCount = max(1, min(requested, lbaCount / MIN_WORKER_LBAS));
+}
+
+bool DeviceScanner::checksum(NandStorage& nand, const vector<vector<string>>& buffer, uint32_t& crc) {
+    Device device(nand, buffer);
+    vector<uint32_t> partial(workerCount, 0);
+    vector<uint64_t> lengths(workerCount, 0);
+
+    bool scanned = forEachRange([&](int worker, int begin, int end) {
+        vector<uint32_t> values(READ_CHUNK_LBAS);
+        vector<uint8_t> bytes(4 * READ_CHUNK_LBAS);
+        for (int addr = begin; addr < end; addr += READ_CHUNK_LBAS) {
+            int count = min(READ_CHUNK_LBAS, end - addr);
+            if (!readRange(device, addr, count, values.data())) return false;
+            for (int idx = 0; idx < count; idx++) {
+                for (int shift = 0; shift < 4; shift++) bytes[4 * idx + shift] = (uint8_t)(values[idx] >> (8 * shift));
+            }
+            partial[worker] = Crc32c::extend(partial[worker], bytes.data(), 4 * (size_t)count);
+        }
+        lengths[worker] = 4 * (uint64_t)(end - begin);
+        return true;
+    });
+    if (!scanned) return false;
+
+    crc = partial[0];
+    for (int worker = 1; worker < workerCount; worker++) crc = Crc32c::combine(crc, partial[worker], lengths[worker]);
+    return true;
+}
+
+bool DeviceScanner::compare(NandStorage& nand, const vector<vector<string>>& buffer,
+    NandStorage& otherNand, const vector<vector<string>>& otherBuffer, vector<int>& mismatched) {
+    Device device(nand, buffer);
+    Device other(otherNand, otherBuffer);
+    vector<vector<int>> found(workerCount);
+
+    bool scanned = forEachRange([&](int worker, int begin, int end) {
+        vector<uint32_t> values(READ_CHUNK_LBAS);
+        vector<uint32_t> otherValues(READ_CHUNK_LBAS);
+        for (int addr = begin; addr < end; addr += READ_CHUNK_LBAS) {
+            int count = min(READ_CHUNK_LBAS, end - addr);
+            if (!readRange(device, addr, count, values.data())) return false;
+            if (!readRange(other, addr, count, otherValues.data())) return false;
+            for (int idx = 0; idx < count; idx++) {
+                if (values[idx] != otherValues[idx]) found[worker].push_back(addr + idx);
+            }
+        }
+        return true;
+    });
+    if (!scanned) return false;
+
+    mismatched.clear();
+    for (const vector<int>& lbas : found) mismatched.insert(mismatched.end(), lbas.begin(), lbas.end());
+    return true;
+}
+
+bool DeviceScanner::forEachRange(const function<bool(int worker, int begin, int end)>& work) {
+    int rangeLbas = (lbaCount + workerCount - 1) / workerCount;
+    vector<char> succeeded(workerCount, 0);
+    auto runWorker = [&](int worker) {
+        int begin = min(lbaCount, worker * rangeLbas);
+        int end = min(lbaCount, begin + rangeLbas);
+        succeeded[worker] = work(worker, begin, end);
+    };
+
+    vector<thread> workers;
+    for (int worker = 1; worker < workerCount; worker++) workers.emplace_back(runWorker, worker);
+    runWorker(0);
+    for (thread& worker : workers) worker.join();
+
+    return all_of(succeeded.begin(), succeeded.end(), [](char ok) { return ok != 0; });
+}
+
+bool DeviceScanner::readRange(Device& device, int addr, int count, uint32_t* values) {
+    if (device.nand.concurrentReads()) {
+        if (!device.nand.readRange(addr, count, values)) return false;
+    }
+    else {
+        lock_guard<mutex> guard(device.lock);
+        if (!device.nand.readRange(addr, count, values)) return false;
+    }
+    applyBuffer(device.buffer, addr, count, values);
+    return true;
+}
+
+void DeviceScanner::applyBuffer(const vector<vector<string>>& buffer, int addr, int count, uint32_t* values) {
+    for (const vector<string>& command : buffer) {
+        int start = stoi(command[1]);
+        if (command[0] == "W") {
+            if (start >= addr && start < addr + count) values[start - addr] = Codec::parseValue(command[2]);
+            continue;
+        }
+        int first = max(addr, start);
+        int last = min(addr + count, start + stoi(command[2]));
+        for (int lba = first; lba < last; lba++) values[lba - addr] = 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstdint>
+
+#include "nandStorage.h"
+#include "codec.h"
+
+using namespace std;
+
+// CRC32C (Castagnoli), as used by iSCSI and ext4. Uses the SSE4.2 crc32
+// instruction when the CPU has it and a lookup table otherwise.
+class Crc32c {
+public:
+    static uint32_t extend(uint32_t crc, const uint8_t* data, size_t length);
+
+    static uint32_t compute(const uint8_t* data, size_t length) {
+        return extend(0, data, length);
+    }
+
+    // The CRC of A followed by B, given the CRCs of both and B's length.
+    static uint32_t combine(uint32_t crcA, uint32_t crcB, uint64_t lengthB);
+
+    static bool hardwareAccelerated();
+
+private:
+    static constexpr uint32_t POLY = 0x82F63B78;
+
+    static uint32_t extendSoftware(uint32_t crc, const uint8_t* data, size_t length);
+    static uint32_t extendHardware(uint32_t crc, const uint8_t* data, size_t length);
+};
+
+// Reads the whole logical device, with the buffered commands applied on top,
+// split into one contiguous LBA range per worker. Workers read
+// READ_CHUNK_LBAS at a time, taking turns on backends without concurrent
+// reads, and hash or compare what they read while the others are reading.
+// The checksum is the CRC32C of every LBA value as a little-endian u32, in
+// LBA order, whatever the worker count.
+class DeviceScanner {
+public:
+    static constexpr int READ_CHUNK_LBAS = 1024;
+
+    // Below this many LBAs per worker, starting a thread costs more than it
+    // saves, so a Command::LBA_MAX device is always scanned by one worker;
+    // more workers only start for the larger devices tests and benchmarks build.
+    static constexpr int MIN_WORKER_LBAS = 4096;
+
+    explicit DeviceScanner(int lbaCount = 100, int workerCount = 0);
+
+    int getWorkerCount() const {
+        return workerCount;
+    }
+
+    bool checksum(NandStorage& nand, const vector<vector<string>>& buffer, uint32_t& crc);
+
+    bool compare(NandStorage& nand, const vector<vector<string>>& buffer,
+        NandStorage& otherNand, const vector<vector<string>>& otherBuffer, vector<int>& mismatched);
+
+    // Overlays the buffered W and E commands on the values of LBAs addr to
+    // addr + count - 1, oldest first.
+    static void applyBuffer(const vector<vector<string>>& buffer, int addr, int count, uint32_t* values);
+
+private:
+    struct Device {
+        NandStorage& nand;
+        const vector<vector<string>>& buffer;
+        mutex lock;
+
+        Device(NandStorage& nand, const vector<vector<string>>& buffer)
+            : nand(nand), buffer(buffer) {
+        }
+    };
+
+    int lbaCount;
+    int workerCount;
+
+    // Runs work(begin, end) for every worker's range and reports whether all succeeded.
+    bool forEachRange(const function<bool(int worker, int begin, int end)>& work);
+
+    static bool readRange(Device& device, int addr, int count, uint32_t* values);
+};
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "durability.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool syncFile(const string& fileName) {
+#if defined(_WIN32)
+    int fd = _open(fileName.c_str(), _O_RDWR);
+    if (fd < 0) return false;
+    bool synced = _commit(fd) == 0;
+    _close(fd);
+    return synced;
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#endif
+}
+
+// Directory entries only need an explicit sync on POSIX; NTFS journals them.
+bool syncDirectory(const string& dirPath) {
+#if defined(_WIN32)
+    return true;
+#else
+    int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#endif
+}
+
+bool DurabilityPolicy::shouldSync(bool mutated, bool flushed) {
+    switch (level) {
+    case DurabilityLevel::SyncOnFlush:
+        return flushed;
+    case DurabilityLevel::SyncPerCommand:
+        return mutated;
+    case DurabilityLevel::GroupCommit:
+        if (mutated && !pending) {
+            pending = true;
+            deadline = steady_clock::now() + window;
+        }
+        return pending && steady_clock::now() >= deadline;
+    default:
+        return false;
+    }
+}
+
+void BackgroundFlushPolicy::commandRan(bool nowBuffered, bool flushed) {
+    lastCommand = steady_clock::now();
+    if (nowBuffered && (!buffered || flushed)) oldest = lastCommand;
+    buffered = nowBuffered;
+}
+
+steady_clock::time_point BackgroundFlushPolicy::dueAt() const {
+    steady_clock::time_point due = steady_clock::time_point::max();
+    if (idleDelay.count() > 0) due = lastCommand + idleDelay;
+    if (maxAge.count() > 0) due = min(due, oldest + maxAge);
+    return due;
+}
+
+string DurabilityPolicy::toString(DurabilityLevel level) {
+    switch (level) {
+    case DurabilityLevel::SyncOnFlush: return "flush";
+    case DurabilityLevel::SyncPerCommand: return "command";
+    case DurabilityLevel::GroupCommit: return "group";
+    default: return "none";
+    }
+}
+
+bool DurabilityPolicy::parse(const string& text, DurabilityLevel& level) {
+    for (DurabilityLevel candidate : { DurabilityLevel::None, DurabilityLevel::SyncOnFlush,
+        DurabilityLevel::SyncPerCommand, DurabilityLevel::GroupCommit }) {
+        if (toString(candidate) == text) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+using namespace std::chrono;
+
+enum class DurabilityLevel {
+    None,
+    SyncOnFlush,
+    SyncPerCommand,
+    GroupCommit,
+};
+
+bool syncFile(const string& fileName);
+bool syncDirectory(const string& dirPath);
+
+class DurabilityPolicy {
+public:
+    explicit DurabilityPolicy(DurabilityLevel level = DurabilityLevel::None,
+        microseconds groupCommitWindow = microseconds(1000))
+        : level(level), window(groupCommitWindow) {
+    }
+
+    // Called after every command; true means the caller must sync now.
+    bool shouldSync(bool mutated, bool flushed);
+
+    bool hasPending() const {
+        return pending;
+    }
+
+    steady_clock::time_point pendingDeadline() const {
+        return deadline;
+    }
+
+    void synced() {
+        pending = false;
+        syncCount++;
+    }
+
+    uint64_t getSyncCount() const {
+        return syncCount;
+    }
+
+    DurabilityLevel getLevel() const {
+        return level;
+    }
+
+    static string toString(DurabilityLevel level);
+    static bool parse(const string& text, DurabilityLevel& level);
+
+private:
+    DurabilityLevel level;
+    microseconds window;
+    bool pending = false;
+    steady_clock::time_point deadline;
+    uint64_t syncCount = 0;
+};
+
+// When a resident host drains the command buffer on its own: once no command
+// has arrived for idleDelay, or once the oldest buffered command is maxAge
+// old even if commands keep arriving. Zero turns either trigger off.
+class BackgroundFlushPolicy {
+public:
+    explicit BackgroundFlushPolicy(microseconds idleDelay = microseconds(0), microseconds maxAge = microseconds(0))
+        : idleDelay(idleDelay), maxAge(maxAge) {
+    }
+
+    // Called after every command with whether the buffer holds anything and
+    // whether the command flushed it.
+    void commandRan(bool nowBuffered, bool flushed);
+
+    bool hasPending() const {
+        return buffered && (idleDelay.count() > 0 || maxAge.count() > 0);
+    }
+
+    steady_clock::time_point dueAt() const;
+
+    // Past maxAge: flush before the next foreground command instead of
+    // waiting for the device to go idle.
+    bool isOverdue(steady_clock::time_point now) const {
+        return hasPending() && maxAge.count() > 0 && now >= oldest + maxAge;
+    }
+
+private:
+    microseconds idleDelay;
+    microseconds maxAge;
+    bool buffered = false;
+    steady_clock::time_point lastCommand;
+    steady_clock::time_point oldest;
+};
\ No newline at end of file
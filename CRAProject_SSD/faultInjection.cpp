@@ -0,0 +1,36 @@
+#include "faultInjection.h"
+
+#include <cstdlib>
+
+void FaultInjector::arm(const string& point, int skipHits, bool cutProcess) {
+    State& state = get();
+    lock_guard<mutex> guard(state.lock);
+    state.point = point;
+    state.remaining = skipHits;
+    state.cutProcess = cutProcess;
+    state.armed = true;
+}
+
+void FaultInjector::disarm() {
+    State& state = get();
+    lock_guard<mutex> guard(state.lock);
+    state.armed = false;
+}
+
+void FaultInjector::hit(const char* point) {
+    State& state = get();
+    if (!state.armed.load(memory_order_relaxed)) return;
+
+    lock_guard<mutex> guard(state.lock);
+    if (!state.armed || state.point != point) return;
+    if (state.remaining-- > 0) return;
+
+    state.armed = false;
+    if (state.cutProcess) _Exit(POWER_LOSS_EXIT_CODE);
+    throw PowerLoss{ point };
+}
+
+FaultInjector::State& FaultInjector::get() {
+    static State state;
+    return state;
+}
\ No newline at end of file
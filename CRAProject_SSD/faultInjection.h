@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+
+// Thrown at a fault point armed without cutProcess. It deliberately does not
+// derive from std::exception so that no error handling on the way up can
+// swallow it: the process is "dead" from that instruction on. Unwinding
+// still flushes open streams, though, which a real power cut would not.
+struct PowerLoss {
+    string point;
+};
+
+// Named points in the persistence paths where a test can cut the power.
+// Disarmed, a point costs one relaxed load.
+class FaultInjector {
+public:
+    static constexpr const char* BUFFER_BEFORE_RENAME = "buffer.beforeRename";
+    static constexpr const char* FLUSH_BEFORE_COMMAND = "flush.beforeCommand";
+    static constexpr const char* IMAGE_BEFORE_INDEX_SWITCH = "image.beforeIndexSwitch";
+    static constexpr const char* HEALTH_BEFORE_RENAME = "health.beforeRename";
+
+    // Exit status of a process cut at a fault point.
+    static constexpr int POWER_LOSS_EXIT_CODE = 86;
+
+    // Fails the (skipHits + 1)-th time the point is reached. With cutProcess
+    // the process ends right there without running destructors or flushing
+    // streams; otherwise PowerLoss is thrown.
+    static void arm(const string& point, int skipHits = 0, bool cutProcess = false);
+    static void disarm();
+    static void hit(const char* point);
+
+private:
+    struct State {
+        mutex lock;
+        string point;
+        int remaining = 0;
+        bool cutProcess = false;
+        atomic<bool> armed{ false };
+    };
+
+    static State& get();
+};
\ No newline at end of file
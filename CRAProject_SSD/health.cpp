@@ -0,0 +1,185 @@
+#include "health.h"
+#include "faultInjection.h"
+
+#include <fstream>
+#include <algorithm>
+
+HealthLog::HealthLog(shared_ptr<NandStorage> nand, const string& fileName, int lbaCount)
+    : nand(nand), fileName(fileName), lbaCount(lbaCount), used(lbaCount, false) {
+    load();
+}
+
+HealthLog::HealthLog(shared_ptr<HealthLog> device, const string& fileName, int firstLba, int lbaCount)
+    : device(device), fileName(fileName), firstLba(firstLba), lbaCount(lbaCount) {
+    load();
+}
+
+void HealthLog::countRead(bool fastRead) {
+    counters.hostReads++;
+    if (fastRead) counters.fastReadHits++;
+    dirty = true;
+}
+
+void HealthLog::countWrite() {
+    counters.hostWrites++;
+    dirty = true;
+}
+
+void HealthLog::countMerged(int entries) {
+    if (entries <= 0) return;
+    counters.mergedEntries += entries;
+    dirty = true;
+}
+
+void HealthLog::countFlush(microseconds latency) {
+    uint64_t micros = (uint64_t)max<int64_t>(latency.count(), 0);
+    counters.flushes++;
+    counters.flushMicros += micros;
+    counters.maxFlushMicros = max(counters.maxFlushMicros, micros);
+    dirty = true;
+    save();
+}
+
+void HealthLog::countError() {
+    counters.errors++;
+    dirty = true;
+}
+
+void HealthLog::countCorruption() {
+    counters.corruptions++;
+    dirty = true;
+}
+
+void HealthLog::recordValue(int addr, uint32_t value) {
+    if (!usageKnown || addr < 0 || addr >= lbaCount || used[addr] == (value != 0)) return;
+
+    used[addr] = value != 0;
+    usedCount += value != 0 ? 1 : -1;
+    usageChanged = true;
+    dirty = true;
+}
+
+void HealthLog::recordZeros(int addr, int size) {
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) recordValue(addr + offsetIdx, 0);
+}
+
+bool HealthLog::rebuildUsage() {
+    vector<uint32_t> values(lbaCount);
+    if (!nand->readRange(0, lbaCount, values.data())) return false;
+
+    vector<bool> current(lbaCount);
+    for (int addr = 0; addr < lbaCount; addr++) current[addr] = values[addr] != 0;
+    setUsage(current);
+    usageChanged = true;
+    dirty = true;
+    return true;
+}
+
+int HealthLog::usedLbas() {
+    if (device) return device->usedLbas(firstLba, lbaCount);
+    if (!usageKnown) rebuildUsage();
+    return usedCount;
+}
+
+int HealthLog::usedLbas(int addr, int count) {
+    if (!usageKnown) rebuildUsage();
+    int end = min(addr + count, lbaCount);
+    return usageKnown && addr < end ? (int)std::count(used.begin() + max(addr, 0), used.begin() + end, true) : 0;
+}
+
+string HealthLog::report() {
+    uint64_t averageMicros = counters.flushes == 0 ? 0 : counters.flushMicros / counters.flushes;
+    return "reads=" + to_string(counters.hostReads) +
+        " writes=" + to_string(counters.hostWrites) +
+        " flushes=" + to_string(counters.flushes) +
+        " fast_reads=" + to_string(counters.fastReadHits) +
+        " merged=" + to_string(counters.mergedEntries) +
+        " flush_avg_us=" + to_string(averageMicros) +
+        " flush_max_us=" + to_string(counters.maxFlushMicros) +
+        " errors=" + to_string(counters.errors) +
+        " corrupt=" + to_string(counters.corruptions) +
+        " used=" + to_string(usedLbas()) + "/" + to_string(lbaCount);
+}
+
+bool HealthLog::save() {
+    if (!dirty || fileName.empty()) return true;
+
+    DeviceLock lock(fileName + ".lock", DeviceLock::Mode::Exclusive);
+    Saved saved = readFile();
+    vector<uint64_t*> merged = counterFields(saved.counters);
+    vector<uint64_t*> ours = counterFields(counters);
+    vector<uint64_t*> base = counterFields(loaded);
+    for (size_t field = 0; field < merged.size(); field++) {
+        if (merged[field] == &saved.counters.maxFlushMicros) *merged[field] = max(*merged[field], *ours[field]);
+        else *merged[field] += *ours[field] - *base[field];
+    }
+    counters = saved.counters;
+    loaded = saved.counters;
+    if (!usageChanged && saved.usageKnown) setUsage(saved.used);
+
+    string encoded;
+    for (uint64_t* field : counterFields(counters)) Codec::putFixed(encoded, *field, 8);
+    if (usageKnown) {
+        string bitmap((lbaCount + 7) / 8, '\0');
+        for (int addr = 0; addr < lbaCount; addr++) {
+            if (used[addr]) bitmap[addr / 8] |= (char)(1 << (addr % 8));
+        }
+        encoded += bitmap;
+    }
+
+    string tempPath = fileName + ".tmp";
+    {
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        file.write(encoded.data(), encoded.size());
+        if (!file.good()) return false;
+    }
+    FaultInjector::hit(FaultInjector::HEALTH_BEFORE_RENAME);
+
+    error_code ec;
+    rename(tempPath, fileName, ec);
+    if (ec) return false;
+
+    usageChanged = false;
+    dirty = false;
+    return true;
+}
+
+void HealthLog::load() {
+    if (fileName.empty()) return;
+
+    DeviceLock lock(fileName + ".lock", DeviceLock::Mode::Shared);
+    Saved saved = readFile();
+    counters = saved.counters;
+    loaded = saved.counters;
+    if (saved.usageKnown) setUsage(saved.used);
+}
+
+HealthLog::Saved HealthLog::readFile() const {
+    Saved saved;
+    ifstream file(fileName, ios::binary);
+    string encoded((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t counterBytes = 8 * (size_t)COUNTER_COUNT;
+    size_t bitmapBytes = (lbaCount + 7) / 8;
+    if (encoded.size() != counterBytes && encoded.size() != counterBytes + bitmapBytes) return saved;
+
+    size_t pos = 0;
+    for (uint64_t* field : counterFields(saved.counters)) Codec::getFixed(encoded, pos, *field, 8);
+    if (encoded.size() == counterBytes) return saved;
+
+    saved.used.resize(lbaCount);
+    for (int addr = 0; addr < lbaCount; addr++) saved.used[addr] = (encoded[pos + addr / 8] >> (addr % 8)) & 1;
+    saved.usageKnown = true;
+    return saved;
+}
+
+void HealthLog::setUsage(const vector<bool>& saved) {
+    used = saved;
+    usedCount = (int)count(used.begin(), used.end(), true);
+    usageKnown = true;
+}
+
+vector<uint64_t*> HealthLog::counterFields(HealthCounters& fields) {
+    return { &fields.hostReads, &fields.hostWrites, &fields.flushes, &fields.fastReadHits,
+        &fields.mergedEntries, &fields.flushMicros, &fields.maxFlushMicros, &fields.errors,
+        &fields.corruptions };
+}
\ No newline at end of file
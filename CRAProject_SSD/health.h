@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+#include "nandStorage.h"
+#include "deviceLock.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct HealthCounters {
+    uint64_t hostReads = 0;
+    uint64_t hostWrites = 0;
+    uint64_t flushes = 0;
+    uint64_t fastReadHits = 0;
+    uint64_t mergedEntries = 0;
+    uint64_t flushMicros = 0;
+    uint64_t maxFlushMicros = 0;
+    uint64_t errors = 0;
+    uint64_t corruptions = 0;
+};
+
+// Device statistics for the S command, counted as commands run so reporting
+// them never touches the image. Capacity is tracked with one bit per LBA
+// (set = holds a non-zero value), seeded from the image only when there is
+// no saved log yet and after a rollback replaced the image.
+//
+// The log is kept in "<image>.health" (the counters as u64, then the bitmap),
+// or only in memory when fileName is empty. It is saved after every flush and
+// when the driver closes, so a crash loses at most the counts since then.
+// Several processes may share the log: saving adds this process's counts to
+// whatever is in the file, under "<image>.health.lock".
+class HealthLog {
+public:
+    HealthLog(shared_ptr<NandStorage> nand, const string& fileName, int lbaCount = 100);
+
+    // A namespace's log: its own counters, and the capacity the device log
+    // tracks for [firstLba, firstLba + lbaCount).
+    HealthLog(shared_ptr<HealthLog> device, const string& fileName, int firstLba, int lbaCount);
+
+    void countRead(bool fastRead);
+    void countWrite();
+    void countMerged(int entries);
+    void countFlush(microseconds latency);
+    void countError();
+    void countCorruption();
+
+    void recordValue(int addr, uint32_t value);
+    void recordZeros(int addr, int size);
+
+    // Trusts the image as it is now, e.g. after a rollback replaced it.
+    bool rebuildUsage();
+
+    const HealthCounters& getCounters() const {
+        return counters;
+    }
+
+    int usedLbas();
+    int usedLbas(int addr, int count);
+
+    // "key=value" pairs separated by spaces, e.g. "reads=3 ... used=2/100".
+    string report();
+
+    bool save();
+
+    const string& getFileName() const {
+        return fileName;
+    }
+
+private:
+    static constexpr int COUNTER_COUNT = 9;
+
+    struct Saved {
+        HealthCounters counters;
+        vector<bool> used;
+        bool usageKnown = false;
+    };
+
+    shared_ptr<NandStorage> nand;
+    shared_ptr<HealthLog> device;
+    string fileName;
+    int firstLba = 0;
+    int lbaCount;
+    HealthCounters counters;
+    HealthCounters loaded;
+    vector<bool> used;
+    int usedCount = 0;
+    bool usageKnown = false;
+    bool usageChanged = false;
+    bool dirty = false;
+
+    void load();
+    Saved readFile() const;
+    void setUsage(const vector<bool>& saved);
+    static vector<uint64_t*> counterFields(HealthCounters& fields);
+};
\ No newline at end of file
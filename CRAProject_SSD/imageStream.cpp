@@ -0,0 +1,69 @@
+#include "imageStream.h"
+#include "deviceScan.h"
+
+#include <algorithm>
+
+bool ImageStream::exportImage(NandStorage& nand, const vector<vector<string>>& buffer, ostream& out, bool binary,
+    int lbaCount) {
+    vector<uint32_t> values(min(lbaCount, STREAM_CHUNK_LBAS));
+    string bytes;
+    for (int addr = 0; addr < lbaCount; addr += STREAM_CHUNK_LBAS) {
+        int count = min(STREAM_CHUNK_LBAS, lbaCount - addr);
+        if (!nand.readRange(addr, count, values.data())) return false;
+        DeviceScanner::applyBuffer(buffer, addr, count, values.data());
+
+        encode(values.data(), count, binary, bytes);
+        if (!out.write(bytes.data(), bytes.size())) return false;
+    }
+    return (bool)out.flush();
+}
+
+bool ImageStream::importImage(istream& in, bool binary, int lbaCount, vector<uint32_t>& values) {
+    values.resize(lbaCount);
+    string bytes;
+    for (int addr = 0; addr < lbaCount; addr += STREAM_CHUNK_LBAS) {
+        int count = min(STREAM_CHUNK_LBAS, lbaCount - addr);
+        bytes.resize((size_t)count * (binary ? 4 : TEXT_CELL_BYTES));
+        if (!in.read(&bytes[0], bytes.size()) || !decode(bytes, count, binary, values.data() + addr)) return false;
+    }
+    return in.peek() == istream::traits_type::eof();
+}
+
+void ImageStream::encode(const uint32_t* values, int count, bool binary, string& bytes) {
+    static const char digits[] = "0123456789ABCDEF";
+    bytes.resize((size_t)count * (binary ? 4 : TEXT_CELL_BYTES));
+    char* out = &bytes[0];
+    for (int idx = 0; idx < count; idx++) {
+        uint32_t value = values[idx];
+        if (binary) {
+            for (int shift = 0; shift < 32; shift += 8) *out++ = (char)(value >> shift);
+            continue;
+        }
+        *out++ = '0';
+        *out++ = 'x';
+        for (int shift = 28; shift >= 0; shift -= 4) *out++ = digits[(value >> shift) & 0xF];
+        *out++ = '\n';
+    }
+}
+
+bool ImageStream::decode(const string& bytes, int count, bool binary, uint32_t* values) {
+    const unsigned char* in = (const unsigned char*)bytes.data();
+    for (int idx = 0; idx < count; idx++) {
+        uint32_t value = 0;
+        if (binary) {
+            for (int shift = 0; shift < 32; shift += 8) value |= (uint32_t)*in++ << shift;
+            values[idx] = value;
+            continue;
+        }
+        if (in[0] != '0' || in[1] != 'x' || in[10] != '\n') return false;
+        for (int digit = 2; digit < 10; digit++) {
+            unsigned char c = in[digit];
+            if (c >= '0' && c <= '9') value = value << 4 | (c - '0');
+            else if (c >= 'A' && c <= 'F') value = value << 4 | (c - 'A' + 10);
+            else return false;
+        }
+        values[idx] = value;
+        in += TEXT_CELL_BYTES;
+    }
+    return true;
+}
\ No newline at end of file
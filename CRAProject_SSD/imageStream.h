@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+using namespace std;
+
+// Whole-device export and import, STREAM_CHUNK_LBAS at a time in LBA order.
+// The text form is one "0x" + eight upper-case hex digits line per LBA, the
+// binary form every LBA as a little-endian u32 with nothing around it.
+class ImageStream {
+public:
+    static constexpr int STREAM_CHUNK_LBAS = 16384;
+
+    // Streams the device with the buffered commands applied on top.
+    static bool exportImage(NandStorage& nand, const vector<vector<string>>& buffer, ostream& out, bool binary,
+        int lbaCount = 100);
+
+    // Reads exactly lbaCount values from in, to be written in one go once
+    // the whole stream is known to be good; fails on a short, longer or
+    // malformed stream.
+    static bool importImage(istream& in, bool binary, int lbaCount, vector<uint32_t>& values);
+
+private:
+    static constexpr int TEXT_CELL_BYTES = 11;
+
+    static void encode(const uint32_t* values, int count, bool binary, string& bytes);
+    static bool decode(const string& bytes, int count, bool binary, uint32_t* values);
+};
\ No newline at end of file
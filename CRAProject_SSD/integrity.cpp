@@ -0,0 +1,143 @@
+#include "integrity.h"
+
+#include <algorithm>
+
+void IntegrityStore::record(int addr, uint32_t value) {
+    if (!load() || addr < 0 || addr >= lbaCount) return;
+
+    crcs[addr] = checksum(addr, value);
+    flagged.erase(addr);
+    dirty = true;
+}
+
+bool IntegrityStore::commit() {
+    if (!dirty || fileName.empty()) return true;
+
+    string encoded;
+    for (uint32_t crc : crcs) Codec::putFixed(encoded, crc, 4);
+    string tempPath = fileName + ".tmp";
+    {
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        file.write(encoded.data(), encoded.size());
+        if (!file.good()) return false;
+    }
+
+    error_code ec;
+    rename(tempPath, fileName, ec);
+    if (ec) return false;
+
+    dirty = false;
+    return true;
+}
+
+bool IntegrityStore::sync() {
+    if (fileName.empty() || !exists(fileName)) return true;
+    return syncFile(fileName);
+}
+
+bool IntegrityStore::check(int addr, const string& value) {
+    if (mode == VerifyMode::Off) return true;
+    if (!load() || flagged.count(addr)) return false;
+
+    bool verify = mode == VerifyMode::EveryRead || (mode == VerifyMode::Sampled && readCount++ % sampleRate == 0);
+    if (!verify) return true;
+
+    uint32_t parsed;
+    return Codec::tryParseValue(value, parsed) && crcs[addr] == checksum(addr, parsed);
+}
+
+bool IntegrityStore::rebuild() {
+    vector<uint32_t> values(lbaCount);
+    if (!nand->readRange(0, lbaCount, values.data())) return false;
+
+    crcs.resize(lbaCount);
+    for (int addr = 0; addr < lbaCount; addr++) crcs[addr] = checksum(addr, values[addr]);
+    flagged.clear();
+    loaded = true;
+    dirty = true;
+    return commit();
+}
+
+bool IntegrityStore::scrub(const vector<vector<string>>& buffer, int count, vector<int>& corrupt) {
+    if (!load()) return false;
+
+    vector<int> found;
+    for (int remaining = min(count, lbaCount); remaining > 0;) {
+        int start = scrubCursor;
+        int length = min(remaining, lbaCount - start);
+        vector<uint32_t> values(length);
+        if (!nand->readRange(start, length, values.data())) return false;
+
+        for (int offsetIdx = 0; offsetIdx < length; offsetIdx++) {
+            int addr = start + offsetIdx;
+            if (isShadowed(buffer, addr) || crcs[addr] == checksum(addr, values[offsetIdx])) continue;
+            flagged.insert(addr);
+            found.push_back(addr);
+        }
+        scrubCursor = (start + length) % lbaCount;
+        remaining -= length;
+    }
+    sort(found.begin(), found.end());
+    corrupt.insert(corrupt.end(), found.begin(), found.end());
+    return true;
+}
+
+uint32_t IntegrityStore::checksum(int addr, uint32_t value) {
+    uint8_t bytes[8];
+    for (int shift = 0; shift < 4; shift++) {
+        bytes[shift] = (uint8_t)((uint32_t)addr >> (8 * shift));
+        bytes[4 + shift] = (uint8_t)(value >> (8 * shift));
+    }
+    return Crc32c::compute(bytes, sizeof(bytes));
+}
+
+string IntegrityStore::toString(VerifyMode mode) {
+    switch (mode) {
+    case VerifyMode::EveryRead: return "read";
+    case VerifyMode::Sampled: return "sample";
+    case VerifyMode::Scrub: return "scrub";
+    default: return "off";
+    }
+}
+
+bool IntegrityStore::parse(const string& text, VerifyMode& mode) {
+    for (VerifyMode candidate : { VerifyMode::Off, VerifyMode::EveryRead, VerifyMode::Sampled, VerifyMode::Scrub }) {
+        if (toString(candidate) == text) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IntegrityStore::load() {
+    if (loaded) return true;
+    if (fileName.empty() || !exists(fileName)) return rebuild();
+
+    ifstream file(fileName, ios::binary);
+    string encoded(4 * (size_t)lbaCount + 1, '\0');
+    file.read(&encoded[0], encoded.size());
+    crcs.assign(lbaCount, 0);
+    if (file.gcount() == 4 * (streamsize)lbaCount) {
+        size_t pos = 0;
+        for (int addr = 0; addr < lbaCount; addr++) {
+            uint64_t crc;
+            Codec::getFixed(encoded, pos, crc, 4);
+            crcs[addr] = (uint32_t)crc;
+        }
+    }
+    else {
+        for (int addr = 0; addr < lbaCount; addr++) flagged.insert(addr);
+    }
+    loaded = true;
+    return true;
+}
+
+bool IntegrityStore::isShadowed(const vector<vector<string>>& buffer, int addr) {
+    for (const vector<string>& command : buffer) {
+        int start = stoi(command[1]);
+        if (command[0] == "W" && start == addr) return true;
+        if (command[0] == "E" && addr >= start && addr < start + stoi(command[2])) return true;
+    }
+    return false;
+}
\ No newline at end of file
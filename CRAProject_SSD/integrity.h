@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <set>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+
+#include "nandStorage.h"
+#include "deviceScan.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+enum class VerifyMode {
+    Off,
+    EveryRead,
+    Sampled,
+    Scrub,
+};
+
+// One CRC32C per LBA over { u32 lba, u32 value }, so a value that lands on
+// the wrong LBA is caught as well as a flipped bit. The CRCs are kept in
+// "<image>.crc", a u32 per LBA, or only in memory when fileName is empty.
+// A missing file is built from the image as it is. A file of the wrong size
+// leaves every LBA's integrity unknown, failing check() until rewritten,
+// rather than trusting an image that may be corrupt as well.
+//
+// Commands record every value they write and commit the CRCs after the
+// image. A crash in between only leaves stale CRCs for LBAs the persisted
+// command buffer still shadows, and replaying the buffer records them again.
+class IntegrityStore {
+public:
+    static constexpr int DEFAULT_SAMPLE_RATE = 16;
+
+    IntegrityStore(shared_ptr<NandStorage> nand, const string& fileName, int lbaCount = 100,
+        VerifyMode mode = VerifyMode::EveryRead, int sampleRate = DEFAULT_SAMPLE_RATE)
+        : nand(nand), fileName(fileName), lbaCount(lbaCount), mode(mode), sampleRate(max(1, sampleRate)) {
+    }
+
+    VerifyMode getMode() const {
+        return mode;
+    }
+
+    void record(int addr, uint32_t value);
+    bool commit();
+    bool sync();
+
+    // Whether a value just read is intact. EveryRead verifies every call,
+    // Sampled one call in sampleRate; every mode fails LBAs a scrub flagged.
+    bool check(int addr, const string& value);
+
+    // Trusts the image as it is now, e.g. after a rollback replaced it.
+    bool rebuild();
+
+    // Verifies the next count LBAs after the previous scrub, wrapping around,
+    // and skips the ones the buffer shadows. Corrupt LBAs are added to
+    // corrupt in LBA order and fail check() until rewritten.
+    bool scrub(const vector<vector<string>>& buffer, int count, vector<int>& corrupt);
+
+    static uint32_t checksum(int addr, uint32_t value);
+
+    static string toString(VerifyMode mode);
+    static bool parse(const string& text, VerifyMode& mode);
+
+private:
+    shared_ptr<NandStorage> nand;
+    string fileName;
+    int lbaCount;
+    VerifyMode mode;
+    int sampleRate;
+    vector<uint32_t> crcs;
+    set<int> flagged;
+    bool loaded = false;
+    bool dirty = false;
+    uint64_t readCount = 0;
+    int scrubCursor = 0;
+
+    bool load();
+    static bool isShadowed(const vector<vector<string>>& buffer, int addr);
+};
\ No newline at end of file
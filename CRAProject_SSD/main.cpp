@@ -1,18 +1,119 @@
-#include "gmock/gmock.h"
-#include "ssdDriver.cpp"
+#include "ssdDriver.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
 
+// The Visual Studio project builds a single executable that runs the tests
+// in Debug; the CMake build has a separate test target and defines SSD_CLI.
+#if defined(_DEBUG) && !defined(SSD_CLI)
+#include "gmock/gmock.h"
 
-#if defined(_DEBUG)
 int main()
 {
 	testing::InitGoogleMock();
 	return RUN_ALL_TESTS();
 }
 #else
+string readEnvironment(const char* name)
+{
+#if defined(_WIN32)
+	char* value = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&value, &length, name) != 0 || value == nullptr) return "";
+	string result(value);
+	free(value);
+	return result;
+#else
+	const char* value = getenv(name);
+	return value == nullptr ? "" : value;
+#endif
+}
+
+unique_ptr<SSDDriver> makeReplayDriver(bool inMemory, const SSDConfig& config)
+{
+	if (!inMemory) return make_unique<SSDDriver>(config);
+
+	SSDContext context(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	if (config.modelTiming) context.timing = make_shared<NandTimingModel>(config.nandTiming);
+	unique_ptr<SSDDriver> ssdDriver = make_unique<SSDDriver>(context, make_shared<MemoryBufferStore>(), config.namespaces);
+	ssdDriver->setDurability(config.durability, config.groupCommitWindow);
+	return ssdDriver;
+}
+
+void sweepDurability(const vector<TraceRecord>& records, ReplayPacing pacing)
+{
+	double baseline = 0;
+	for (DurabilityLevel level : { DurabilityLevel::None, DurabilityLevel::SyncOnFlush,
+		DurabilityLevel::SyncPerCommand, DurabilityLevel::GroupCommit }) {
+		string dirPath = "replay_" + DurabilityPolicy::toString(level);
+		remove_all(dirPath);
+		create_directories(dirPath);
+
+		SSDConfig config = SSDConfig::inDirectory(dirPath);
+		config.durability = level;
+		ReplayReport report;
+		uint64_t syncCount;
+		{
+			SSDDriver ssdDriver(config);
+			report = TraceReplayer(records).replay(ssdDriver, pacing);
+			ssdDriver.syncPending();
+			syncCount = ssdDriver.getDurability().getSyncCount();
+		}
+		remove_all(dirPath);
+
+		if (level == DurabilityLevel::None) baseline = report.commandsPerSec;
+		double relative = baseline > 0 ? report.commandsPerSec / baseline : 0;
+		cout << "durability=" << DurabilityPolicy::toString(level) << " syncs=" << syncCount
+			<< " relative=" << fixed << setprecision(2) << relative << " " << report.toString() << endl;
+	}
+}
+
+int replayTrace(int argc, char* argv[])
+{
+	vector<TraceRecord> records;
+	if (argc < 3 || !TraceReader::load(argv[2], records)) {
+		cerr << "usage: ssd.exe --replay <trace> [--paced] [--memory] "
+			"[--durability none|flush|command|group] [--group-window-us <n>] [--durability-sweep] "
+			"[--nand-timing slc|mlc|tlc[,tR=<us>,tPROG=<us>,tBERS=<us>,xfer=<us>,channels=<n>,dies=<n>]] "
+			"[--namespaces <layout>]" << endl;
+		return 1;
+	}
+
+	ReplayPacing pacing = ReplayPacing::MaxSpeed;
+	bool inMemory = false;
+	bool sweep = false;
+	SSDConfig config;
+	for (int i = 3; i < argc; ++i) {
+		string option = argv[i];
+		if (option == "--paced") pacing = ReplayPacing::Original;
+		if (option == "--memory") inMemory = true;
+		if (option == "--durability-sweep") sweep = true;
+		if (option == "--durability" && i + 1 < argc) DurabilityPolicy::parse(argv[++i], config.durability);
+		if (option == "--group-window-us" && i + 1 < argc) config.groupCommitWindow = microseconds(atoi(argv[++i]));
+		if (option == "--nand-timing" && i + 1 < argc) config.modelTiming = NandTiming::parse(argv[++i], config.nandTiming);
+		if (option == "--namespaces" && i + 1 < argc) NamespaceLayout::parse(argv[++i], config.namespaces);
+	}
+
+	if (sweep) {
+		sweepDurability(records, pacing);
+		return 0;
+	}
+
+	unique_ptr<SSDDriver> ssdDriver = makeReplayDriver(inMemory, config);
+	ReplayReport report = TraceReplayer(records).replay(*ssdDriver, pacing);
+	ssdDriver->syncPending();
+	cout << "durability=" << DurabilityPolicy::toString(config.durability)
+		<< " syncs=" << ssdDriver->getDurability().getSyncCount() << " " << report.toString() << endl;
+	if (ssdDriver->getTimingModel()) cout << ssdDriver->getTimingModel()->report() << endl;
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
-	SSDDriver ssdDriver;
-	ssdDriver.run(argc, argv);
+	if (argc >= 2 && string(argv[1]) == "--replay") return replayTrace(argc, argv);
+
+	SSDDriver::runOnce(SSDConfig::fromEnvironment(".", readEnvironment), argc, argv);
 	return 0;
 }
 #endif
\ No newline at end of file
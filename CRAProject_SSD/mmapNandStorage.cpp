@@ -0,0 +1,95 @@
+#include "mmapNandStorage.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+
+MmapNandStorage::~MmapNandStorage() {
+    unmapImage();
+}
+
+bool MmapNandStorage::read(int addr, string& value) {
+    uint32_t cell;
+    if (!readRange(addr, 1, &cell)) return false;
+    value = Codec::formatValue(cell);
+    return true;
+}
+
+bool MmapNandStorage::write(int addr, const string& value) {
+    if (addr < 0 || addr >= lbaCount || value.size() != CELL_BYTES) return false;
+    if (!markAllocated(addr, 1) || !mapImage()) return false;
+
+    memcpy(image + CELL_BYTES * (size_t)addr, value.data(), CELL_BYTES);
+    return true;
+}
+
+bool MmapNandStorage::erase(int addr, int size) {
+    if (addr < 0 || addr + size > lbaCount) return false;
+    if (!markAllocated(addr, size) || !mapImage()) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        memcpy(image + CELL_BYTES * (size_t)(addr + offsetIdx), "0x00000000", CELL_BYTES);
+    }
+    return true;
+}
+
+bool MmapNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || addr + count > lbaCount) return false;
+    loadMap();
+    if (!mapImage()) return false;
+
+    return decodeCells(image + CELL_BYTES * (size_t)addr, CELL_BYTES * (size_t)count, addr, count, values);
+}
+
+bool MmapNandStorage::sync() {
+    if (image != nullptr && msync(image, imageLength, MS_SYNC) != 0) return false;
+    return FileNandStorage::sync();
+}
+
+bool MmapNandStorage::loadSnapshot(const string& name) {
+    unmapImage();
+    return FileNandStorage::loadSnapshot(name);
+}
+
+bool MmapNandStorage::mapImage() {
+    if (image != nullptr) return true;
+
+    fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    imageLength = CELL_BYTES * (size_t)lbaCount;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || ((size_t)status.st_size < imageLength && ftruncate(fd, imageLength) != 0)) {
+        unmapImage();
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, imageLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        unmapImage();
+        return false;
+    }
+    image = static_cast<char*>(mapped);
+    return true;
+}
+
+void MmapNandStorage::unmapImage() {
+    if (image != nullptr) munmap(image, imageLength);
+    image = nullptr;
+    if (fd >= 0) close(fd);
+    fd = -1;
+}
+#else
+MmapNandStorage::~MmapNandStorage() = default;
+
+bool MmapNandStorage::read(int addr, string& value) { return FileNandStorage::read(addr, value); }
+bool MmapNandStorage::write(int addr, const string& value) { return FileNandStorage::write(addr, value); }
+bool MmapNandStorage::erase(int addr, int size) { return FileNandStorage::erase(addr, size); }
+bool MmapNandStorage::readRange(int addr, int count, uint32_t* values) { return FileNandStorage::readRange(addr, count, values); }
+bool MmapNandStorage::sync() { return FileNandStorage::sync(); }
+bool MmapNandStorage::loadSnapshot(const string& name) { return FileNandStorage::loadSnapshot(name); }
+bool MmapNandStorage::mapImage() { return false; }
+void MmapNandStorage::unmapImage() {}
+#endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+using namespace std;
+
+// The text image mapped into memory: reads and writes are copies, and
+// sync() is an msync. The file is extended to its full size up front; the
+// NUL bytes that leaves read as unwritten cells. Falls back to
+// FileNandStorage where mmap is unavailable.
+class MmapNandStorage : public FileNandStorage {
+public:
+    explicit MmapNandStorage(const string& fileName, int lbaCount = 100)
+        : FileNandStorage(fileName, lbaCount) {
+    }
+
+    ~MmapNandStorage() override;
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool sync() override;
+    bool loadSnapshot(const string& name) override;
+
+private:
+    int fd = -1;
+    char* image = nullptr;
+    size_t imageLength = 0;
+
+    bool mapImage();
+    void unmapImage();
+};
\ No newline at end of file
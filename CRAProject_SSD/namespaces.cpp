@@ -0,0 +1,70 @@
+#include "namespaces.h"
+#include "bufferStore.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+bool NamespaceLayout::parse(const string& text, vector<SSDNamespace>& layout, int lbaCount) {
+    vector<SSDNamespace> parsed;
+    stringstream ss(text);
+    string item;
+    int nextLba = 0;
+    while (getline(ss, item, ',')) {
+        SSDNamespace ns;
+        size_t colon = item.find(':');
+        try {
+            size_t used;
+            ns.lbaCount = stoi(item.substr(0, colon), &used);
+            if (used != min(colon, item.size())) return false;
+            if (colon != string::npos) {
+                ns.bufferCapacity = stoi(item.substr(colon + 1), &used);
+                if (used != item.size() - colon - 1) return false;
+            }
+        }
+        catch (const exception&) {
+            return false;
+        }
+        // A buffer is saved in one manifest, so it may not outgrow its slots.
+        if (ns.lbaCount <= 0 || ns.bufferCapacity <= 0 || ns.bufferCapacity > DirectoryBufferStore::SLOT_COUNT) return false;
+        if (ns.lbaCount > lbaCount - nextLba) return false;
+
+        ns.firstLba = nextLba;
+        nextLba += ns.lbaCount;
+        parsed.push_back(ns);
+    }
+    if (parsed.empty()) return false;
+
+    layout = parsed;
+    return true;
+}
+
+string NamespaceLayout::toString(const vector<SSDNamespace>& layout) {
+    string text;
+    for (const SSDNamespace& ns : layout) {
+        if (!text.empty()) text += ",";
+        text += to_string(ns.lbaCount) + ":" + to_string(ns.bufferCapacity);
+    }
+    return text;
+}
+
+vector<SSDNamespace> NamespaceLayout::open(const string& fileName, const vector<SSDNamespace>& requested) {
+    vector<SSDNamespace> saved;
+    bool hasSaved = load(fileName, saved);
+    if (requested.empty()) return saved;
+
+    if (!hasSaved || saved != requested) save(fileName, requested);
+    return requested;
+}
+
+bool NamespaceLayout::load(const string& fileName, vector<SSDNamespace>& layout) {
+    ifstream ifs(fileName);
+    string text;
+    return getline(ifs, text) && parse(text, layout);
+}
+
+bool NamespaceLayout::save(const string& fileName, const vector<SSDNamespace>& layout) {
+    ofstream ofs(fileName, ios::trunc);
+    ofs << toString(layout);
+    return ofs.good();
+}
\ No newline at end of file
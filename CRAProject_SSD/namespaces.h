@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A contiguous range of LBAs with its own command buffer, flush threshold
+// and statistics. Commands keep using device LBAs; the namespace is the one
+// the LBA falls in.
+struct SSDNamespace {
+    static constexpr int DEFAULT_BUFFER_CAPACITY = 5;
+
+    int firstLba = 0;
+    int lbaCount = 100;
+    int bufferCapacity = DEFAULT_BUFFER_CAPACITY;
+
+    bool contains(int addr, int size = 1) const {
+        return addr >= firstLba && addr < firstLba + lbaCount && addr + size <= firstLba + lbaCount;
+    }
+
+    bool operator==(const SSDNamespace& other) const = default;
+};
+
+// Namespaces are written "<lbas>[:<buffer capacity>]" separated by commas and
+// laid out back to back from LBA 0, e.g. "80,20:2". LBAs past the last one
+// belong to no namespace. A layout is kept next to the image in
+// "<image>.namespaces" so later runs open the device the same way.
+class NamespaceLayout {
+public:
+    static bool parse(const string& text, vector<SSDNamespace>& layout, int lbaCount = 100);
+    static string toString(const vector<SSDNamespace>& layout);
+
+    // The requested layout, saved for later runs, or the saved one if none
+    // is requested; empty when the device was never split.
+    static vector<SSDNamespace> open(const string& fileName, const vector<SSDNamespace>& requested);
+
+    static bool load(const string& fileName, vector<SSDNamespace>& layout);
+    static bool save(const string& fileName, const vector<SSDNamespace>& layout);
+};
\ No newline at end of file
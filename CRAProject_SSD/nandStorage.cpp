@@ -0,0 +1,253 @@
+#include "nandStorage.h"
+
+bool NandStorage::readRange(int addr, int count, uint32_t* values) {
+    string value;
+    for (int offsetIdx = 0; offsetIdx < count; offsetIdx++) {
+        if (!read(addr + offsetIdx, value) || !Codec::tryParseValue(value, values[offsetIdx])) return false;
+    }
+    return true;
+}
+
+bool NandStorage::writeRange(int addr, int count, const uint32_t* values) {
+    for (int offsetIdx = 0; offsetIdx < count; offsetIdx++) {
+        if (!write(addr + offsetIdx, Codec::formatValue(values[offsetIdx]))) return false;
+    }
+    return true;
+}
+
+bool FileNandStorage::read(int addr, string& value) {
+    loadMap();
+    if (!isAllocated(addr)) {
+        value = "0x00000000";
+        return true;
+    }
+    if (!openOrCreate(ios::in)) return false;
+
+    string readResult(10, '\0');
+    streampos offset = 10 * addr;
+
+    nand.seekp(offset);
+    nand.read(&readResult[0], 10);
+    streamsize bytesRead = nand.gcount();
+    nand.close();
+
+    // Writing past the end leaves a hole of NUL bytes for the skipped LBAs.
+    bool unwritten = bytesRead < 10 || readResult[0] == '\0';
+    value = unwritten ? "0x00000000" : readResult;
+    return true;
+}
+
+bool FileNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || addr + count > lbaCount) return false;
+    loadMap();
+    if (!openOrCreate(ios::in)) return false;
+
+    string cells(CELL_BYTES * (size_t)count, '\0');
+    nand.seekg(CELL_BYTES * (streamoff)addr);
+    nand.read(&cells[0], cells.size());
+    streamsize bytesRead = nand.gcount();
+    nand.close();
+
+    return decodeCells(cells.data(), (size_t)bytesRead, addr, count, values);
+}
+
+bool FileNandStorage::write(int addr, const string& value) {
+    if (!markAllocated(addr, 1)) return false;
+    if (!openOrCreate(ios::in | ios::out)) return false;
+
+    streampos offset = 10 * addr;
+    nand.seekp(offset);
+    nand << value;
+    nand.close();
+    return true;
+}
+
+bool FileNandStorage::erase(int addr, int size) {
+    if (!markAllocated(addr, size)) return false;
+    if (!openOrCreate(ios::in | ios::out)) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        streampos offsetBase = 10 * (addr + offsetIdx);
+        nand.seekp(offsetBase);
+        nand << "0x00000000";
+    }
+    nand.close();
+    return true;
+}
+
+bool FileNandStorage::deallocate(int addr, int size) {
+    loadMap();
+    if (addr < 0 || addr + size > lbaCount) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        allocated[addr + offsetIdx] = false;
+    }
+    return saveMap();
+}
+
+bool FileNandStorage::sync() {
+    if (exists(mapFileName) && !syncFile(mapFileName)) return false;
+    if (!exists(fileName)) return true;
+    return syncFile(fileName);
+}
+
+bool FileNandStorage::saveSnapshot(const string& name) {
+    error_code ec;
+    path snapshotPath = snapshotDir() / name;
+    create_directories(snapshotPath, ec);
+    return !ec && copyImage(fileName, mapFileName, snapshotPath / "image", snapshotPath / "image.map");
+}
+
+bool FileNandStorage::loadSnapshot(const string& name) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    mapLoaded = false;
+    return copyImage(snapshotPath / "image", snapshotPath / "image.map", fileName, mapFileName);
+}
+
+bool FileNandStorage::removeSnapshot(const string& name) {
+    error_code ec;
+    return remove_all(snapshotDir() / name, ec) > 0 && !ec;
+}
+
+bool FileNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    return copyImage(snapshotPath / "image", snapshotPath / "image.map", targetPath, targetPath + ".map");
+}
+
+bool FileNandStorage::copyImage(const path& image, const path& map, const path& targetImage, const path& targetMap) {
+    error_code ec;
+    remove(targetImage, ec);
+    remove(targetMap, ec);
+    if (exists(image) && !copy_file(image, targetImage, ec)) return false;
+    if (exists(map) && !copy_file(map, targetMap, ec)) return false;
+    return true;
+}
+
+void FileNandStorage::loadMap() {
+    if (mapLoaded) return;
+    mapLoaded = true;
+    allocated.assign(lbaCount, true);
+
+    ifstream map(mapFileName, ios::binary);
+    if (!map.is_open()) return;
+
+    string bits((lbaCount + 7) / 8, '\0');
+    map.read(&bits[0], bits.size());
+    for (int addr = 0; addr < lbaCount && addr / 8 < map.gcount(); addr++) {
+        allocated[addr] = (bits[addr / 8] >> (addr % 8)) & 1;
+    }
+}
+
+bool FileNandStorage::saveMap() {
+    string bits((lbaCount + 7) / 8, '\0');
+    for (int addr = 0; addr < lbaCount; addr++) {
+        if (allocated[addr]) bits[addr / 8] |= (char)(1 << (addr % 8));
+    }
+
+    ofstream map(mapFileName, ios::binary | ios::trunc);
+    if (!map.is_open()) return false;
+    map.write(bits.data(), bits.size());
+    return map.good();
+}
+
+bool FileNandStorage::markAllocated(int addr, int size) {
+    loadMap();
+    bool changed = false;
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        if (isAllocated(addr + offsetIdx)) continue;
+        allocated[addr + offsetIdx] = true;
+        changed = true;
+    }
+    return !changed || saveMap();
+}
+
+bool FileNandStorage::decodeCells(const char* cells, size_t bytesRead, int addr, int count, uint32_t* values) {
+    for (int offsetIdx = 0; offsetIdx < count; offsetIdx++) {
+        size_t offset = CELL_BYTES * (size_t)offsetIdx;
+        bool unwritten = offset + CELL_BYTES > bytesRead || cells[offset] == '\0';
+        if (unwritten || !isAllocated(addr + offsetIdx)) values[offsetIdx] = 0;
+        else if (!Codec::tryParseValue(string(cells + offset, CELL_BYTES), values[offsetIdx])) return false;
+    }
+    return true;
+}
+
+bool FileNandStorage::openOrCreate(ios_base::openmode mode) {
+    nand.open(fileName, mode);
+    if (!nand.is_open()) {
+        ofstream createFile(fileName);
+        createFile.close();
+        nand.open(fileName, mode);
+    }
+    return nand.is_open();
+}
+
+bool MemoryNandStorage::read(int addr, string& value) {
+    if (addr < 0 || addr >= lbaCount) return false;
+
+    const shared_ptr<Chunk>& chunk = chunks[addr / CHUNK_LBAS];
+    bool unmapped = !chunk || (*chunk)[addr % CHUNK_LBAS].empty();
+    value = unmapped ? "0x00000000" : (*chunk)[addr % CHUNK_LBAS];
+    return true;
+}
+
+bool MemoryNandStorage::write(int addr, const string& value) {
+    if (addr < 0 || addr >= lbaCount) return false;
+
+    mutableCell(addr) = value;
+    return true;
+}
+
+bool MemoryNandStorage::erase(int addr, int size) {
+    if (addr < 0 || addr + size > lbaCount) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        mutableCell(addr + offsetIdx) = "0x00000000";
+    }
+    return true;
+}
+
+bool MemoryNandStorage::deallocate(int addr, int size) {
+    if (addr < 0 || addr + size > lbaCount) return false;
+
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        if (chunks[(addr + offsetIdx) / CHUNK_LBAS]) mutableCell(addr + offsetIdx).clear();
+    }
+    return true;
+}
+
+bool MemoryNandStorage::saveSnapshot(const string& name) {
+    snapshots[name] = chunks;
+    return true;
+}
+
+bool MemoryNandStorage::loadSnapshot(const string& name) {
+    auto snapshot = snapshots.find(name);
+    if (snapshot == snapshots.end()) return false;
+
+    chunks = snapshot->second;
+    return true;
+}
+
+shared_ptr<MemoryNandStorage> MemoryNandStorage::fork(const string& name) const {
+    shared_ptr<MemoryNandStorage> forked = make_shared<MemoryNandStorage>(lbaCount);
+    if (name.empty()) {
+        forked->chunks = chunks;
+        return forked;
+    }
+
+    auto snapshot = snapshots.find(name);
+    if (snapshot == snapshots.end()) return nullptr;
+    forked->chunks = snapshot->second;
+    return forked;
+}
+
+string& MemoryNandStorage::mutableCell(int addr) {
+    shared_ptr<Chunk>& chunk = chunks[addr / CHUNK_LBAS];
+    if (!chunk) chunk = make_shared<Chunk>(CHUNK_LBAS);
+    else if (chunk.use_count() > 1) chunk = make_shared<Chunk>(*chunk);
+    return (*chunk)[addr % CHUNK_LBAS];
+}
\ No newline at end of file
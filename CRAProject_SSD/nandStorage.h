@@ -0,0 +1,136 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+
+#include "durability.h"
+#include "codec.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+class NandStorage {
+public:
+    virtual ~NandStorage() = default;
+    virtual bool read(int addr, string& value) = 0;
+    virtual bool write(int addr, const string& value) = 0;
+    virtual bool erase(int addr, int size) = 0;
+
+    // Bulk read for scans; the default falls back to one read per LBA.
+    virtual bool readRange(int addr, int count, uint32_t* values);
+
+    // Bulk write for imports; the default falls back to one write per LBA.
+    virtual bool writeRange(int addr, int count, const uint32_t* values);
+
+    // Whether read and readRange may run on several threads at once.
+    virtual bool concurrentReads() const { return false; }
+
+    virtual bool deallocate(int addr, int size) { return erase(addr, size); }
+    virtual bool commit() { return true; }
+    virtual bool sync() { return true; }
+
+    virtual bool saveSnapshot(const string&) { return false; }
+    virtual bool loadSnapshot(const string&) { return false; }
+    virtual bool removeSnapshot(const string&) { return false; }
+    virtual bool cloneSnapshot(const string&, const string&) { return false; }
+
+    // Backend-specific figures appended to the S report; empty if none.
+    virtual string statistics() { return ""; }
+};
+
+// Deallocated LBAs are tracked in a bitmap next to the image ("<image>.map",
+// one bit per LBA, set = allocated). An image without a map is fully
+// allocated, so existing images keep working unchanged.
+class FileNandStorage : public NandStorage {
+public:
+    explicit FileNandStorage(const string& fileName, int lbaCount = 100)
+        : fileName(fileName), mapFileName(fileName + ".map"), lbaCount(lbaCount) {
+    }
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool deallocate(int addr, int size) override;
+    bool sync() override;
+
+    // A text image has no chunks to share, so its snapshots are full copies.
+    bool saveSnapshot(const string& name) override;
+
+    bool loadSnapshot(const string& name) override;
+    bool removeSnapshot(const string& name) override;
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+protected:
+    static constexpr int CELL_BYTES = 10;
+
+    string fileName;
+    string mapFileName;
+    int lbaCount;
+    fstream nand;
+    vector<bool> allocated;
+    bool mapLoaded = false;
+
+    path snapshotDir() const {
+        return path(fileName + ".snapshots");
+    }
+
+    static bool copyImage(const path& image, const path& map, const path& targetImage, const path& targetMap);
+
+    bool isAllocated(int addr) const {
+        return addr < 0 || addr >= (int)allocated.size() || allocated[addr];
+    }
+
+    void loadMap();
+    bool saveMap();
+    bool markAllocated(int addr, int size);
+    bool openOrCreate(ios_base::openmode mode);
+
+    // Parses count cells read from the image at addr, of which only
+    // bytesRead bytes were there. Unwritten and deallocated cells are zero.
+    bool decodeCells(const char* cells, size_t bytesRead, int addr, int count, uint32_t* values);
+};
+
+// Cells live in fixed-size chunks shared between the live image, snapshots
+// and forks; a chunk is copied only when a shared one is written.
+class MemoryNandStorage : public NandStorage {
+public:
+    static constexpr int CHUNK_LBAS = 16;
+
+    explicit MemoryNandStorage(int lbaCount = 100)
+        : lbaCount(lbaCount), chunks((lbaCount + CHUNK_LBAS - 1) / CHUNK_LBAS) {
+    }
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool deallocate(int addr, int size) override;
+    bool saveSnapshot(const string& name) override;
+    bool loadSnapshot(const string& name) override;
+
+    bool concurrentReads() const override {
+        return true;
+    }
+
+    bool removeSnapshot(const string& name) override {
+        return snapshots.erase(name) > 0;
+    }
+
+    // A new storage that starts from the snapshot (or the live image when the
+    // name is empty) and shares every chunk with it until written.
+    shared_ptr<MemoryNandStorage> fork(const string& name = "") const;
+
+private:
+    using Chunk = vector<string>;
+
+    int lbaCount;
+    vector<shared_ptr<Chunk>> chunks;
+    map<string, vector<shared_ptr<Chunk>>> snapshots;
+
+    string& mutableCell(int addr);
+};
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "nandTiming.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+
+bool NandTiming::parse(const string& text, NandTiming& timing) {
+    NandTiming parsed;
+    stringstream ss(text);
+    string item;
+    bool any = false;
+    while (getline(ss, item, ',')) {
+        any = true;
+        if (item == "slc") {
+            parsed.readTime = microseconds(25);
+            parsed.programTime = microseconds(200);
+            parsed.eraseTime = microseconds(1500);
+            continue;
+        }
+        if (item == "mlc") {
+            parsed.readTime = microseconds(50);
+            parsed.programTime = microseconds(600);
+            parsed.eraseTime = microseconds(3000);
+            continue;
+        }
+        if (item == "tlc") {
+            parsed.readTime = microseconds(80);
+            parsed.programTime = microseconds(1800);
+            parsed.eraseTime = microseconds(5000);
+            continue;
+        }
+
+        size_t equals = item.find('=');
+        if (equals == string::npos) return false;
+        string key = item.substr(0, equals);
+        int value;
+        try {
+            size_t used;
+            value = stoi(item.substr(equals + 1), &used);
+            if (used != item.size() - equals - 1) return false;
+        }
+        catch (const exception&) {
+            return false;
+        }
+        if (value < (key == "channels" || key == "dies" ? 1 : 0)) return false;
+
+        if (key == "tR") parsed.readTime = microseconds(value);
+        else if (key == "tPROG") parsed.programTime = microseconds(value);
+        else if (key == "tBERS") parsed.eraseTime = microseconds(value);
+        else if (key == "xfer") parsed.transferTime = microseconds(value);
+        else if (key == "channels") parsed.channels = value;
+        else if (key == "dies") parsed.diesPerChannel = value;
+        else return false;
+    }
+    if (!any) return false;
+
+    timing = parsed;
+    return true;
+}
+
+NandTimingModel::NandTimingModel(const NandTiming& timing)
+    : timing(timing), dieFree(timing.dieCount(), 0), channelFree(timing.channels, 0) {
+}
+
+void NandTimingModel::read(int addr) {
+    int die = dieOf(addr);
+    int channel = channelOf(die);
+    int64_t arrayStart = max(issueTime(), dieFree[die]);
+    int64_t transferStart = max(arrayStart + timing.readTime.count(), channelFree[channel]);
+    int64_t end = transferStart + timing.transferTime.count();
+
+    dieBusy += end - arrayStart;
+    dieFree[die] = end;
+    channelFree[channel] = end;
+    reads++;
+    finish(end);
+}
+
+void NandTimingModel::program(int addr) {
+    int die = dieOf(addr);
+    int channel = channelOf(die);
+    int64_t transferStart = max({ issueTime(), dieFree[die], channelFree[channel] });
+    int64_t transferEnd = transferStart + timing.transferTime.count();
+    int64_t end = transferEnd + timing.programTime.count();
+
+    dieBusy += end - transferStart;
+    channelFree[channel] = transferEnd;
+    dieFree[die] = end;
+    programs++;
+    finish(end);
+}
+
+void NandTimingModel::erase(int addr, int size) {
+    set<int> dies;
+    for (int offset = 0; offset < size && (int)dies.size() < timing.dieCount(); offset++) dies.insert(dieOf(addr + offset));
+
+    for (int die : dies) {
+        int64_t start = max(issueTime(), dieFree[die]);
+        int64_t end = start + timing.eraseTime.count();
+        dieBusy += end - start;
+        dieFree[die] = end;
+        erases++;
+        finish(end);
+    }
+}
+
+void NandTimingModel::beginCommand() {
+    inCommand = true;
+    issued = hostClock;
+    completed = hostClock;
+}
+
+void NandTimingModel::endCommand() {
+    if (!inCommand) return;
+
+    inCommand = false;
+    latencies.push_back(completed - issued);
+    hostClock = completed;
+}
+
+string NandTimingModel::report() const {
+    vector<int64_t> sorted = latencies;
+    sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (int64_t latency : sorted) total += (double)latency;
+
+    double elapsedSec = hostClock / 1e6;
+    double busy = hostClock > 0 ? 100.0 * dieBusy / ((double)hostClock * timing.dieCount()) : 0;
+    stringstream ss;
+    ss << fixed << setprecision(2)
+        << "simulated commands=" << sorted.size()
+        << " elapsed=" << elapsedSec << "s"
+        << " throughput=" << (elapsedSec > 0 ? sorted.size() / elapsedSec : 0) << "ops/s"
+        << " latency(us) avg=" << (sorted.empty() ? 0 : total / sorted.size())
+        << " p50=" << (sorted.empty() ? 0 : sorted[(sorted.size() - 1) * 50 / 100])
+        << " p99=" << (sorted.empty() ? 0 : sorted[(sorted.size() - 1) * 99 / 100])
+        << " max=" << (sorted.empty() ? 0 : sorted.back())
+        << " reads=" << reads
+        << " programs=" << programs
+        << " erases=" << erases
+        << " die_busy=" << busy << "%";
+    return ss.str();
+}
+
+void NandTimingModel::finish(int64_t end) {
+    if (inCommand) completed = max(completed, end);
+}
\ No newline at end of file
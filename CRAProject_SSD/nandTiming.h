@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+using namespace std::chrono;
+
+// Latencies of a NAND part and the geometry it is wired in. LBAs are striped
+// over the dies, and die d sits on channel d % channels.
+struct NandTiming {
+    microseconds readTime = microseconds(50);
+    microseconds programTime = microseconds(600);
+    microseconds eraseTime = microseconds(3000);
+
+    // Moving one LBA between controller and die over the channel.
+    microseconds transferTime = microseconds(10);
+
+    int channels = 1;
+    int diesPerChannel = 1;
+
+    int dieCount() const {
+        return channels * diesPerChannel;
+    }
+
+    // Comma-separated profile names ("slc", "mlc", "tlc") and overrides
+    // tR, tPROG, tBERS, xfer (microseconds), channels and dies (per channel),
+    // e.g. "tlc,channels=4,dies=2".
+    static bool parse(const string& text, NandTiming& timing);
+};
+
+// Charges every NAND operation the commands issue on virtual per-die and
+// per-channel timelines, independent of how fast the host file system is.
+// The host is modeled at queue depth one: a command is issued when the
+// previous one completed, its operations start as soon as their die and
+// channel are free, and it completes with the last of them. A read moves
+// the data out after tR, a program moves it in before tPROG, and an erase
+// of a range costs one tBERS on every die the range touches.
+class NandTimingModel {
+public:
+    explicit NandTimingModel(const NandTiming& timing = NandTiming());
+
+    const NandTiming& getTiming() const {
+        return timing;
+    }
+
+    void read(int addr);
+    void program(int addr);
+    void erase(int addr, int size);
+
+    // Operations charged in between belong to one host command. Outside a
+    // command, e.g. for a background flush slice, they are issued at the
+    // current virtual time without adding a command.
+    void beginCommand();
+    void endCommand();
+
+    microseconds now() const {
+        return microseconds(hostClock);
+    }
+
+    uint64_t getCommandCount() const {
+        return latencies.size();
+    }
+
+    // Formatted like ReplayReport, prefixed "simulated", followed by the
+    // operation counts and how busy the dies were.
+    string report() const;
+
+private:
+    NandTiming timing;
+    vector<int64_t> dieFree;
+    vector<int64_t> channelFree;
+    int64_t hostClock = 0;
+    int64_t issued = 0;
+    int64_t completed = 0;
+    bool inCommand = false;
+    int64_t dieBusy = 0;
+    uint64_t reads = 0;
+    uint64_t programs = 0;
+    uint64_t erases = 0;
+    vector<int64_t> latencies;
+
+    int dieOf(int addr) const {
+        return addr % timing.dieCount();
+    }
+
+    int channelOf(int die) const {
+        return die % timing.channels;
+    }
+
+    int64_t issueTime() const {
+        return inCommand ? issued : hostClock;
+    }
+
+    void finish(int64_t end);
+};
\ No newline at end of file
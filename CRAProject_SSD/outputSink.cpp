@@ -0,0 +1,11 @@
+#include "outputSink.h"
+
+#include <fstream>
+
+void FileOutputSink::write(const string& text) {
+    ofstream file(fileName);
+    if (!file.is_open()) return;
+
+    file << text;
+    file.close();
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    virtual void write(const string& text) = 0;
+};
+
+class FileOutputSink : public OutputSink {
+public:
+    explicit FileOutputSink(const string& fileName)
+        : fileName(fileName) {
+    }
+
+    void write(const string& text) override;
+
+private:
+    string fileName;
+};
+
+class MemoryOutputSink : public OutputSink {
+public:
+    void write(const string& text) override {
+        output = text;
+    }
+
+    const string& read() const {
+        return output;
+    }
+
+private:
+    string output;
+};
\ No newline at end of file
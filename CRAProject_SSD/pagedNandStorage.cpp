@@ -0,0 +1,287 @@
+#include "pagedNandStorage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+PagedNandStorage::PagedNandStorage(const string& fileName, int lbaCount)
+    : fileName(fileName), lbaCount(lbaCount), scratch(allocatePage()) {
+}
+
+PagedNandStorage::~PagedNandStorage() {
+    commit();
+    close();
+}
+
+bool PagedNandStorage::read(int addr, string& value) {
+    if (addr < 0 || addr >= lbaCount) return false;
+
+    const uint32_t* data = currentPage(addr / LBAS_PER_PAGE);
+    if (data == nullptr) return false;
+    value = Codec::formatValue(data[addr % LBAS_PER_PAGE]);
+    return true;
+}
+
+bool PagedNandStorage::write(int addr, const string& value) {
+    uint32_t parsed;
+    if (addr < 0 || addr >= lbaCount || !Codec::tryParseValue(value, parsed)) return false;
+
+    uint32_t* data = dirtyPage(addr / LBAS_PER_PAGE, false);
+    if (data == nullptr) return false;
+    data[addr % LBAS_PER_PAGE] = parsed;
+    return true;
+}
+
+bool PagedNandStorage::writeRange(int addr, int count, const uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount) return false;
+
+    for (int end = addr + count; addr < end;) {
+        int page = addr / LBAS_PER_PAGE;
+        int first = addr % LBAS_PER_PAGE;
+        int last = min(end - page * LBAS_PER_PAGE, LBAS_PER_PAGE);
+        bool overwrite = first == 0 && last >= min(LBAS_PER_PAGE, lbaCount - page * LBAS_PER_PAGE);
+
+        uint32_t* data = dirtyPage(page, overwrite);
+        if (data == nullptr) return false;
+        copy(values, values + (last - first), data + first);
+        values += last - first;
+        addr += last - first;
+    }
+    return true;
+}
+
+bool PagedNandStorage::erase(int addr, int size) {
+    if (addr < 0 || size < 0 || addr + size > lbaCount) return false;
+
+    for (int end = addr + size; addr < end;) {
+        int page = addr / LBAS_PER_PAGE;
+        int first = addr % LBAS_PER_PAGE;
+        int last = min(end - page * LBAS_PER_PAGE, LBAS_PER_PAGE);
+        bool overwrite = first == 0 && last >= min(LBAS_PER_PAGE, lbaCount - page * LBAS_PER_PAGE);
+
+        uint32_t* data = dirtyPage(page, overwrite);
+        if (data == nullptr) return false;
+        fill(data + first, data + last, 0u);
+        addr += last - first;
+    }
+    return true;
+}
+
+bool PagedNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount) return false;
+
+    for (int end = addr + count; addr < end;) {
+        int page = addr / LBAS_PER_PAGE;
+        int first = addr % LBAS_PER_PAGE;
+        int last = min(end - page * LBAS_PER_PAGE, LBAS_PER_PAGE);
+
+        const uint32_t* data = currentPage(page);
+        if (data == nullptr) return false;
+        values = copy(data + first, data + last, values);
+        addr += last - first;
+    }
+    return true;
+}
+
+bool PagedNandStorage::commit() {
+    if (dirty.empty()) return true;
+    if (!open() || (!hasHeader && !writeHeader())) return false;
+
+    for (auto& [page, data] : dirty) {
+        if (!writePage(page + 1, data.get())) return false;
+    }
+    dirty.clear();
+    return true;
+}
+
+bool PagedNandStorage::saveSnapshot(const string& name) {
+    if (!commit()) return false;
+
+    error_code ec;
+    create_directories(snapshotDir(), ec);
+    return !ec && copyImage(fileName, snapshotDir() / name);
+}
+
+bool PagedNandStorage::loadSnapshot(const string& name) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    dirty.clear();
+    close();
+    return copyImage(snapshotPath, fileName);
+}
+
+bool PagedNandStorage::removeSnapshot(const string& name) {
+    error_code ec;
+    return remove(snapshotDir() / name, ec) && !ec;
+}
+
+bool PagedNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    return copyImage(snapshotPath, targetPath);
+}
+
+bool PagedNandStorage::usesDirectIo() {
+    return open() && directIo;
+}
+
+bool PagedNandStorage::isImage(const string& fileName) {
+    ifstream image(fileName, ios::binary);
+    char magic[4] = {};
+    image.read(magic, 4);
+    return image.gcount() == 4 && equal(magic, magic + 4, MAGIC);
+}
+
+void PagedNandStorage::FreePage::operator()(uint32_t* page) const {
+#if defined(_WIN32)
+    _aligned_free(page);
+#else
+    free(page);
+#endif
+}
+
+PagedNandStorage::Page PagedNandStorage::allocatePage() {
+#if defined(_WIN32)
+    void* memory = _aligned_malloc(PAGE_SIZE, PAGE_SIZE);
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, PAGE_SIZE, PAGE_SIZE) != 0) memory = nullptr;
+#endif
+    if (memory == nullptr) throw bad_alloc();
+    return Page(static_cast<uint32_t*>(memory));
+}
+
+bool PagedNandStorage::writeHeader() {
+    Page header = allocatePage();
+    char* bytes = reinterpret_cast<char*>(header.get());
+    memset(bytes, 0, PAGE_SIZE);
+    memcpy(bytes, MAGIC, 4);
+    header.get()[1] = VERSION;
+    header.get()[2] = (uint32_t)lbaCount;
+    header.get()[3] = LBAS_PER_PAGE;
+    if (!writePage(0, header.get())) return false;
+
+    hasHeader = true;
+    return true;
+}
+
+bool PagedNandStorage::isValidHeader(const uint32_t* header) const {
+    const char* bytes = reinterpret_cast<const char*>(header);
+    return equal(bytes, bytes + 4, MAGIC) && header[1] == VERSION && header[2] == (uint32_t)lbaCount && header[3] == LBAS_PER_PAGE;
+}
+
+uint32_t* PagedNandStorage::dirtyPage(int page, bool overwrite) {
+    auto cached = dirty.find(page);
+    if (cached != dirty.end()) return cached->second.get();
+
+    Page data = allocatePage();
+    if (overwrite) {
+        memset(data.get(), 0, PAGE_SIZE);
+    }
+    else if (!open() || !readPage(page + 1, data.get())) {
+        return nullptr;
+    }
+    return dirty.emplace(page, move(data)).first->second.get();
+}
+
+const uint32_t* PagedNandStorage::currentPage(int page) {
+    auto cached = dirty.find(page);
+    if (cached != dirty.end()) return cached->second.get();
+
+    if (!open() || !readPage(page + 1, scratch.get())) return nullptr;
+    return scratch.get();
+}
+
+bool PagedNandStorage::copyImage(const path& image, const path& target) {
+    error_code ec;
+    remove(target, ec);
+    if (exists(image) && !copy_file(image, target, ec)) return false;
+    return true;
+}
+
+#if defined(__linux__)
+bool PagedNandStorage::open() {
+    if (fd >= 0) return true;
+
+    fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+    directIo = fd >= 0;
+    if (fd < 0 && errno == EINVAL) fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    off_t fileBytes = lseek(fd, 0, SEEK_END);
+    if (fileBytes > 0 && (!readPage(0, scratch.get()) || !isValidHeader(scratch.get()))) {
+        close();
+        return false;
+    }
+    hasHeader = fileBytes > 0;
+    return true;
+}
+
+void PagedNandStorage::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool PagedNandStorage::readPage(int page, uint32_t* data) {
+    ssize_t bytesRead = pread(fd, data, PAGE_SIZE, (off_t)page * PAGE_SIZE);
+    if (bytesRead < 0) return false;
+    memset(reinterpret_cast<char*>(data) + bytesRead, 0, PAGE_SIZE - bytesRead);
+    return true;
+}
+
+bool PagedNandStorage::writePage(int page, const uint32_t* data) {
+    return pwrite(fd, data, PAGE_SIZE, (off_t)page * PAGE_SIZE) == PAGE_SIZE;
+}
+
+bool PagedNandStorage::sync() {
+    return fd < 0 || fdatasync(fd) == 0;
+}
+#else
+bool PagedNandStorage::open() {
+    if (opened) return true;
+
+    ofstream(fileName, ios::binary | ios::app);
+    error_code ec;
+    uintmax_t fileBytes = file_size(fileName, ec);
+    if (ec || (fileBytes > 0 && (!readPage(0, scratch.get()) || !isValidHeader(scratch.get())))) return false;
+    hasHeader = fileBytes > 0;
+    opened = true;
+    return true;
+}
+
+void PagedNandStorage::close() {
+    opened = false;
+}
+
+bool PagedNandStorage::readPage(int page, uint32_t* data) {
+    ifstream image(fileName, ios::binary);
+    if (!image.is_open()) return false;
+    image.seekg((streamoff)page * PAGE_SIZE);
+    image.read(reinterpret_cast<char*>(data), PAGE_SIZE);
+    streamsize bytesRead = max<streamsize>(image.gcount(), 0);
+    memset(reinterpret_cast<char*>(data) + bytesRead, 0, PAGE_SIZE - (size_t)bytesRead);
+    return true;
+}
+
+bool PagedNandStorage::writePage(int page, const uint32_t* data) {
+    fstream image(fileName, ios::in | ios::out | ios::binary);
+    if (!image.is_open()) return false;
+    image.seekp((streamoff)page * PAGE_SIZE);
+    image.write(reinterpret_cast<const char*>(data), PAGE_SIZE);
+    return image.good();
+}
+
+bool PagedNandStorage::sync() {
+    return !exists(fileName) || syncFile(fileName);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// Page-aligned image layout, PAGE_SIZE bytes per page:
+//   page 0   "SSDP", u32 version, u32 lbaCount, u32 lbasPerPage, zero padding
+//   page n   the little-endian u32 values of LBAs (n - 1) * LBAS_PER_PAGE on
+//            (every zero value is unwritten or deallocated)
+// The image is opened with O_DIRECT, so every transfer is a whole page from
+// or to an aligned buffer and bypasses the page cache; where the filesystem
+// refuses O_DIRECT the same pages go through buffered I/O. Writes modify a
+// copy of their page kept until commit(), which writes each dirty page once.
+// Reads of clean pages always go to the device.
+class PagedNandStorage : public NandStorage {
+public:
+    static constexpr int PAGE_SIZE = 4096;
+    static constexpr int LBAS_PER_PAGE = PAGE_SIZE / 4;
+
+    explicit PagedNandStorage(const string& fileName, int lbaCount = 100);
+    ~PagedNandStorage() override;
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool writeRange(int addr, int count, const uint32_t* values) override;
+    bool commit() override;
+    bool sync() override;
+
+    bool saveSnapshot(const string& name) override;
+    bool loadSnapshot(const string& name) override;
+    bool removeSnapshot(const string& name) override;
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+    // Whether the image was opened with O_DIRECT.
+    bool usesDirectIo();
+
+    size_t dirtyPageCount() const {
+        return dirty.size();
+    }
+
+    static bool isImage(const string& fileName);
+
+private:
+    struct FreePage {
+        void operator()(uint32_t* page) const;
+    };
+    using Page = unique_ptr<uint32_t, FreePage>;
+
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'P' };
+    static constexpr uint32_t VERSION = 1;
+
+    string fileName;
+    int lbaCount;
+#if defined(__linux__)
+    int fd = -1;
+#else
+    bool opened = false;
+#endif
+    bool directIo = false;
+    bool hasHeader = false;
+    map<int, Page> dirty;
+    Page scratch;
+
+    path snapshotDir() const {
+        return path(fileName + ".snapshots");
+    }
+
+    static Page allocatePage();
+
+    bool open();
+    void close();
+    bool readPage(int page, uint32_t* data);
+    bool writePage(int page, const uint32_t* data);
+    bool writeHeader();
+
+    // Whether page 0 is a header this storage can use as is.
+    bool isValidHeader(const uint32_t* header) const;
+
+    // The dirty copy of a page, read from the image first unless the caller
+    // is about to overwrite all of it.
+    uint32_t* dirtyPage(int page, bool overwrite);
+
+    // The page as it is now: the dirty copy, or scratch filled from the image.
+    const uint32_t* currentPage(int page);
+
+    static bool copyImage(const path& image, const path& target);
+};
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "powerLossHarness.h"
+
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+string PowerLossReport::toString() const {
+    stringstream ss;
+    ss << "point=" << point;
+    if (!crashed) {
+        ss << " not reached";
+        return ss.str();
+    }
+    ss << " command=" << crashedCommand
+        << " consistent=" << (consistent ? "yes" : "no")
+        << " mismatched=" << mismatchedLbas.size()
+        << fixed << setprecision(2) << " recovery=" << recoveryUs << "us";
+    return ss.str();
+}
+
+PowerLossReport PowerLossHarness::run(const vector<vector<string>>& workload, const string& point, int skipHits) {
+    PowerLossReport report;
+    report.point = point;
+    reset();
+
+    int crashedCommand = -1;
+    report.crashed = runUntilPowerLoss(workload, point, skipHits, crashedCommand);
+    if (!report.crashed) return report;
+    report.crashedCommand = crashedCommand;
+
+    map<int, string> before;
+    map<int, string> after;
+    for (int idx = 0; idx <= report.crashedCommand; ++idx) {
+        before = after;
+        applyToModel(after, workload[idx]);
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+    SSDDriver recovered(config());
+    report.recoveryUs = duration<double, micro>(steady_clock::now() - start).count();
+
+    vector<string> state = readAll(recovered);
+    vector<int> mismatchedBefore = compare(state, before);
+    vector<int> mismatchedAfter = compare(state, after);
+    report.consistent = mismatchedBefore.empty() || mismatchedAfter.empty();
+    if (!report.consistent) report.mismatchedLbas = mismatchedBefore;
+    return report;
+}
+
+#if defined(_WIN32)
+bool PowerLossHarness::runUntilPowerLoss(const vector<vector<string>>& workload, const string& point, int skipHits, int& crashedCommand) {
+    unique_ptr<SSDDriver> ssdDriver = make_unique<SSDDriver>(config());
+    FaultInjector::arm(point, skipHits);
+    for (int idx = 0; idx < (int)workload.size(); ++idx) {
+        try {
+            ssdDriver->run(workload[idx]);
+        }
+        catch (const PowerLoss&) {
+            FaultInjector::disarm();
+            crashedCommand = idx;
+            // A killed process runs no destructors, so nothing gets a chance
+            // to write back state the crash interrupted.
+            static_cast<void>(ssdDriver.release());
+            return true;
+        }
+    }
+    FaultInjector::disarm();
+    return false;
+}
+#else
+bool PowerLossHarness::runUntilPowerLoss(const vector<vector<string>>& workload, const string& point, int skipHits, int& crashedCommand) {
+    int progress[2];
+    if (pipe(progress) != 0) return false;
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(progress[0]);
+        FaultInjector::arm(point, skipHits, true);
+        {
+            SSDDriver ssdDriver(config());
+            for (int idx = 0; idx < (int)workload.size(); ++idx) {
+                if (write(progress[1], &idx, sizeof(idx)) != (ssize_t)sizeof(idx)) _Exit(EXIT_FAILURE);
+                ssdDriver.run(workload[idx]);
+            }
+        }
+        _Exit(EXIT_SUCCESS);
+    }
+
+    close(progress[1]);
+    int idx;
+    while (child > 0 && read(progress[0], &idx, sizeof(idx)) == (ssize_t)sizeof(idx)) crashedCommand = idx;
+    close(progress[0]);
+
+    int status = 0;
+    if (child < 0 || waitpid(child, &status, 0) != child) return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == FaultInjector::POWER_LOSS_EXIT_CODE;
+}
+#endif
+
+vector<RecoveryTiming> PowerLossHarness::measureRecovery(int samples) {
+    vector<RecoveryTiming> timings;
+    for (bool filled : { false, true }) {
+        for (int bufferEntries = 0; bufferEntries <= 5; ++bufferEntries) {
+            reset();
+            {
+                SSDDriver ssdDriver(config());
+                if (filled) {
+                    for (int addr = 0; addr < LBA_COUNT; ++addr) {
+                        ssdDriver.run(vector<string>{ "W", to_string(addr), "0x12345678" });
+                    }
+                    ssdDriver.run(vector<string>{ "F" });
+                }
+                for (int addr = 0; addr < bufferEntries; ++addr) {
+                    ssdDriver.run(vector<string>{ "W", to_string(addr * 2), "0xCAFEBABE" });
+                }
+            }
+
+            vector<double> latencies;
+            for (int sample = 0; sample < samples; ++sample) {
+                steady_clock::time_point start = steady_clock::now();
+                SSDDriver recovered(config());
+                latencies.push_back(duration<double, micro>(steady_clock::now() - start).count());
+            }
+            sort(latencies.begin(), latencies.end());
+
+            RecoveryTiming timing;
+            timing.imageFormat = string(imageFormat == ImageFormat::Compressed ? "compressed" : "text") +
+                (filled ? "/filled" : "/empty");
+            timing.bufferEntries = bufferEntries;
+            timing.recoveryUs = latencies[latencies.size() / 2];
+            timings.push_back(timing);
+        }
+    }
+    reset();
+    return timings;
+}
+
+SSDConfig PowerLossHarness::config() const {
+    SSDConfig config = SSDConfig::inDirectory(dirPath);
+    config.imageFormat = imageFormat;
+    return config;
+}
+
+void PowerLossHarness::reset() {
+    remove_all(dirPath);
+    create_directories(dirPath);
+}
+
+void PowerLossHarness::applyToModel(map<int, string>& model, const vector<string>& args) {
+    if (args.empty()) return;
+    if (args[0] == "W" && args.size() >= 3) {
+        model[stoi(args[1])] = args[2];
+    }
+    else if ((args[0] == "E" || args[0] == "D") && args.size() >= 3) {
+        int addr = stoi(args[1]);
+        for (int offsetIdx = 0; offsetIdx < stoi(args[2]); ++offsetIdx) model.erase(addr + offsetIdx);
+    }
+}
+
+vector<string> PowerLossHarness::readAll(SSDDriver& ssdDriver) {
+    vector<string> state;
+    for (int addr = 0; addr < LBA_COUNT; ++addr) {
+        ssdDriver.run(vector<string>{ "R", to_string(addr) });
+        ifstream output(config().outputPath);
+        string value;
+        output >> value;
+        state.push_back(value);
+    }
+    return state;
+}
+
+vector<int> PowerLossHarness::compare(const vector<string>& state, const map<int, string>& model) {
+    vector<int> mismatched;
+    for (int addr = 0; addr < (int)state.size(); ++addr) {
+        auto expected = model.find(addr);
+        string value = expected == model.end() ? "0x00000000" : expected->second;
+        if (state[addr] != value) mismatched.push_back(addr);
+    }
+    return mismatched;
+}
\ No newline at end of file
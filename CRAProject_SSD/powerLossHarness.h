@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+
+#include "ssdDriver.h"
+#include "faultInjection.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace std::filesystem;
+
+struct PowerLossReport {
+    string point;
+    bool crashed = false;
+    int crashedCommand = -1;
+    bool consistent = true;
+    vector<int> mismatchedLbas;
+    double recoveryUs = 0;
+
+    string toString() const;
+};
+
+struct RecoveryTiming {
+    string imageFormat;
+    int bufferEntries = 0;
+    double recoveryUs = 0;
+};
+
+// Runs a workload against an on-disk device, cuts the power at an injected
+// fault point, restarts the device from the same directory and compares every
+// LBA with a reference model. The recovered state must equal the model either
+// just before or just after the command that was interrupted. The workload
+// runs in a forked child that the fault point kills, so whatever the child
+// still held in memory is lost as in a real power cut; Windows has no fork
+// and unwinds a PowerLoss in-process instead.
+class PowerLossHarness {
+public:
+    static constexpr int LBA_COUNT = 100;
+
+    explicit PowerLossHarness(const string& dirPath, ImageFormat imageFormat = ImageFormat::Text)
+        : dirPath(dirPath), imageFormat(imageFormat) {
+    }
+
+    PowerLossReport run(const vector<vector<string>>& workload, const string& point, int skipHits = 0);
+
+    // Median time to bring a device up with a buffer holding 0..5 commands,
+    // on an empty and on a fully written image.
+    vector<RecoveryTiming> measureRecovery(int samples = 20);
+
+private:
+    string dirPath;
+    ImageFormat imageFormat;
+
+    // Whether the power was cut, and in which command.
+    bool runUntilPowerLoss(const vector<vector<string>>& workload, const string& point, int skipHits, int& crashedCommand);
+
+    SSDConfig config() const;
+    void reset();
+    static void applyToModel(map<int, string>& model, const vector<string>& args);
+    vector<string> readAll(SSDDriver& ssdDriver);
+    static vector<int> compare(const vector<string>& state, const map<int, string>& model);
+};
\ No newline at end of file
@@ -1,38 +1,88 @@
-#pragma once
+#include "ssdContext.h"
+#include "command.h"
 
-#include <fstream>
-#include <string>
+#include <cstdlib>
+#include <algorithm>
 
-using namespace std;
+SSDConfig SSDConfig::inDirectory(const string& dirPath) {
+    path p(dirPath);
+    SSDConfig config;
+    config.nandPath = (p / "ssd_nand.txt").string();
+    config.outputPath = (p / "ssd_output.txt").string();
+    config.bufferPath = (p / "buffer").string();
+    return config;
+}
 
-struct SSDContext {
-    fstream nand;
-    const string nandFileName = "ssd_nand.txt";
+SSDConfig SSDConfig::detectInDirectory(const string& dirPath) {
+    SSDConfig config = inDirectory(dirPath);
+    if (CompressedNandStorage::isImage(config.nandPath)) config.imageFormat = ImageFormat::Compressed;
+    if (PagedNandStorage::isImage(config.nandPath)) config.imageFormat = ImageFormat::Paged;
+    if (ZonedNandStorage::isImage(config.nandPath)) config.imageFormat = ImageFormat::Zoned;
+    if (DedupNandStorage::isImage(config.nandPath)) config.imageFormat = ImageFormat::Dedup;
+    return config;
+}
 
-    static void overwriteTextToFile(const string& fileName, const string& text) {
-        ofstream file(fileName);
-        if (!file.is_open()) return;
+SSDConfig SSDConfig::fromEnvironment(const string& dirPath, const function<string(const char*)>& environment) {
+    SSDConfig config = detectInDirectory(dirPath);
+    error_code ec;
+    bool newImage = !exists(config.nandPath) || file_size(config.nandPath, ec) == 0;
+    string imageFormat = environment("SSD_IMAGE_FORMAT");
+    if (newImage && imageFormat == "compressed") config.imageFormat = ImageFormat::Compressed;
+    if (newImage && imageFormat == "paged") config.imageFormat = ImageFormat::Paged;
+    if (newImage && imageFormat == "zoned") config.imageFormat = ImageFormat::Zoned;
+    if (newImage && imageFormat == "dedup") config.imageFormat = ImageFormat::Dedup;
 
-        file << text;
-        file.close();
-    }
+    config.tracePath = environment("SSD_TRACE");
+    config.zoneSize = max(atoi(environment("SSD_ZONE_SIZE").c_str()), 0);
+    IntegrityStore::parse(environment("SSD_VERIFY"), config.verifyMode);
+    DurabilityPolicy::parse(environment("SSD_DURABILITY"), config.durability);
+    parseEraseMode(environment("SSD_ERASE_MODE"), config.eraseMode);
+    string ioEngine = environment("SSD_IO_ENGINE");
+    if (ioEngine == "uring") config.ioEngine = IoEngine::Uring;
+    if (ioEngine == "mmap") config.ioEngine = IoEngine::Mmap;
+    NamespaceLayout::parse(environment("SSD_NAMESPACES"), config.namespaces);
+    return config;
+}
 
-    bool openOrCreateNand(ios_base::openmode mode) {
-        nand.open(nandFileName, mode);
-        if (!nand.is_open()) {
-            ofstream createFile(nandFileName);
-            createFile.close();
-            nand.open(nandFileName, mode);
-        }
-        return nand.is_open();
-    }
+bool SSDConfig::parseEraseMode(const string& text, EraseMode& mode) {
+    if (text == "overwrite") mode = EraseMode::Overwrite;
+    else if (text == "deallocate") mode = EraseMode::Deallocate;
+    else return false;
+    return true;
+}
 
-    string handleErrorReturn() {
-        overwriteTextToFile("ssd_output.txt", "ERROR");
-        return "";
+shared_ptr<NandStorage> SSDContext::makeNandStorage(const SSDConfig& config) {
+    if (config.imageFormat == ImageFormat::Compressed) {
+        return make_shared<CompressedNandStorage>(config.nandPath);
     }
+    if (config.imageFormat == ImageFormat::Paged) return make_shared<PagedNandStorage>(config.nandPath);
+    if (config.imageFormat == ImageFormat::Zoned) return make_shared<ZonedNandStorage>(config.nandPath, zoneSizeFor(config));
+    if (config.imageFormat == ImageFormat::Dedup) return make_shared<DedupNandStorage>(config.nandPath);
+    if (config.ioEngine == IoEngine::Uring) return make_shared<UringNandStorage>(config.nandPath);
+    if (config.ioEngine == IoEngine::Mmap) return make_shared<MmapNandStorage>(config.nandPath);
+    return make_shared<FileNandStorage>(config.nandPath);
+}
 
-    void handleError() {
-        overwriteTextToFile("ssd_output.txt", "ERROR");
-    }
-};
\ No newline at end of file
+shared_ptr<IntegrityStore> SSDContext::makeIntegrityStore(const SSDConfig& config, shared_ptr<NandStorage> nandStorage) {
+    // CRCs an earlier run left are kept current even when this run does not verify.
+    string crcPath = config.nandPath + ".crc";
+    if (config.verifyMode == VerifyMode::Off && !exists(crcPath)) return nullptr;
+    return make_shared<IntegrityStore>(nandStorage, crcPath, Command::LBA_MAX, config.verifyMode, config.verifySampleRate);
+}
+
+shared_ptr<ZoneTable> SSDContext::makeZoneTable(const SSDConfig& config) {
+    int zoneSize = zoneSizeFor(config);
+    if (zoneSize == 0) return nullptr;
+    return make_shared<ZoneTable>(config.nandPath + ".zones", zoneSize);
+}
+
+int SSDContext::zoneSizeFor(const SSDConfig& config) {
+    int zoneSize = config.zoneSize;
+    if (zoneSize > 0 || ZoneTable::readZoneSize(config.nandPath + ".zones", zoneSize)) return zoneSize;
+    return config.imageFormat == ImageFormat::Zoned ? ZoneTable::DEFAULT_ZONE_SIZE : 0;
+}
+
+string SSDContext::handleErrorReturn() {
+    handleError();
+    return "";
+}
\ No newline at end of file
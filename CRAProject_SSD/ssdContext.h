@@ -0,0 +1,151 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+
+#include "nandStorage.h"
+#include "compressedNandStorage.h"
+#include "uringNandStorage.h"
+#include "mmapNandStorage.h"
+#include "pagedNandStorage.h"
+#include "zonedNandStorage.h"
+#include "dedupNandStorage.h"
+#include "outputSink.h"
+#include "integrity.h"
+#include "health.h"
+#include "namespaces.h"
+#include "zones.h"
+#include "nandTiming.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+enum class EraseMode {
+    Overwrite,
+    Deallocate,
+};
+
+enum class ImageFormat {
+    Text,
+    Compressed,
+    Paged,
+
+    // Zone logs; implies zoned mode.
+    Zoned,
+
+    // Bit-packed indexes into a pattern dictionary.
+    Dedup,
+};
+
+// How a text image is accessed; Linux only, elsewhere every engine is Stream.
+enum class IoEngine {
+    Stream,
+    Mmap,
+    Uring,
+};
+
+struct SSDConfig {
+    string nandPath = "ssd_nand.txt";
+    string outputPath = "ssd_output.txt";
+    string bufferPath = "./buffer";
+    string tracePath;
+    DurabilityLevel durability = DurabilityLevel::None;
+    microseconds groupCommitWindow = microseconds(1000);
+    microseconds flushIdleDelay = microseconds(0);
+    microseconds flushMaxAge = microseconds(0);
+    EraseMode eraseMode = EraseMode::Overwrite;
+    ImageFormat imageFormat = ImageFormat::Text;
+    IoEngine ioEngine = IoEngine::Stream;
+    VerifyMode verifyMode = VerifyMode::Off;
+    int verifySampleRate = IntegrityStore::DEFAULT_SAMPLE_RATE;
+
+    // Empty keeps the device as one namespace (or as the image was last split).
+    vector<SSDNamespace> namespaces;
+
+    // LBAs per zone in zoned mode; 0 keeps the device unzoned unless it was
+    // zoned before or uses the Zoned image format.
+    int zoneSize = 0;
+
+    // Charge NAND operations to a timing model with these latencies.
+    bool modelTiming = false;
+    NandTiming nandTiming;
+
+    static SSDConfig inDirectory(const string& dirPath);
+
+    // A device directory opened without knowing how it was created.
+    static SSDConfig detectInDirectory(const string& dirPath);
+
+    // The CLI's device in dirPath, configured by the SSD_* variables that
+    // environment looks up. An existing image keeps the format it was
+    // created with; SSD_IMAGE_FORMAT only picks the format of a new one.
+    static SSDConfig fromEnvironment(const string& dirPath, const function<string(const char*)>& environment);
+
+    // "overwrite" or "deallocate".
+    static bool parseEraseMode(const string& text, EraseMode& mode);
+};
+
+struct SSDContext {
+    shared_ptr<NandStorage> nand;
+    shared_ptr<OutputSink> output;
+    EraseMode eraseMode = EraseMode::Overwrite;
+
+    // Per-LBA CRCs; null unless the config turns verification on or the
+    // device already has a CRC file.
+    shared_ptr<IntegrityStore> integrity;
+
+    // Statistics for the S command; kept next to the image, or in memory.
+    shared_ptr<HealthLog> health;
+
+    // Zone states and write pointers; null unless the device is zoned.
+    shared_ptr<ZoneTable> zones;
+
+    // Simulated NAND latencies; null unless the config models timing.
+    shared_ptr<NandTimingModel> timing;
+
+    SSDContext()
+        : SSDContext(SSDConfig()) {
+    }
+
+    explicit SSDContext(const SSDConfig& config)
+        : nand(makeNandStorage(config)),
+          output(make_shared<FileOutputSink>(config.outputPath)),
+          eraseMode(config.eraseMode),
+          integrity(makeIntegrityStore(config, nand)),
+          health(make_shared<HealthLog>(nand, config.nandPath + ".health")),
+          zones(makeZoneTable(config)),
+          timing(config.modelTiming ? make_shared<NandTimingModel>(config.nandTiming) : nullptr) {
+    }
+
+    SSDContext(shared_ptr<NandStorage> nandStorage, shared_ptr<OutputSink> outputSink)
+        : nand(nandStorage), output(outputSink), health(make_shared<HealthLog>(nandStorage, "")) {
+    }
+
+    static shared_ptr<NandStorage> makeNandStorage(const SSDConfig& config);
+    static shared_ptr<IntegrityStore> makeIntegrityStore(const SSDConfig& config, shared_ptr<NandStorage> nandStorage);
+    static shared_ptr<ZoneTable> makeZoneTable(const SSDConfig& config);
+
+    // The zone size the config, an existing zone table or the image format
+    // asks for; 0 if the device is not zoned.
+    static int zoneSizeFor(const SSDConfig& config);
+
+    static void overwriteTextToFile(const string& fileName, const string& text) {
+        FileOutputSink(fileName).write(text);
+    }
+
+    string handleErrorReturn();
+
+    void handleError() {
+        health->countError();
+        output->write("ERROR");
+    }
+
+    // Data that fails its integrity check, as opposed to a bad command.
+    void handleCorruption() {
+        health->countCorruption();
+        output->write("CORRUPT");
+    }
+};
\ No newline at end of file
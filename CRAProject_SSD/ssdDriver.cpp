@@ -1,126 +1,446 @@
-#pragma once
+#include "ssdDriver.h"
 
-#include <vector>
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <filesystem>
+SSDDriver::SSDDriver(const SSDConfig& config)
+    : SSDDriver(SSDContext(config), make_shared<DirectoryBufferStore>(config.bufferPath),
+        NamespaceLayout::open(config.nandPath + ".namespaces", config.namespaces)) {
+    durability = DurabilityPolicy(config.durability, config.groupCommitWindow);
+    backgroundFlush = BackgroundFlushPolicy(config.flushIdleDelay, config.flushMaxAge);
+    if (!config.tracePath.empty()) {
+        setTraceRecorder(make_shared<TraceRecorder>(config.tracePath));
+    }
+}
 
-#include "ssdContext.cpp"
-#include "commandBuffer.cpp"
-#include "command.cpp"
+SSDDriver::SSDDriver(SSDContext context, shared_ptr<BufferStore> bufferStore, const vector<SSDNamespace>& layout)
+    : commandBufferManager(context, bufferStore, layout.empty() ? SSDNamespace::DEFAULT_BUFFER_CAPACITY : layout[0].bufferCapacity),
+      ctx(context), layout(layout) {
+    if (layout.empty()) {
+        namespaces.push_back({ SSDNamespace(), &commandBufferManager, nullptr });
+        return;
+    }
 
-using namespace std;
-using namespace std::filesystem;
+    for (int nsid = 0; nsid < (int)layout.size(); nsid++) {
+        CommandBufferManager* buffer = &commandBufferManager;
+        if (nsid > 0) {
+            namespaceBuffers.push_back(make_unique<CommandBufferManager>(ctx, bufferStore->forNamespace(nsid), layout[nsid].bufferCapacity));
+            buffer = namespaceBuffers.back().get();
+        }
+        string healthPath = ctx.health->getFileName().empty() ? "" : ctx.health->getFileName() + ".ns" + to_string(nsid);
+        shared_ptr<HealthLog> health = make_shared<HealthLog>(ctx.health, healthPath, layout[nsid].firstLba, layout[nsid].lbaCount);
+        buffer->setNamespaceHealth(health);
+        namespaces.push_back({ layout[nsid], buffer, health });
+    }
+}
 
-class SSDDriver {
-public:
-    CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
+void SSDDriver::setDurability(DurabilityLevel level, microseconds groupCommitWindow) {
+    syncPending();
+    durability = DurabilityPolicy(level, groupCommitWindow);
+}
 
-    void run(int argc, char* argv[]) {
+void SSDDriver::run(const vector<string>& args) {
+    if (ctx.timing) ctx.timing->beginCommand();
+    runCommand(args);
+    if (ctx.timing) ctx.timing->endCommand();
+}
 
-        if (argc <= 1) return ctx.handleError();
+void SSDDriver::runCommand(const vector<string>& args) {
+    if (traceRecorder) traceRecorder->record(args);
+    if (args.empty()) return ctx.handleError();
 
-        vector<string> args = parseArguments(argc, argv);
+    if (isValid(args) == false) {
+        return ctx.handleError();
+    }
+    if (activeFlush && args[0] != "R") {
+        while (activeFlush) flushSlice();
+    }
 
-        if (isValid(args) == false) {
-            return ctx.handleError();
-        }
+    unique_ptr<Command> cmd = make_unique<NoopCommand>();
+    string command = args[0];
+    if (command == "W" || command == "E") {
+        cmd = preprocessWE(args);
+    }
+    else if (command == "R") {
+        cmd = preprocessR(args);
+    }
+    else if (command == "F") {
+        cmd = preprocessF();
+    }
+    else if (command == "D") {
+        cmd = preprocessD(args);
+    }
+    else if (command == "SNAP") {
+        cmd = preprocessSnap(args);
+    }
+    else if (command == "ROLLBACK") {
+        cmd = preprocessRollback(args);
+    }
+    else if (command == "CLONE") {
+        cmd = preprocessClone(args);
+    }
+    else if (command == "CHECKSUM") {
+        cmd = make_unique<ChecksumCommand>(ctx, bufferedCommands());
+    }
+    else if (command == "COMPARE") {
+        cmd = make_unique<CompareCommand>(ctx, bufferedCommands(), args[1]);
+    }
+    else if (command == "SCRUB") {
+        cmd = make_unique<ScrubCommand>(ctx, bufferedCommands());
+    }
+    else if (command == "S") {
+        cmd = args.size() < 2 ? make_unique<HealthCommand>(ctx) : make_unique<HealthCommand>(ctx, namespaces[stoi(args[1])].health);
+    }
+    else if (command == "ZAPPEND") {
+        cmd = preprocessZoneAppend(args);
+    }
+    else if (command == "ZRESET") {
+        cmd = preprocessZoneReset(args);
+    }
+    else if (command == "ZOPEN" || command == "ZCLOSE" || command == "ZFINISH") {
+        cmd = make_unique<ZoneCommand>(ctx, command, stoi(args[1]));
+    }
+    else if (command == "ZREPORT") {
+        cmd = make_unique<ZoneReportCommand>(ctx);
+    }
+    else if (command == "EXPORT") {
+        cmd = make_unique<ExportCommand>(ctx, bufferedCommands(), args[1], args.size() >= 3);
+    }
+    else if (command == "IMPORT") {
+        cmd = preprocessImport(args);
+    }
+    else {
+        return ctx.handleError();
+    }
 
-        unique_ptr<Command> cmd = make_unique<NoopCommand>();
-        string command = args[0];
-        if (command == "W" || command == "E") {
-            cmd = preprocessWE(args);
-        }
-        else if (command == "R") {
-            cmd = preprocessR(args);
-        }
-        else if (command == "F") {
-            cmd = preprocessF(args);
-        }
-        else {
-            return ctx.handleError();
-        }
+    vector<int> flushedNamespaces;
+    flushedNamespaces.swap(flushing);
+    steady_clock::time_point start = steady_clock::now();
+    if (preemptibleFlush && dynamic_cast<FlushCommand*>(cmd.get()) != nullptr) {
+        activeFlush.reset(static_cast<FlushCommand*>(cmd.release()));
+        activeFlushCommand = command;
+        activeFlushNamespaces = flushedNamespaces;
+        activeFlushStart = start;
+        return;
+    }
+    cmd->execute();
+
+    bool flushed = dynamic_cast<FlushCommand*>(cmd.get()) != nullptr;
+    completeCommand(command, flushed, flushedNamespaces, start);
+}
+
+void SSDDriver::runOnce(const SSDConfig& config, const vector<string>& args) {
+    bool readOnly = !args.empty() && isReadOnly(args[0]);
+    DeviceLock lock(config.nandPath + ".lock", readOnly ? DeviceLock::Mode::Shared : DeviceLock::Mode::Exclusive);
+    SSDDriver(config).run(args);
+}
+
+string SSDDriver::execute(const vector<string>& args) {
+    return captureOutput([&]() { run(args); });
+}
+
+void SSDDriver::flushSlice() {
+    if (!activeFlush || !activeFlush->executeSlice(FLUSH_SLICE_COMMANDS)) return;
+
+    activeFlush.reset();
+    completeCommand(activeFlushCommand, true, activeFlushNamespaces, activeFlushStart);
+}
+
+string SSDDriver::executeFlushSlice() {
+    return captureOutput([&]() { flushSlice(); });
+}
 
-        cmd->execute();
+void SSDDriver::completeCommand(const string& command, bool flushed, const vector<int>& flushedNamespaces,
+    steady_clock::time_point start) {
+    microseconds latency = duration_cast<microseconds>(steady_clock::now() - start);
+    if (flushed) ctx.health->countFlush(latency);
+    for (int nsid : flushedNamespaces) {
+        if (namespaces[nsid].health) namespaces[nsid].health->countFlush(latency);
+        namespaces[nsid].buffer->completeFlush();
     }
+    bool buffered = false;
+    for (Namespace& ns : namespaces) buffered = buffered || !ns.buffer->getBuffer().empty();
+    backgroundFlush.commandRan(buffered, flushed);
+    if (durability.shouldSync(!isReadOnly(command), flushed)) syncAll();
+}
 
-private:
-    SSDContext ctx;
+string SSDDriver::captureOutput(const function<void()>& body) {
+    shared_ptr<OutputSink> output = ctx.output;
+    captured->write("");
+    ctx.output = captured;
+    for (Namespace& ns : namespaces) ns.buffer->setOutput(captured);
+    body();
+    ctx.output = output;
+    for (Namespace& ns : namespaces) ns.buffer->setOutput(output);
+    return captured->read();
+}
 
-    static vector<string> parseArguments(int argc, char* argv[]) {
-        vector<string> args;
-        for (int i = 1; i < argc; ++i) {
-            args.emplace_back(argv[i]);
-        }
-        return args;
+void SSDDriver::scrubStep() {
+    if (!scrubsInBackground()) return;
+    vector<int> corrupt;
+    ctx.integrity->scrub(bufferedCommands(), SCRUB_STEP_LBAS, corrupt);
+}
+
+int SSDDriver::namespaceOf(int addr, int size) const {
+    for (int nsid = 0; nsid < (int)namespaces.size(); nsid++) {
+        if (namespaces[nsid].range.contains(addr, size)) return nsid;
     }
+    return -1;
+}
 
-    unique_ptr<Command> preprocessWE(vector<string> args) {
-        unique_ptr<Command> cmd = make_unique<NoopCommand>();
-        bool needFlush = commandBufferManager.pushCommandBuffer(args);
-        if (needFlush == true) {
-            cmd = make_unique<FlushCommand>(ctx, commandBufferManager.getBuffer());
-        }
-        else {
-            cmd = make_unique<NoopCommand>();
-        }
+vector<vector<string>> SSDDriver::bufferedCommands() const {
+    if (namespaces.size() == 1) return namespaces[0].buffer->getBuffer();
 
-        return cmd;
+    vector<vector<string>> commands;
+    for (const Namespace& ns : namespaces) {
+        const vector<vector<string>>& buffer = ns.buffer->getBuffer();
+        commands.insert(commands.end(), buffer.begin(), buffer.end());
     }
+    return commands;
+}
 
-    unique_ptr<Command> preprocessR(vector<string> args) {
-        unique_ptr<Command> cmd = make_unique<NoopCommand>();
-        string value = commandBufferManager.getCommand(args);
-        if (value == "") {
-            cmd = make_unique<ReadCommand>(ctx, stoi(args[1]));
-        }
-        else {
-            cmd = make_unique<FastReadCommand>(ctx, value);
-        }
-        return cmd;
+void SSDDriver::syncAll() {
+    bool synced = ctx.nand->sync();
+    if (ctx.integrity) synced = ctx.integrity->sync() && synced;
+    for (Namespace& ns : namespaces) synced = ns.buffer->sync() && synced;
+    durability.synced();
+    if (!synced) ctx.handleError();
+}
+
+vector<string> SSDDriver::parseArguments(int argc, char* argv[]) {
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+        args.emplace_back(argv[i]);
     }
+    return args;
+}
 
-    unique_ptr<Command> preprocessF(vector<string> args) {
-        unique_ptr<Command> cmd = make_unique<NoopCommand>();
-        cmd = make_unique<FlushCommand>(ctx, commandBufferManager.getBuffer());
-        commandBufferManager.eraseAll();
+unique_ptr<Command> SSDDriver::preprocessWE(vector<string> args) {
+    unique_ptr<Command> cmd = make_unique<NoopCommand>();
+    int nsid = namespaceOf(stoi(args[1]));
+    if (ctx.zones && !ctx.zones->write(stoi(args[1]))) {
+        ctx.handleError();
         return cmd;
     }
 
-    bool isValid(vector<string> args)
+    ctx.health->countWrite();
+    if (namespaces[nsid].health) namespaces[nsid].health->countWrite();
+    CommandBufferManager& buffer = *namespaces[nsid].buffer;
+    bool needFlush = buffer.pushCommandBuffer(args);
+    if (needFlush == true) {
+        cmd = make_unique<FlushCommand>(ctx, buffer.getFlushBuffer());
+        flushing = { nsid };
+    }
+    else {
+        cmd = make_unique<NoopCommand>();
+    }
+
+    return cmd;
+}
+
+unique_ptr<Command> SSDDriver::preprocessR(vector<string> args) {
+    unique_ptr<Command> cmd = make_unique<NoopCommand>();
+    Namespace& ns = namespaces[namespaceOf(stoi(args[1]))];
+    string value = ns.buffer->getCommand(args);
+    if (value == "" && activeFlush) value = CommandBufferManager::lookup(activeFlush->getBuffer(), stoi(args[1]));
+    ctx.health->countRead(value != "");
+    if (ns.health) ns.health->countRead(value != "");
+    if (value == "") {
+        cmd = make_unique<ReadCommand>(ctx, stoi(args[1]));
+    }
+    else {
+        cmd = make_unique<FastReadCommand>(ctx, value);
+    }
+    return cmd;
+}
+
+unique_ptr<Command> SSDDriver::preprocessF() {
+    unique_ptr<Command> cmd = make_unique<FlushCommand>(ctx, bufferedCommands());
+    for (int nsid = 0; nsid < (int)namespaces.size(); nsid++) {
+        if (namespaces[nsid].buffer->getBuffer().empty()) continue;
+        namespaces[nsid].buffer->setBuffer({});
+        flushing.push_back(nsid);
+    }
+    return cmd;
+}
+
+unique_ptr<Command> SSDDriver::preprocessD(vector<string> args) {
+    int addr = stoi(args[1]);
+    int size = stoi(args[2]);
+    for (Namespace& ns : namespaces) {
+        if (addr < ns.range.firstLba + ns.range.lbaCount && ns.range.firstLba < addr + size) ns.buffer->discardRange(addr, size);
+    }
+    return make_unique<DeallocateCommand>(ctx, addr, size);
+}
+
+unique_ptr<Command> SSDDriver::preprocessZoneAppend(vector<string> args) {
+    int zone = stoi(args[1]);
+    int addr = ctx.zones->writePointer(zone);
+    if (ctx.zones->getState(zone) == ZoneState::Full || namespaceOf(addr) < 0) {
+        ctx.handleError();
+        return make_unique<NoopCommand>();
+    }
+
+    ctx.output->write(to_string(addr));
+    return preprocessWE({ "W", to_string(addr), args[2] });
+}
+
+unique_ptr<Command> SSDDriver::preprocessZoneReset(vector<string> args) {
+    int zone = stoi(args[1]);
+    int addr = ctx.zones->zoneStart(zone);
+    int size = ctx.zones->zoneCapacity(zone);
+    for (Namespace& ns : namespaces) {
+        if (addr < ns.range.firstLba + ns.range.lbaCount && ns.range.firstLba < addr + size) ns.buffer->discardRange(addr, size);
+    }
+    return make_unique<ZoneCommand>(ctx, "ZRESET", zone);
+}
+
+unique_ptr<Command> SSDDriver::preprocessSnap(vector<string> args) {
+    for (Namespace& ns : namespaces) {
+        if (ns.buffer->saveSnapshot(args[1])) continue;
+        ctx.handleError();
+        return make_unique<NoopCommand>();
+    }
+    return make_unique<SnapshotCommand>(ctx, args[1]);
+}
+
+unique_ptr<Command> SSDDriver::preprocessRollback(vector<string> args) {
+    vector<vector<vector<string>>> snapshots(namespaces.size());
+    for (size_t nsid = 0; nsid < namespaces.size(); nsid++) {
+        if (namespaces[nsid].buffer->readSnapshot(args[1], snapshots[nsid])) continue;
+        ctx.handleError();
+        return make_unique<NoopCommand>();
+    }
+    return make_unique<RollbackCommand>(ctx, args[1], [this, snapshots]() {
+        bool restored = true;
+        for (size_t nsid = 0; nsid < namespaces.size(); nsid++) restored = namespaces[nsid].buffer->restore(snapshots[nsid]) && restored;
+        return restored;
+    });
+}
+
+unique_ptr<Command> SSDDriver::preprocessClone(vector<string> args) {
+    vector<vector<vector<string>>> snapshots(namespaces.size());
+    for (size_t nsid = 0; nsid < namespaces.size(); nsid++) {
+        if (namespaces[nsid].buffer->readSnapshot(args[1], snapshots[nsid])) continue;
+        ctx.handleError();
+        return make_unique<NoopCommand>();
+    }
+    return make_unique<CloneCommand>(ctx, args[1], args[2], snapshots, layout);
+}
+
+unique_ptr<Command> SSDDriver::preprocessImport(vector<string> args) {
+    if (args[1] != "-" && !is_regular_file(args[1])) {
+        ctx.handleError();
+        return make_unique<NoopCommand>();
+    }
+    return make_unique<ImportCommand>(ctx, args[1], args.size() >= 3, [this]() {
+        for (Namespace& ns : namespaces) ns.buffer->eraseAll();
+    });
+}
+
+bool SSDDriver::isReadOnly(const string& command) {
+    return command == "R" || command == "CHECKSUM" || command == "COMPARE" || command == "SCRUB" || command == "S" ||
+        command == "ZREPORT" || command == "EXPORT";
+}
+
+bool SSDDriver::isValidSnapshotName(const string& name) {
+    if (name.empty() || name.size() > 64) return false;
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-') return false;
+    }
+    return true;
+}
+
+bool SSDDriver::isValid(vector<string> args)
+{
+    try {
+        return isValidArguments(args);
+    }
+    catch (const exception&) {
+        return false;
+    }
+}
+
+bool SSDDriver::isValidArguments(const vector<string>& args)
+{
+    string command = args[0];
+    
+    if (command == "W")
     {
-        string command = args[0];
-        
-        if (command == "W")
-        {
-            int addr = stoi(args[1]);
-            string value = args[2];
-            const string valid = "0123456789ABCDEF";
-            if (addr < 0 || addr >= 100) return false;
-            if (value.find("0x") != 0 || value.size() != 10) return false;
-
-            for (int i = 2; i < 10; ++i) {
-                if (valid.find(value[i]) == string::npos) return false;
-            }
-        }
-        else if (command == "R") {
-            int addr = stoi(args[1]);
-            if (addr < 0 || addr >= 100) return false;
-        }
-        else if (command == "E") {
-            int addr = stoi(args[1]);
-            int value = stoi(args[2]);
+        if (args.size() < 3) return false;
+        int addr = stoi(args[1]);
+        string value = args[2];
+        const string valid = "0123456789ABCDEF";
+        if (addr < 0 || addr >= 100) return false;
+        if (value.find("0x") != 0 || value.size() != 10) return false;
 
-            if (addr < 0 || addr >= 100) return false;
-            if (addr + value < 0 || addr + value > 100) return false;
-            if (value < 0 || value > 10) return false;
+        for (int i = 2; i < 10; ++i) {
+            if (valid.find(value[i]) == string::npos) return false;
         }
+    }
+    else if (command == "R") {
+        if (args.size() < 2) return false;
+        int addr = stoi(args[1]);
+        if (addr < 0 || addr >= 100) return false;
+    }
+    else if (command == "E") {
+        if (args.size() < 3) return false;
+        int addr = stoi(args[1]);
+        int value = stoi(args[2]);
+
+        if (addr < 0 || addr >= 100) return false;
+        if (addr + value < 0 || addr + value > 100) return false;
+        if (value < 0 || value > 10) return false;
+    }
+    else if (command == "D") {
+        if (args.size() < 3) return false;
+        int addr = stoi(args[1]);
+        int size = stoi(args[2]);
 
-        if (command != "W" && command != "E" && command != "F" && command != "R") return false;
+        if (addr < 0 || addr >= 100) return false;
+        if (size < 0 || addr + size > 100) return false;
+    }
 
-        return true;
+    else if (command == "SNAP" || command == "ROLLBACK") {
+        if (args.size() < 2 || !isValidSnapshotName(args[1])) return false;
+    }
+    else if (command == "CLONE") {
+        if (args.size() < 3 || !isValidSnapshotName(args[1]) || args[2].empty()) return false;
     }
+    else if (command == "COMPARE") {
+        if (args.size() < 2 || args[1].empty()) return false;
+    }
+    else if (command == "S" && args.size() >= 2) {
+        int nsid = stoi(args[1]);
+        if (layout.empty() || nsid < 0 || nsid >= (int)layout.size()) return false;
+    }
+
+    else if (command == "ZOPEN" || command == "ZCLOSE" || command == "ZFINISH" || command == "ZRESET" || command == "ZAPPEND") {
+        if (!ctx.zones || args.size() < (command == "ZAPPEND" ? 3u : 2u)) return false;
+        int zone = stoi(args[1]);
+        if (zone < 0 || zone >= ctx.zones->getZoneCount()) return false;
+        if (command == "ZAPPEND" && !Codec::isValue(args[2])) return false;
+    }
+    else if (command == "ZREPORT") {
+        if (!ctx.zones) return false;
+    }
+    else if (command == "EXPORT" || command == "IMPORT") {
+        if (args.size() < 2 || args[1].empty() || (args.size() >= 3 && args[2] != "BIN")) return false;
+    }
+
+    // A command buffers in one namespace, so it may not leave it.
+    if (command == "W" || command == "R") {
+        if (namespaceOf(stoi(args[1])) < 0) return false;
+    }
+    else if (command == "E") {
+        if (namespaceOf(stoi(args[1]), stoi(args[2])) < 0) return false;
+    }
+
+    // Zones are written sequentially and only emptied by ZRESET.
+    if (ctx.zones && (command == "E" || command == "D" || command == "IMPORT")) return false;
+
+    if (command != "W" && command != "E" && command != "F" && command != "R" && command != "D" &&
+        command != "SNAP" && command != "ROLLBACK" && command != "CLONE" &&
+        command != "CHECKSUM" && command != "COMPARE" && command != "SCRUB" && command != "S" &&
+        command != "ZOPEN" && command != "ZCLOSE" && command != "ZFINISH" && command != "ZRESET" &&
+        command != "ZAPPEND" && command != "ZREPORT" && command != "EXPORT" && command != "IMPORT") return false;
 
-    friend class SddDriverTestFixture;
-};
\ No newline at end of file
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cctype>
+#include <functional>
+
+#include "ssdContext.h"
+#include "commandBuffer.h"
+#include "command.h"
+#include "trace.h"
+#include "deviceLock.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+class SSDDriver {
+public:
+    // The buffer of the first namespace: the whole device unless it is split.
+    CommandBufferManager commandBufferManager;
+
+    SSDDriver()
+        : SSDDriver(SSDConfig()) {
+    }
+
+    explicit SSDDriver(const SSDConfig& config);
+
+    // With a layout, each namespace buffers and flushes its writes on its
+    // own, namespace n > 0 in bufferStore->forNamespace(n), and keeps its own
+    // statistics ("S <nsid>"). F flushes every namespace.
+    SSDDriver(SSDContext context, shared_ptr<BufferStore> bufferStore, const vector<SSDNamespace>& layout = {});
+
+    void setTraceRecorder(shared_ptr<TraceRecorder> recorder) {
+        traceRecorder = recorder;
+    }
+
+    ~SSDDriver() {
+        while (activeFlush) flushSlice();
+        syncPending();
+        ctx.health->save();
+        for (Namespace& ns : namespaces) {
+            if (ns.health) ns.health->save();
+        }
+    }
+
+    SSDDriver(const SSDDriver&) = delete;
+    SSDDriver& operator=(const SSDDriver&) = delete;
+
+    void setDurability(DurabilityLevel level, microseconds groupCommitWindow = microseconds(1000));
+
+    const DurabilityPolicy& getDurability() const {
+        return durability;
+    }
+
+    // Group commit: syncs the commands batched since the last sync. Resident
+    // hosts call this once the window expires or the device goes idle.
+    void syncPending() {
+        if (durability.hasPending()) syncAll();
+    }
+
+    // Background flushing, for hosts that keep the driver resident: drains
+    // the buffer once the device idles or its oldest entry gets too old.
+    void setBackgroundFlush(microseconds idleDelay, microseconds maxAge) {
+        backgroundFlush = BackgroundFlushPolicy(idleDelay, maxAge);
+    }
+
+    const BackgroundFlushPolicy& getBackgroundFlush() const {
+        return backgroundFlush;
+    }
+
+    void flushInBackground() {
+        if (backgroundFlush.hasPending()) run(vector<string>{ "F" });
+    }
+
+    // Preemptible flushes, for hosts that serve reads during a flush: run()
+    // only starts a flush, and the host applies FLUSH_SLICE_COMMANDS buffered
+    // commands per flushSlice(). Reads see the flush's commands until it
+    // ends; any other command finishes it first.
+    static constexpr int FLUSH_SLICE_COMMANDS = 1;
+
+    void setPreemptibleFlush(bool enabled) {
+        preemptibleFlush = enabled;
+    }
+
+    bool hasFlushInProgress() const {
+        return activeFlush != nullptr;
+    }
+
+    void flushSlice();
+
+    // flushSlice(), returning what it wrote like execute().
+    string executeFlushSlice();
+
+    // Background scrubbing, for hosts that keep the driver resident: each
+    // step verifies the next SCRUB_STEP_LBAS LBAs when the mode is Scrub.
+    static constexpr int SCRUB_STEP_LBAS = 16;
+
+    bool scrubsInBackground() const {
+        return ctx.integrity && ctx.integrity->getMode() == VerifyMode::Scrub;
+    }
+
+    void scrubStep();
+
+    void run(int argc, char* argv[]) {
+        run(parseArguments(argc, argv));
+    }
+
+    // One command the way a standalone ssd process runs it: the driver is
+    // opened, run and closed under the device's lock file ("<image>.lock"),
+    // shared for read-only commands so parallel readers do not wait for each
+    // other, exclusive for anything that touches the buffer or the image.
+    static void runOnce(const SSDConfig& config, const vector<string>& args);
+
+    static void runOnce(const SSDConfig& config, int argc, char* argv[]) {
+        runOnce(config, parseArguments(argc, argv));
+    }
+
+    static bool isReadOnly(const string& command);
+
+    void run(const vector<string>& args);
+
+    // Runs one command and returns what it wrote ("" if nothing) instead of
+    // writing it to the output.
+    string execute(const vector<string>& args);
+
+    const vector<SSDNamespace>& getLayout() const {
+        return layout;
+    }
+
+    // The namespace addr falls in, or -1 if none does.
+    int namespaceOf(int addr, int size = 1) const;
+
+    // The commands buffered in every namespace.
+    vector<vector<string>> bufferedCommands() const;
+
+    // Null unless the device is zoned.
+    shared_ptr<ZoneTable> getZones() const {
+        return ctx.zones;
+    }
+
+    // Null unless the config models NAND timing; each run() is one command.
+    shared_ptr<NandTimingModel> getTimingModel() const {
+        return ctx.timing;
+    }
+
+private:
+    struct Namespace {
+        SSDNamespace range;
+        CommandBufferManager* buffer;
+
+        // Null when the device is not split: the device log is the only one.
+        shared_ptr<HealthLog> health;
+    };
+
+    SSDContext ctx;
+    vector<SSDNamespace> layout;
+    vector<Namespace> namespaces;
+    vector<unique_ptr<CommandBufferManager>> namespaceBuffers;
+    vector<int> flushing;
+    shared_ptr<TraceRecorder> traceRecorder;
+    DurabilityPolicy durability;
+    BackgroundFlushPolicy backgroundFlush;
+    shared_ptr<MemoryOutputSink> captured = make_shared<MemoryOutputSink>();
+    bool preemptibleFlush = false;
+    unique_ptr<FlushCommand> activeFlush;
+    string activeFlushCommand;
+    vector<int> activeFlushNamespaces;
+    steady_clock::time_point activeFlushStart;
+
+    void syncAll();
+    void runCommand(const vector<string>& args);
+
+    // flushedNamespaces lists those whose buffers the command flushed.
+    void completeCommand(const string& command, bool flushed, const vector<int>& flushedNamespaces,
+        steady_clock::time_point start);
+    string captureOutput(const function<void()>& body);
+    static vector<string> parseArguments(int argc, char* argv[]);
+    unique_ptr<Command> preprocessWE(vector<string> args);
+    unique_ptr<Command> preprocessR(vector<string> args);
+    unique_ptr<Command> preprocessF();
+    unique_ptr<Command> preprocessD(vector<string> args);
+    unique_ptr<Command> preprocessZoneAppend(vector<string> args);
+    unique_ptr<Command> preprocessZoneReset(vector<string> args);
+    unique_ptr<Command> preprocessImport(vector<string> args);
+    unique_ptr<Command> preprocessSnap(vector<string> args);
+    unique_ptr<Command> preprocessRollback(vector<string> args);
+    unique_ptr<Command> preprocessClone(vector<string> args);
+    static bool isValidSnapshotName(const string& name);
+    bool isValid(vector<string> args);
+    bool isValidArguments(const vector<string>& args);
+
+    friend class SddDriverTestFixture;
+};
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "ssdHost.h"
+
+#include <utility>
+#include <algorithm>
+
+string SSDRequest::wait() {
+    unique_lock<mutex> guard(state->lock);
+    state->done.wait(guard, [&]() { return state->completed; });
+    return state->result;
+}
+
+bool SSDRequest::isDone() const {
+    lock_guard<mutex> guard(state->lock);
+    return state->completed;
+}
+
+bool SSDRequest::await_suspend(coroutine_handle<> waiter) {
+    lock_guard<mutex> guard(state->lock);
+    if (state->completed) return false;
+    state->waiter = waiter;
+    return true;
+}
+
+void SSDRequest::State::complete(const string& output) {
+    coroutine_handle<> resumed;
+    {
+        lock_guard<mutex> guard(lock);
+        completed = true;
+        result = output;
+        resumed = exchange(waiter, nullptr);
+    }
+    done.notify_all();
+    if (resumed) resumed.resume();
+}
+
+SSDHost::SSDHost(int deviceCount, DriverFactory factory, IoScheduler scheduler) {
+    for (int i = 0; i < deviceCount; ++i) {
+        devices.push_back(make_unique<Device>());
+        devices.back()->driver = factory(i);
+        devices.back()->driver->setPreemptibleFlush(scheduler.policy != IoSchedule::Fifo);
+        devices.back()->scheduler = scheduler;
+    }
+    for (auto& device : devices) {
+        Device* target = device.get();
+        target->worker = thread([target]() { workerLoop(*target); });
+    }
+}
+
+SSDHost::SSDHost(const string& rootPath, int deviceCount)
+    : SSDHost(deviceCount, [rootPath](int idx) {
+        string devicePath = (path(rootPath) / ("device_" + to_string(idx))).string();
+        create_directories(devicePath);
+        return make_unique<SSDDriver>(SSDConfig::inDirectory(devicePath));
+    }) {
+}
+
+SSDHost::~SSDHost() {
+    for (auto& device : devices) {
+        {
+            lock_guard<mutex> guard(device->lock);
+            device->stopping = true;
+        }
+        device->wake.notify_one();
+    }
+    for (auto& device : devices) {
+        if (device->worker.joinable()) device->worker.join();
+    }
+}
+
+void SSDHost::submit(int idx, const vector<string>& args) {
+    Device& target = *devices[idx];
+    {
+        lock_guard<mutex> guard(target.lock);
+        enqueue(target, { args, nullptr, steady_clock::now() });
+    }
+    target.wake.notify_one();
+}
+
+SSDRequest SSDHost::request(int idx, const vector<string>& args) {
+    SSDRequest pending;
+    Device& target = *devices[idx];
+    {
+        lock_guard<mutex> guard(target.lock);
+        enqueue(target, { args, pending.state, steady_clock::now() });
+    }
+    target.wake.notify_one();
+    return pending;
+}
+
+void SSDHost::waitIdle() {
+    for (auto& device : devices) {
+        unique_lock<mutex> guard(device->lock);
+        device->idle.wait(guard, [&]() { return device->isIdle(); });
+    }
+}
+
+void SSDHost::enqueue(Device& device, Queued queued) {
+    const vector<string>& args = queued.args;
+    bool overtakes = device.scheduler.policy != IoSchedule::Fifo && args.size() >= 2 && args[0] == "R";
+    if (overtakes) {
+        try {
+            int addr = stoi(args[1]);
+            shared_ptr<ZoneTable> zones = device.driver->getZones();
+            for (const Queued& other : device.queue) {
+                if (mayChange(other.args, addr, zones.get())) overtakes = false;
+            }
+        }
+        catch (const exception&) {
+            overtakes = false;
+        }
+    }
+    (overtakes ? device.reads : device.queue).push_back(move(queued));
+}
+
+bool SSDHost::mayChange(const vector<string>& queued, int addr, const ZoneTable* zones) {
+    try {
+        if (queued.empty()) return false;
+        if (queued[0] == "W") return queued.size() >= 2 && stoi(queued[1]) == addr;
+        if (queued[0] == "E" || queued[0] == "D") {
+            return queued.size() >= 3 && addr >= stoi(queued[1]) && addr < stoi(queued[1]) + stoi(queued[2]);
+        }
+
+        // Where an append lands is only known when it runs, so it may change
+        // any LBA of its zone.
+        if (queued[0] == "ZAPPEND" || queued[0] == "ZRESET") {
+            if (zones == nullptr || queued.size() < 2) return false;
+            int zone = stoi(queued[1]);
+            int start = zones->zoneStart(zone);
+            return addr >= start && addr < start + zones->zoneCapacity(zone);
+        }
+        // Whole-device writers.
+        return queued[0] == "ROLLBACK" || queued[0] == "IMPORT";
+    }
+    catch (const exception&) {
+        return false;
+    }
+}
+
+bool SSDHost::takeNext(Device& device, Queued& next, bool& sliceFlush) {
+    bool readReady = !device.reads.empty();
+    bool otherReady = device.flushing || !device.queue.empty();
+    sliceFlush = false;
+    if (!readReady && !otherReady) return false;
+
+    bool takeRead = readReady;
+    if (readReady && otherReady) {
+        const IoScheduler& scheduler = device.scheduler;
+        steady_clock::time_point otherSince = device.flushing ? device.flushQueuedAt : device.queue.front().queuedAt;
+        takeRead = scheduler.policy == IoSchedule::Deadline ?
+            steady_clock::now() - otherSince < scheduler.writeDeadline :
+            device.readStreak < scheduler.readWeight;
+    }
+    device.readStreak = takeRead ? device.readStreak + 1 : 0;
+    if (!takeRead && device.flushing) {
+        sliceFlush = true;
+        return false;
+    }
+
+    deque<Queued>& from = takeRead ? device.reads : device.queue;
+    next = move(from.front());
+    from.pop_front();
+    return true;
+}
+
+void SSDHost::workerLoop(Device& device) {
+    unique_lock<mutex> guard(device.lock);
+    auto hasWork = [&]() { return device.stopping || !device.queue.empty() || !device.reads.empty(); };
+    while (true) {
+        SSDDriver& driver = *device.driver;
+        const DurabilityPolicy& durability = driver.getDurability();
+        const BackgroundFlushPolicy& backgroundFlush = driver.getBackgroundFlush();
+        if (!device.flushing && backgroundFlush.isOverdue(steady_clock::now())) {
+            guard.unlock();
+            driver.flushInBackground();
+            guard.lock();
+            device.flushing = driver.hasFlushInProgress();
+            device.flushQueuedAt = steady_clock::now();
+            continue;
+        }
+
+        steady_clock::time_point due = steady_clock::time_point::max();
+        if (durability.hasPending()) due = durability.pendingDeadline();
+        if (backgroundFlush.hasPending()) due = min(due, backgroundFlush.dueAt());
+        if (due == steady_clock::time_point::max() && driver.scrubsInBackground()) due = steady_clock::now() + SCRUB_INTERVAL;
+
+        // A flush in progress is work of its own, so there is no waiting.
+        if (!device.flushing && due == steady_clock::time_point::max()) {
+            device.wake.wait(guard, hasWork);
+        }
+        else if (!device.flushing && !device.wake.wait_until(guard, due, hasWork)) {
+            guard.unlock();
+            runBackground(driver);
+            guard.lock();
+            device.flushing = driver.hasFlushInProgress();
+            device.flushQueuedAt = steady_clock::now();
+            continue;
+        }
+
+        Queued next;
+        bool sliceFlush;
+        if (!takeNext(device, next, sliceFlush) && !sliceFlush) {
+            guard.unlock();
+            driver.syncPending();
+            return;
+        }
+        device.busy = true;
+
+        guard.unlock();
+        if (sliceFlush) runFlushSlice(device);
+        else runQueued(device, next);
+        bool flushing = driver.hasFlushInProgress();
+        guard.lock();
+
+        device.busy = false;
+        device.flushing = flushing;
+        if (device.isIdle()) device.idle.notify_all();
+    }
+}
+
+void SSDHost::runQueued(Device& device, Queued& next) {
+    SSDDriver& driver = *device.driver;
+    string output;
+    if (next.completion) output = driver.execute(next.args);
+    else driver.run(next.args);
+
+    if (!driver.hasFlushInProgress() || device.flushing) {
+        if (next.completion) next.completion->complete(output);
+        return;
+    }
+    device.flushCompletion = next.completion;
+    device.flushOutput = output;
+    device.flushQueuedAt = next.queuedAt;
+}
+
+void SSDHost::runFlushSlice(Device& device) {
+    SSDDriver& driver = *device.driver;
+    if (!device.flushCompletion) {
+        driver.flushSlice();
+        return;
+    }
+
+    string output = driver.executeFlushSlice();
+    if (!output.empty()) device.flushOutput = output;
+    if (driver.hasFlushInProgress()) return;
+    exchange(device.flushCompletion, nullptr)->complete(device.flushOutput);
+}
+
+void SSDHost::runBackground(SSDDriver& driver) {
+    const DurabilityPolicy& durability = driver.getDurability();
+    const BackgroundFlushPolicy& backgroundFlush = driver.getBackgroundFlush();
+    if (!durability.hasPending() && !backgroundFlush.hasPending()) return driver.scrubStep();
+
+    steady_clock::time_point now = steady_clock::now();
+    if (backgroundFlush.hasPending() && backgroundFlush.dueAt() <= now) driver.flushInBackground();
+    if (durability.hasPending() && durability.pendingDeadline() <= now) driver.syncPending();
+}
\ No newline at end of file
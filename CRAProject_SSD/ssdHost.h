@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <coroutine>
+#include <filesystem>
+
+#include "ssdDriver.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// One command queued on an SSDHost device. It completes with what the
+// command wrote ("ERROR", a read value, "" for most writes), and can be
+// co_awaited. The awaiting coroutine resumes on the device's worker thread,
+// so it may queue more requests there but must not wait() on that device.
+class SSDRequest {
+public:
+    string wait();
+
+    bool isDone() const;
+
+    bool await_ready() const noexcept {
+        return isDone();
+    }
+
+    bool await_suspend(coroutine_handle<> waiter);
+
+    string await_resume() {
+        return wait();
+    }
+
+private:
+    struct State {
+        mutable mutex lock;
+        condition_variable done;
+        bool completed = false;
+        string result;
+        coroutine_handle<> waiter;
+
+        void complete(const string& output);
+    };
+
+    shared_ptr<State> state = make_shared<State>();
+
+    friend class SSDHost;
+};
+
+enum class IoSchedule {
+    Fifo,
+    Deadline,
+    WeightedFair,
+};
+
+// How each device orders its commands. Except under Fifo, a read that no
+// queued command could change goes to a separate read queue and may overtake
+// them, and flushes run in slices with reads served in between. Deadline
+// serves reads first until the oldest other command or flush has waited
+// writeDeadline; WeightedFair serves up to readWeight reads per other
+// command or flush slice.
+struct IoScheduler {
+    IoSchedule policy = IoSchedule::Fifo;
+    microseconds writeDeadline = microseconds(2000);
+    int readWeight = 4;
+};
+
+class SSDHost {
+public:
+    using DriverFactory = function<unique_ptr<SSDDriver>(int)>;
+
+    SSDHost(int deviceCount, DriverFactory factory, IoScheduler scheduler = IoScheduler());
+    SSDHost(const string& rootPath, int deviceCount);
+    ~SSDHost();
+
+    SSDHost(const SSDHost&) = delete;
+    SSDHost& operator=(const SSDHost&) = delete;
+
+    int deviceCount() const {
+        return (int)devices.size();
+    }
+
+    SSDDriver& device(int idx) {
+        return *devices[idx]->driver;
+    }
+
+    static constexpr milliseconds SCRUB_INTERVAL = milliseconds(5);
+
+    void submit(int idx, const vector<string>& args);
+
+    // Queues one command without a thread per request; any number can be in
+    // flight, and each device runs its commands in submission order apart
+    // from the reads its IoScheduler lets overtake.
+    SSDRequest request(int idx, const vector<string>& args);
+
+    SSDRequest write(int idx, int addr, const string& value) {
+        return request(idx, { "W", to_string(addr), value });
+    }
+
+    SSDRequest read(int idx, int addr) {
+        return request(idx, { "R", to_string(addr) });
+    }
+
+    SSDRequest erase(int idx, int addr, int size) {
+        return request(idx, { "E", to_string(addr), to_string(size) });
+    }
+
+    SSDRequest flush(int idx) {
+        return request(idx, { "F" });
+    }
+
+    void waitIdle();
+
+private:
+    struct Queued {
+        vector<string> args;
+        shared_ptr<SSDRequest::State> completion;
+        steady_clock::time_point queuedAt;
+    };
+
+    struct Device {
+        unique_ptr<SSDDriver> driver;
+        IoScheduler scheduler;
+        thread worker;
+        mutex lock;
+        condition_variable wake;
+        condition_variable idle;
+        deque<Queued> queue;
+        deque<Queued> reads;
+        bool busy = false;
+        bool flushing = false;
+        bool stopping = false;
+        int readStreak = 0;
+
+        // Owned by the worker: the request whose command started the flush
+        // in progress, what it has written so far, and when it was queued.
+        shared_ptr<SSDRequest::State> flushCompletion;
+        string flushOutput;
+        steady_clock::time_point flushQueuedAt;
+
+        bool isIdle() const {
+            return queue.empty() && reads.empty() && !busy && !flushing;
+        }
+    };
+
+    vector<unique_ptr<Device>> devices;
+
+    static void enqueue(Device& device, Queued queued);
+
+    // Whether queued could change what a read of addr returns; zones is the
+    // device's zone table, or null if it is not zoned.
+    static bool mayChange(const vector<string>& queued, int addr, const ZoneTable* zones);
+
+    // Picks the next read or other command by the device's policy; false
+    // with sliceFlush set when the flush in progress should go next instead.
+    static bool takeNext(Device& device, Queued& next, bool& sliceFlush);
+
+    static void workerLoop(Device& device);
+    static void runQueued(Device& device, Queued& next);
+    static void runFlushSlice(Device& device);
+
+    // Whatever background work is due: a buffer flush, a group commit sync,
+    // or a scrub step when nothing else is pending.
+    static void runBackground(SSDDriver& driver);
+};
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "gmock/gmock.h"
-#include "ssdDriver.cpp"
+#include "ssdDriver.h"
+#include "ssdHost.h"
+#include "powerLossHarness.h"
 
 using namespace testing;
 using namespace std;
@@ -11,12 +13,16 @@ protected:
 		srand(static_cast<unsigned int>(time(nullptr)));
 		overwriteTextToFile("ssd_nand.txt", "");
 		overwriteTextToFile("ssd_output.txt", "");
-		commandBufferManager.eraseAll();
+		remove("ssd_nand.txt.map");
+		ssdDriver->commandBufferManager.eraseAll();
+	}
+
+	void TearDown() override {
+		delete ssdDriver;
 	}
 public:
 	SSDContext ctx;
 	SSDDriver* ssdDriver;
-	CommandBufferManager& commandBufferManager = CommandBufferManager::getInstance();
 
 	vector<std::string> parseArguments(int argc, char* argv[]) {
 		return SSDDriver::parseArguments(argc, argv);
@@ -29,15 +35,15 @@ public:
 
 	string fastRead(vector<string> args, vector<vector<string>> buffer)
 	{
-		commandBufferManager.setBuffer(buffer);
-		return commandBufferManager.getCommand(args);
+		ssdDriver->commandBufferManager.setBuffer(buffer);
+		return ssdDriver->commandBufferManager.getCommand(args);
 	}
 
 	void mergeAlgorithm(vector<string> args, vector<vector<string>>& buffer) const
 	{
-		commandBufferManager.setBuffer(buffer);
-		commandBufferManager.mergeAlgorithm(args);
-		buffer = commandBufferManager.getBuffer();
+		ssdDriver->commandBufferManager.setBuffer(buffer);
+		ssdDriver->commandBufferManager.mergeAlgorithm(args);
+		buffer = ssdDriver->commandBufferManager.getBuffer();
 		return;
 	}
 
@@ -284,15 +290,7 @@ TEST_F(SddDriverTestFixture, EraseSuccessInManyPages)
 
 TEST_F(SddDriverTestFixture, TC1CommandBufferTest)
 {
-	// Delete All Files in Directory
-	path dirPath("./buffer");
-	for (const auto& entry : directory_iterator(dirPath)) {
-		if (entry.is_regular_file()) {
-			std::error_code ec;
-			remove(entry.path(), ec);
-			if (ec) ctx.handleError();
-		}
-	}
+	remove_all("./buffer");
 	const char* argv1[] = { "ssd.exe", "E", "9", "3" };
 	int argc1 = 4;
 
@@ -308,15 +306,10 @@ TEST_F(SddDriverTestFixture, TC1CommandBufferTest)
 
 	ssdDriver->run(argc3, const_cast<char**>(argv3));
 
-	// Read All Files in Directory
-	int correctFileNamesIdx = 0;
-	vector<string> correctFileNames = { "1_E_9_3", "2_W_10_0xAB12CD34", "3_W_13_0xE5E5E5E5", "4_empty", "5_empty" };
-	for (const auto& entry : directory_iterator(dirPath)) {
-		if (!entry.is_regular_file()) continue;
-
-		string fileName = entry.path().filename().string();
-		EXPECT_EQ(correctFileNames[correctFileNamesIdx++], fileName);
-	}
+	vector<vector<string>> persisted;
+	EXPECT_TRUE(DirectoryBufferStore("./buffer").load(persisted));
+	vector<vector<string>> expectedBuffer = { { "E", "9", "3" }, { "W", "10", "0xAB12CD34" }, { "W", "13", "0xE5E5E5E5" } };
+	EXPECT_EQ(expectedBuffer, persisted);
 }
 
 TEST_F(SddDriverTestFixture, FastReadExactErase)
@@ -808,7 +801,7 @@ TEST_F(SddDriverTestFixture, WriteWithValidHexButInvalidPattern)
 
 TEST_F(SddDriverTestFixture, WrongCommandExecution)
 {
-	const char* argv1[] = { "ssd.exe", "S" };
+	const char* argv1[] = { "ssd.exe", "X" };
 
 	ssdDriver->run(sizeof(argv1) / sizeof(argv1[0]), const_cast<char**>(argv1));
 
@@ -868,14 +861,1891 @@ TEST_F(SddDriverTestFixture, ForceToFlush)
 	ssdDriver->run(4, const_cast<char**>(argv4));
 	ssdDriver->run(4, const_cast<char**>(argv5));
 
-	// Read All Files in Directory
-	int correctFileNamesIdx = 0;
-	vector<string> correctFileNames = { "1_W_5_0x12345678", "2_empty", "3_empty", "4_empty", "5_empty" };
-	for (const auto& entry : directory_iterator("./buffer")) {
-		if (!entry.is_regular_file()) continue;
-		ASSERT_LT(correctFileNamesIdx, correctFileNames.size());
+	vector<vector<string>> persisted;
+	EXPECT_TRUE(DirectoryBufferStore("./buffer").load(persisted));
+	vector<vector<string>> expectedBuffer = { { "W", "5", "0x12345678" } };
+	EXPECT_EQ(expectedBuffer, persisted);
+}
+
+class InMemoryDeviceTestFixture : public Test {
+public:
+	shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	shared_ptr<MemoryBufferStore> bufferStore = make_shared<MemoryBufferStore>();
+	SSDContext ctx{ nand, output };
+	SSDDriver ssdDriver{ ctx, bufferStore };
+	CommandBufferManager& commandBufferManager = ssdDriver.commandBufferManager;
+
+	void run(vector<string> args)
+	{
+		vector<char*> argv = { const_cast<char*>("ssd.exe") };
+		for (string& arg : args) argv.push_back(&arg[0]);
+		ssdDriver.run((int)argv.size(), argv.data());
+	}
+
+	string readNand(int addr)
+	{
+		string value;
+		nand->read(addr, value);
+		return value;
+	}
+};
+
+TEST_F(InMemoryDeviceTestFixture, WriteAndReadThroughBuffer)
+{
+	run({ "W", "3", "0x1234ABCD" });
+	run({ "R", "3" });
+
+	EXPECT_EQ("0x1234ABCD", output->read());
+	EXPECT_EQ("0x00000000", readNand(3));
+}
+
+TEST_F(InMemoryDeviceTestFixture, FlushWritesToMemoryNand)
+{
+	run({ "W", "0", "0x12345678" });
+	run({ "E", "1", "2" });
+	run({ "F" });
+
+	EXPECT_EQ("0x12345678", readNand(0));
+	EXPECT_EQ("0x00000000", readNand(1));
+	EXPECT_TRUE(commandBufferManager.getBuffer().empty());
+}
+
+TEST_F(InMemoryDeviceTestFixture, ErrorGoesToMemorySink)
+{
+	run({ "R", "100" });
+
+	EXPECT_EQ("ERROR", output->read());
+}
+
+TEST_F(InMemoryDeviceTestFixture, ForcedFlushKeepsNewCommandBuffered)
+{
+	for (int i = 0; i <= 5; ++i) {
+		run({ "W", to_string(i), "0x0000000" + to_string(i) });
+	}
+
+	vector<vector<string>> expectedBuffer = { { "W", "5", "0x00000005" } };
+	EXPECT_EQ(expectedBuffer, commandBufferManager.getBuffer());
+
+	vector<vector<string>> persisted;
+	bufferStore->load(persisted);
+	EXPECT_EQ(expectedBuffer, persisted);
+
+	run({ "R", "5" });
+	EXPECT_EQ("0x00000005", output->read());
+	EXPECT_EQ("0x00000004", readNand(4));
+}
+
+TEST_F(InMemoryDeviceTestFixture, IndependentInstancesDoNotShareState)
+{
+	shared_ptr<MemoryNandStorage> otherNand = make_shared<MemoryNandStorage>();
+	shared_ptr<MemoryOutputSink> otherOutput = make_shared<MemoryOutputSink>();
+	SSDContext otherCtx{ otherNand, otherOutput };
+	SSDDriver otherDriver{ otherCtx, make_shared<MemoryBufferStore>() };
+
+	run({ "W", "7", "0xAAAAAAAA" });
+	run({ "F" });
+
+	const char* argv[] = { "ssd.exe", "R", "7" };
+	otherDriver.run(3, const_cast<char**>(argv));
+
+	EXPECT_EQ("0x00000000", otherOutput->read());
+	EXPECT_EQ("0xAAAAAAAA", readNand(7));
+}
+
+
+TEST_F(InMemoryDeviceTestFixture, RunWithParsedArguments)
+{
+	ssdDriver.run(vector<string>{ "W", "1" });
+	EXPECT_EQ("ERROR", output->read());
+
+	ssdDriver.run(vector<string>{ "R", "abc" });
+	EXPECT_EQ("ERROR", output->read());
+
+	ssdDriver.run(vector<string>{ "W", "1", "0x0000ABCD" });
+	ssdDriver.run(vector<string>{ "R", "1" });
+	EXPECT_EQ("0x0000ABCD", output->read());
+}
+
+TEST(SSDHostTest, DevicesRunIndependentlyOnTheirOwnThreads)
+{
+	const int deviceCount = 8;
+	vector<shared_ptr<MemoryOutputSink>> outputs;
+	for (int i = 0; i < deviceCount; ++i) outputs.push_back(make_shared<MemoryOutputSink>());
+
+	SSDHost host(deviceCount, [&outputs](int idx) {
+		SSDContext context(make_shared<MemoryNandStorage>(), outputs[idx]);
+		return make_unique<SSDDriver>(context, make_shared<MemoryBufferStore>());
+	});
+
+	for (int i = 0; i < deviceCount; ++i) {
+		for (int lba = 0; lba < 20; ++lba) {
+			host.submit(i, { "W", to_string(lba), "0x000000" + string(1, "0123456789ABCDEF"[i]) + "0" });
+		}
+		host.submit(i, { "R", "19" });
+	}
+	host.waitIdle();
+
+	for (int i = 0; i < deviceCount; ++i) {
+		EXPECT_EQ("0x000000" + string(1, "0123456789ABCDEF"[i]) + "0", outputs[i]->read());
+	}
+}
+
+struct DetachedTask {
+	struct promise_type {
+		DetachedTask get_return_object() { return {}; }
+		suspend_never initial_suspend() noexcept { return {}; }
+		suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { terminate(); }
+	};
+};
+
+DetachedTask writeThenRead(SSDHost& host, int idx, int addr, atomic<int>& matched)
+{
+	string value = Codec::formatValue(idx * 1000 + addr);
+	string written = co_await host.write(idx, addr, value);
+	string read = co_await host.read(idx, addr);
+	if (written.empty() && read == value) matched++;
+}
+
+TEST(SSDHostTest, AwaitedRequestsKeepManyCommandsInFlight)
+{
+	const int deviceCount = 4;
+	SSDHost host(deviceCount, [](int) {
+		SSDContext context(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+		return make_unique<SSDDriver>(context, make_shared<MemoryBufferStore>());
+	});
+
+	atomic<int> matched = 0;
+	for (int idx = 0; idx < deviceCount; ++idx) {
+		for (int addr = 0; addr < 100; ++addr) writeThenRead(host, idx, addr, matched);
+	}
+	host.waitIdle();
+	EXPECT_EQ(deviceCount * 100, matched.load());
+
+	EXPECT_EQ("", host.flush(0).wait());
+	EXPECT_EQ("0x00000007", host.read(0, 7).wait());
+	EXPECT_EQ("ERROR", host.erase(0, 95, 10).wait());
+}
+
+TEST(SSDHostTest, FileBackedDevicesUseSeparateDirectories)
+{
+	remove_all("./host_test");
+	{
+		SSDHost host("./host_test", 2);
+		host.submit(0, { "W", "0", "0x11111111" });
+		host.submit(0, { "F" });
+		host.submit(1, { "R", "0" });
+		host.waitIdle();
+	}
+
+	ifstream nand0("./host_test/device_0/ssd_nand.txt");
+	string nandData;
+	nand0 >> nandData;
+	EXPECT_EQ("0x11111111", nandData);
+
+	ifstream output1("./host_test/device_1/ssd_output.txt");
+	string outputData;
+	output1 >> outputData;
+	EXPECT_EQ("0x00000000", outputData);
+
+	nand0.close();
+	output1.close();
+	remove_all("./host_test");
+}
+
+TEST_F(InMemoryDeviceTestFixture, TraceRecordsEveryCommandAndReplays)
+{
+	const string traceFile = "trace_test.bin";
+	remove(traceFile);
+	ssdDriver.setTraceRecorder(make_shared<TraceRecorder>(traceFile));
+
+	vector<vector<string>> commands = {
+		{ "W", "3", "0x1234ABCD" },
+		{ "E", "0", "3" },
+		{ "R", "3" },
+		{ "F" },
+		{ "W", "05", "0xzz" },
+		{},
+	};
+	for (const vector<string>& args : commands) ssdDriver.run(args);
+	ssdDriver.setTraceRecorder(nullptr);
+
+	vector<TraceRecord> records;
+	ASSERT_TRUE(TraceReader::load(traceFile, records));
+	ASSERT_EQ(commands.size(), records.size());
+	for (size_t i = 0; i < commands.size(); ++i) {
+		EXPECT_EQ(commands[i], records[i].args);
+		if (i > 0) {
+			EXPECT_LE(records[i - 1].timestampNs, records[i].timestampNs);
+		}
+	}
+
+	SSDContext replayCtx(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	SSDDriver replayDriver(replayCtx, make_shared<MemoryBufferStore>());
+	ReplayReport report = TraceReplayer(records).replay(replayDriver, ReplayPacing::MaxSpeed);
+
+	EXPECT_EQ(commands.size(), report.commandCount);
+	EXPECT_LE(report.p50LatencyUs, report.maxLatencyUs);
+	string value;
+	replayCtx.nand->read(3, value);
+	EXPECT_EQ("0x1234ABCD", value);
+	remove(traceFile);
+}
+
+TEST(TraceTest, AppendedSessionsKeepIncreasingTimestamps)
+{
+	const string traceFile = "trace_sessions.bin";
+	remove(traceFile);
+	TraceRecorder(traceFile).record({ "R", "1" });
+	TraceRecorder(traceFile).record({ "R", "2" });
+
+	vector<TraceRecord> records;
+	ASSERT_TRUE(TraceReader::load(traceFile, records));
+	ASSERT_EQ(2, records.size());
+	EXPECT_EQ(vector<string>({ "R", "2" }), records[1].args);
+	EXPECT_LE(records[0].timestampNs, records[1].timestampNs);
+	remove(traceFile);
+}
+
+TEST(BufferCoalescerTest, FoldsErasesJoinedByThirdCommand)
+{
+	vector<vector<string>> buffer = {
+		{ "E", "0", "3" },
+		{ "E", "6", "3" },
+		{ "E", "3", "3" },
+	};
+
+	vector<vector<string>> expectedBuffer = { { "E", "0", "9" } };
+	EXPECT_EQ(expectedBuffer, BufferCoalescer::coalesce(buffer));
+}
+
+TEST(BufferCoalescerTest, FoldsWritesIntoSurroundingErase)
+{
+	vector<vector<string>> buffer = {
+		{ "E", "0", "2" },
+		{ "W", "2", "0x22222222" },
+		{ "E", "3", "2" },
+	};
+
+	vector<vector<string>> expectedBuffer = {
+		{ "E", "0", "5" },
+		{ "W", "2", "0x22222222" },
+	};
+	EXPECT_EQ(expectedBuffer, BufferCoalescer::coalesce(buffer));
+}
+
+TEST(BufferCoalescerTest, SplitsUnionIntoChunksOfTen)
+{
+	vector<vector<string>> buffer = {
+		{ "E", "0", "10" },
+		{ "E", "10", "10" },
+		{ "E", "20", "5" },
+	};
+
+	vector<vector<string>> expectedBuffer = {
+		{ "E", "0", "10" },
+		{ "E", "10", "10" },
+		{ "E", "20", "5" },
+	};
+	EXPECT_EQ(expectedBuffer, BufferCoalescer::coalesce(buffer));
+}
+
+TEST(BufferCoalescerTest, NeverErasesUntouchedLba)
+{
+	vector<vector<string>> buffer = {
+		{ "E", "0", "2" },
+		{ "E", "3", "2" },
+		{ "W", "0", "0x11111111" },
+	};
+
+	vector<vector<string>> expectedBuffer = {
+		{ "E", "1", "1" },
+		{ "E", "3", "2" },
+		{ "W", "0", "0x11111111" },
+	};
+	EXPECT_EQ(expectedBuffer, BufferCoalescer::coalesce(buffer));
+}
+
+TEST(BufferCoalescerTest, MatchesSequentialExecution)
+{
+	srand(29);
+	for (int round = 0; round < 200; ++round) {
+		vector<vector<string>> buffer;
+		for (int i = 0; i < 8; ++i) {
+			int addr = rand() % 30;
+			if (rand() % 2) buffer.push_back({ "W", to_string(addr), "0x0000000" + to_string(rand() % 10) });
+			else buffer.push_back({ "E", to_string(addr), to_string(1 + rand() % min(10, 30 - addr)) });
+		}
+
+		SSDContext sequentialCtx(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+		SSDContext coalescedCtx(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+		vector<vector<string>> coalesced = BufferCoalescer::coalesce(buffer);
+		FlushCommand(sequentialCtx, buffer).execute();
+		FlushCommand(coalescedCtx, coalesced).execute();
+
+		EXPECT_LE(coalesced.size(), buffer.size());
+		for (int addr = 0; addr < 30; ++addr) {
+			string expected, actual;
+			sequentialCtx.nand->read(addr, expected);
+			coalescedCtx.nand->read(addr, actual);
+			ASSERT_EQ(expected, actual);
+		}
+	}
+}
+
+TEST_F(InMemoryDeviceTestFixture, FullBufferAbsorbsCoalescibleCommandWithoutFlush)
+{
+	run({ "E", "0", "3" });
+	run({ "E", "6", "3" });
+	run({ "W", "20", "0x20202020" });
+	run({ "W", "21", "0x21212121" });
+	run({ "W", "22", "0x22222222" });
+	ASSERT_EQ(5, commandBufferManager.getBuffer().size());
+
+	run({ "E", "3", "3" });
+
+	vector<vector<string>> expectedBuffer = {
+		{ "E", "0", "9" },
+		{ "W", "20", "0x20202020" },
+		{ "W", "21", "0x21212121" },
+		{ "W", "22", "0x22222222" },
+	};
+	EXPECT_EQ(expectedBuffer, commandBufferManager.getBuffer());
+	EXPECT_TRUE(commandBufferManager.getFlushBuffer().empty());
+}
+
+class CountingNandStorage : public MemoryNandStorage {
+public:
+	int syncCount = 0;
+
+	bool sync() override {
+		syncCount++;
+		return true;
+	}
+};
+
+class DurabilityTestFixture : public Test {
+public:
+	shared_ptr<CountingNandStorage> nand = make_shared<CountingNandStorage>();
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	SSDDriver ssdDriver{ SSDContext(nand, output), make_shared<MemoryBufferStore>() };
+
+	void runWrites(int count)
+	{
+		for (int i = 0; i < count; ++i) {
+			ssdDriver.run(vector<string>{ "W", to_string(i % 50), "0x12345678" });
+		}
+	}
+};
+
+TEST_F(DurabilityTestFixture, NoneNeverSyncs)
+{
+	runWrites(12);
+	ssdDriver.run(vector<string>{ "F" });
+
+	EXPECT_EQ(0, nand->syncCount);
+}
+
+TEST_F(DurabilityTestFixture, SyncOnFlushSyncsOncePerFlush)
+{
+	ssdDriver.setDurability(DurabilityLevel::SyncOnFlush);
+	runWrites(12);
+	ssdDriver.run(vector<string>{ "R", "0" });
+	ssdDriver.run(vector<string>{ "F" });
+
+	EXPECT_EQ(3, nand->syncCount);
+}
+
+TEST_F(DurabilityTestFixture, SyncPerCommandSyncsEveryMutation)
+{
+	ssdDriver.setDurability(DurabilityLevel::SyncPerCommand);
+	runWrites(12);
+	ssdDriver.run(vector<string>{ "R", "0" });
+
+	EXPECT_EQ(12, nand->syncCount);
+}
+
+TEST_F(DurabilityTestFixture, GroupCommitBatchesWithinWindow)
+{
+	ssdDriver.setDurability(DurabilityLevel::GroupCommit, hours(1));
+	runWrites(12);
+
+	EXPECT_EQ(0, nand->syncCount);
+	EXPECT_TRUE(ssdDriver.getDurability().hasPending());
+
+	ssdDriver.syncPending();
+	EXPECT_EQ(1, nand->syncCount);
+	EXPECT_FALSE(ssdDriver.getDurability().hasPending());
+}
+
+TEST_F(DurabilityTestFixture, GroupCommitSyncsWhenWindowExpires)
+{
+	ssdDriver.setDurability(DurabilityLevel::GroupCommit, microseconds(0));
+	runWrites(3);
+
+	EXPECT_EQ(3, nand->syncCount);
+}
+
+TEST(SSDHostTest, GroupCommitSyncsIdleDevice)
+{
+	shared_ptr<CountingNandStorage> nand = make_shared<CountingNandStorage>();
+	SSDHost host(1, [&nand](int) {
+		unique_ptr<SSDDriver> driver = make_unique<SSDDriver>(
+			SSDContext(nand, make_shared<MemoryOutputSink>()), make_shared<MemoryBufferStore>());
+		driver->setDurability(DurabilityLevel::GroupCommit, milliseconds(5));
+		return driver;
+	});
+
+	for (int i = 0; i < 20; ++i) host.submit(0, { "W", to_string(i), "0x12345678" });
+	host.waitIdle();
+	this_thread::sleep_for(milliseconds(100));
+
+	EXPECT_GE(nand->syncCount, 1);
+	EXPECT_FALSE(host.device(0).getDurability().hasPending());
+}
+
+TEST_F(InMemoryDeviceTestFixture, DeallocateDropsBufferedWritesAndUnmaps)
+{
+	run({ "W", "10", "0x10101010" });
+	run({ "F" });
+	run({ "W", "11", "0x11111111" });
+	run({ "W", "60", "0x60606060" });
+
+	run({ "D", "0", "50" });
+
+	vector<vector<string>> expectedBuffer = { { "W", "60", "0x60606060" } };
+	EXPECT_EQ(expectedBuffer, commandBufferManager.getBuffer());
+	run({ "R", "10" });
+	EXPECT_EQ("0x00000000", output->read());
+	run({ "R", "11" });
+	EXPECT_EQ("0x00000000", output->read());
+}
+
+TEST_F(InMemoryDeviceTestFixture, DeallocateRejectsOutOfRange)
+{
+	run({ "D", "90", "20" });
+	EXPECT_EQ("ERROR", output->read());
+}
+
+TEST_F(SddDriverTestFixture, DeallocateSkipsDataWritesOnFileImage)
+{
+	WriteCommand(ctx, 0, "0x11111111").execute();
+	WriteCommand(ctx, 1, "0x22222222").execute();
+
+	DeallocateCommand(ctx, 0, 1).execute();
+
+	EXPECT_EQ("0x111111110x22222222", readFileAsString("ssd_nand.txt"));
+	ReadCommand(ctx, 0).execute();
+	EXPECT_EQ("0x00000000", readFileAsString("ssd_output.txt"));
+
+	SSDContext reopened;
+	ReadCommand(reopened, 0).execute();
+	EXPECT_EQ("0x00000000", readFileAsString("ssd_output.txt"));
+	ReadCommand(reopened, 1).execute();
+	EXPECT_EQ("0x22222222", readFileAsString("ssd_output.txt"));
+
+	WriteCommand(reopened, 0, "0x33333333").execute();
+	ReadCommand(reopened, 0).execute();
+	EXPECT_EQ("0x33333333", readFileAsString("ssd_output.txt"));
+	remove("ssd_nand.txt.map");
+}
+
+TEST_F(SddDriverTestFixture, EraseInDeallocateModeLeavesImageUntouched)
+{
+	WriteCommand(ctx, 0, "0x11111111").execute();
+	EXPECT_FALSE(SSDConfig::parseEraseMode("trim", ctx.eraseMode));
+	ASSERT_TRUE(SSDConfig::parseEraseMode("deallocate", ctx.eraseMode));
+
+	EraseCommand(ctx, 0, "1").execute();
+
+	EXPECT_EQ("0x11111111", readFileAsString("ssd_nand.txt"));
+	ReadCommand(ctx, 0).execute();
+	EXPECT_EQ("0x00000000", readFileAsString("ssd_output.txt"));
+	remove("ssd_nand.txt.map");
+}
+
+class CompressedImageTestFixture : public Test {
+protected:
+	void SetUp() override {
+		remove(imageFile);
+	}
+
+	void TearDown() override {
+		remove(imageFile);
+	}
+public:
+	const string imageFile = "compressed_nand.img";
+
+	string readLba(CompressedNandStorage& storage, int addr)
+	{
+		string value;
+		EXPECT_TRUE(storage.read(addr, value));
+		return value;
+	}
+};
+
+TEST_F(CompressedImageTestFixture, ValuesSurviveReopen)
+{
+	{
+		CompressedNandStorage storage(imageFile);
+		storage.write(0, "0x12345678");
+		storage.write(17, "0xCAFEBABE");
+		storage.write(99, "0x00000001");
+		storage.erase(0, 1);
+		EXPECT_TRUE(storage.commit());
+	}
+
+	CompressedNandStorage reopened(imageFile);
+	EXPECT_EQ("0x00000000", readLba(reopened, 0));
+	EXPECT_EQ("0xCAFEBABE", readLba(reopened, 17));
+	EXPECT_EQ("0x00000001", readLba(reopened, 99));
+	EXPECT_EQ("0x00000000", readLba(reopened, 50));
+	EXPECT_EQ(2, reopened.storedChunkCount());
+}
+
+TEST_F(CompressedImageTestFixture, ZeroChunksAreElided)
+{
+	CompressedNandStorage storage(imageFile);
+	storage.write(5, "0x55555555");
+	storage.commit();
+	uint64_t oneChunk = file_size(imageFile);
+
+	storage.erase(5, 1);
+	storage.commit();
+
+	EXPECT_EQ(0, storage.storedChunkCount());
+	EXPECT_LT(file_size(imageFile), 1000 * 10);
+	EXPECT_LE(file_size(imageFile), oneChunk + 16);
+}
+
+TEST_F(CompressedImageTestFixture, RepeatedPatternsCompress)
+{
+	CompressedNandStorage storage(imageFile);
+	for (int addr = 0; addr < 100; ++addr) storage.write(addr, "0xABABABAB");
+	storage.commit();
+
+	EXPECT_LT(file_size(imageFile), 100 * 10 / 4);
+}
+
+TEST_F(CompressedImageTestFixture, CommitRewritesOnlyDirtyChunks)
+{
+	CompressedNandStorage storage(imageFile);
+	for (int addr = 0; addr < 100; ++addr) storage.write(addr, "0x0000000" + to_string(addr % 10));
+	storage.commit();
+	uint64_t before = file_size(imageFile);
+
+	storage.write(3, "0xFFFFFFFF");
+	storage.commit();
+
+	uint64_t appended = file_size(imageFile) - before;
+	EXPECT_GT(appended, 0);
+	EXPECT_LE(appended, 1 + CompressedNandStorage::CHUNK_LBAS * 4);
+}
+
+TEST_F(CompressedImageTestFixture, GarbageIsCompacted)
+{
+	CompressedNandStorage storage(imageFile);
+	for (int round = 0; round < 500; ++round) {
+		for (int addr = 0; addr < 16; ++addr) storage.write(addr, "0x0000" + to_string(1000 + (round + addr) % 9000));
+		storage.commit();
+	}
+
+	EXPECT_LT(file_size(imageFile), 3 * 4096);
+	EXPECT_EQ("0x00001499", readLba(storage, 0));
+}
+
+TEST_F(CompressedImageTestFixture, DriverRunsOnCompressedImage)
+{
+	remove_all("./compressed_device");
+	create_directories("./compressed_device");
+	SSDConfig config = SSDConfig::inDirectory("./compressed_device");
+	config.imageFormat = ImageFormat::Compressed;
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "42", "0x42424242" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "R", "42" });
+	}
+
+	ifstream output(config.outputPath);
+	string value;
+	output >> value;
+	EXPECT_EQ("0x42424242", value);
+	output.close();
+	remove_all("./compressed_device");
+}
+
+// Creates a device in dirPath with SSD_IMAGE_FORMAT=format, then opens it
+// the way the CLI does without the variable, writes through it, and checks
+// both writes read back once the variable is set again.
+ImageFormat reopenWithoutImageFormat(const string& dirPath, const string& format)
+{
+	map<string, string> variables = { { "SSD_IMAGE_FORMAT", format } };
+	auto environment = [&variables](const char* name) { return variables[name]; };
+	remove_all(dirPath);
+	create_directories(dirPath);
+	{
+		SSDDriver ssdDriver(SSDConfig::fromEnvironment(dirPath, environment));
+		ssdDriver.run(vector<string>{ "W", "3", "0x12345678" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
 
-		string fileName = entry.path().filename().string();
-		EXPECT_EQ(correctFileNames[correctFileNamesIdx++], fileName);
+	variables.clear();
+	SSDConfig detected = SSDConfig::fromEnvironment(dirPath, environment);
+	{
+		SSDDriver ssdDriver(detected);
+		ssdDriver.run(vector<string>{ "W", "5", "0x11111111" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+
+	variables["SSD_IMAGE_FORMAT"] = format;
+	SSDConfig config = SSDConfig::fromEnvironment(dirPath, environment);
+	SSDDriver ssdDriver(config);
+	string value;
+	ssdDriver.run(vector<string>{ "R", "3" });
+	ifstream(config.outputPath) >> value;
+	EXPECT_EQ("0x12345678", value);
+	ssdDriver.run(vector<string>{ "R", "5" });
+	ifstream(config.outputPath) >> value;
+	EXPECT_EQ("0x11111111", value);
+	return detected.imageFormat;
+}
+
+TEST(CommandLineConfigTest, ExistingCompressedImageKeepsItsFormat)
+{
+	EXPECT_EQ(ImageFormat::Compressed, reopenWithoutImageFormat("./cli_device", "compressed"));
+	EXPECT_EQ(ImageFormat::Text, reopenWithoutImageFormat("./cli_device", ""));
+
+	auto compressed = [](const char* name) { return string(name) == "SSD_IMAGE_FORMAT" ? "compressed" : ""; };
+	EXPECT_EQ(ImageFormat::Text, SSDConfig::fromEnvironment("./cli_device", compressed).imageFormat);
+	remove_all("./cli_device");
+}
+
+TEST(CommandLineConfigTest, ExistingPagedImageKeepsItsFormat)
+{
+	EXPECT_EQ(ImageFormat::Paged, reopenWithoutImageFormat("./cli_device", "paged"));
+	remove_all("./cli_device");
+}
+
+TEST(CommandLineConfigTest, ExistingDedupImageKeepsItsFormat)
+{
+	EXPECT_EQ(ImageFormat::Dedup, reopenWithoutImageFormat("./cli_device", "dedup"));
+	remove_all("./cli_device");
+}
+
+TEST_F(InMemoryDeviceTestFixture, RollbackRestoresBufferAndNand)
+{
+	run({ "W", "1", "0x11111111" });
+	run({ "F" });
+	run({ "W", "2", "0x22222222" });
+	run({ "SNAP", "base" });
+
+	run({ "W", "1", "0xFFFFFFFF" });
+	run({ "E", "2", "1" });
+	run({ "F" });
+	run({ "ROLLBACK", "base" });
+
+	vector<vector<string>> expectedBuffer = { { "W", "2", "0x22222222" } };
+	EXPECT_EQ(expectedBuffer, commandBufferManager.getBuffer());
+	EXPECT_EQ("0x11111111", readNand(1));
+	run({ "R", "2" });
+	EXPECT_EQ("0x22222222", output->read());
+}
+
+TEST_F(InMemoryDeviceTestFixture, RollbackToUnknownSnapshotIsError)
+{
+	run({ "ROLLBACK", "missing" });
+	EXPECT_EQ("ERROR", output->read());
+
+	commandBufferManager.saveSnapshot("buffer-only");
+	run({ "W", "3", "0x33333333" });
+	run({ "ROLLBACK", "buffer-only" });
+	EXPECT_EQ("ERROR", output->read());
+	vector<vector<string>> expectedBuffer = { { "W", "3", "0x33333333" } };
+	EXPECT_EQ(expectedBuffer, commandBufferManager.getBuffer());
+
+	run({ "SNAP", "../escape" });
+	EXPECT_EQ("ERROR", output->read());
+}
+
+TEST(MemoryNandStorageTest, ForkIsIndependentOfOrigin)
+{
+	MemoryNandStorage origin;
+	origin.write(0, "0x00000001");
+	origin.write(40, "0x00000002");
+	origin.saveSnapshot("base");
+	shared_ptr<MemoryNandStorage> forked = origin.fork("base");
+
+	origin.write(0, "0x0000000A");
+	forked->write(40, "0x0000000B");
+
+	string value;
+	forked->read(0, value);
+	EXPECT_EQ("0x00000001", value);
+	origin.read(40, value);
+	EXPECT_EQ("0x00000002", value);
+	origin.loadSnapshot("base");
+	origin.read(0, value);
+	EXPECT_EQ("0x00000001", value);
+}
+
+TEST_F(CompressedImageTestFixture, SnapshotSurvivesCompactionAndReopen)
+{
+	{
+		CompressedNandStorage storage(imageFile);
+		for (int addr = 0; addr < 100; ++addr) storage.write(addr, "0x0000" + to_string(1000 + addr));
+		EXPECT_TRUE(storage.saveSnapshot("base"));
+		for (int round = 0; round < 500; ++round) {
+			for (int addr = 0; addr < 16; ++addr) storage.write(addr, "0x0000" + to_string(2000 + round % 9));
+			storage.commit();
+		}
+		EXPECT_LT(file_size(imageFile), 4 * 4096);
 	}
+
+	CompressedNandStorage reopened(imageFile);
+	EXPECT_EQ("0x00002004", readLba(reopened, 0));
+	EXPECT_TRUE(reopened.loadSnapshot("base"));
+	EXPECT_EQ("0x00001000", readLba(reopened, 0));
+	EXPECT_EQ("0x00001099", readLba(reopened, 99));
+}
+
+TEST_F(CompressedImageTestFixture, CloneHoldsOnlySnapshotChunks)
+{
+	const string cloneFile = "compressed_clone.img";
+	CompressedNandStorage storage(imageFile);
+	storage.write(3, "0x33333333");
+	EXPECT_TRUE(storage.saveSnapshot("base"));
+	for (int addr = 16; addr < 100; ++addr) storage.write(addr, "0x0000" + to_string(1000 + addr));
+	storage.commit();
+
+	EXPECT_TRUE(storage.cloneSnapshot("base", cloneFile));
+	{
+		CompressedNandStorage clone(cloneFile);
+		EXPECT_EQ("0x33333333", readLba(clone, 3));
+		EXPECT_EQ("0x00000000", readLba(clone, 50));
+		EXPECT_EQ(1, clone.storedChunkCount());
+		EXPECT_FALSE(clone.loadSnapshot("base"));
+	}
+	remove(cloneFile);
+}
+
+TEST_F(SddDriverTestFixture, CloneCreatesIndependentDevice)
+{
+	remove_all("./clone_device");
+	remove_all("./ssd_nand.txt.snapshots");
+	remove_all("./buffer.snapshots");
+
+	ssdDriver->run(vector<string>{ "W", "7", "0x77777777" });
+	ssdDriver->run(vector<string>{ "F" });
+	ssdDriver->run(vector<string>{ "W", "8", "0x88888888" });
+	ssdDriver->run(vector<string>{ "SNAP", "base" });
+	ssdDriver->run(vector<string>{ "CLONE", "base", "./clone_device" });
+	ssdDriver->run(vector<string>{ "W", "7", "0x00000001" });
+	ssdDriver->run(vector<string>{ "F" });
+
+	{
+		SSDDriver clone(SSDConfig::inDirectory("./clone_device"));
+		clone.run(vector<string>{ "R", "7" });
+		EXPECT_EQ("0x77777777", readFileAsString("./clone_device/ssd_output.txt"));
+		clone.run(vector<string>{ "R", "8" });
+		EXPECT_EQ("0x88888888", readFileAsString("./clone_device/ssd_output.txt"));
+	}
+
+	remove_all("./clone_device");
+	remove_all("./ssd_nand.txt.snapshots");
+	remove_all("./buffer.snapshots");
+}
+
+class PowerLossTestFixture : public Test {
+protected:
+	void TearDown() override {
+		FaultInjector::disarm();
+		remove_all(dirPath);
+	}
+public:
+	const string dirPath = "./power_loss";
+	PowerLossHarness harness{ dirPath };
+	vector<vector<string>> workload = {
+		{ "W", "1", "0x11111111" },
+		{ "W", "2", "0x22222222" },
+		{ "W", "3", "0x33333333" },
+		{ "F" },
+	};
+};
+
+TEST_F(PowerLossTestFixture, UnreachedPointLeavesDeviceConsistent)
+{
+	PowerLossReport report = harness.run(workload, FaultInjector::BUFFER_BEFORE_RENAME, 100);
+
+	EXPECT_FALSE(report.crashed);
+	EXPECT_TRUE(report.consistent);
+}
+
+TEST_F(PowerLossTestFixture, BufferSurvivesCrashBeforeManifestRename)
+{
+	PowerLossReport report = harness.run(workload, FaultInjector::BUFFER_BEFORE_RENAME, 2);
+
+	EXPECT_TRUE(report.crashed);
+	EXPECT_EQ(2, report.crashedCommand);
+	EXPECT_TRUE(report.consistent);
+}
+
+TEST_F(PowerLossTestFixture, BufferedWritesSurviveCrashMidFlush)
+{
+	PowerLossReport report = harness.run(workload, FaultInjector::FLUSH_BEFORE_COMMAND, 1);
+
+	EXPECT_TRUE(report.crashed);
+	EXPECT_EQ(3, report.crashedCommand);
+	EXPECT_TRUE(report.consistent);
+}
+
+TEST_F(PowerLossTestFixture, CompressedImageSurvivesCrashBeforeIndexSwitch)
+{
+	PowerLossHarness compressed(dirPath, ImageFormat::Compressed);
+	vector<vector<string>> twoFlushes = {
+		{ "W", "1", "0x11111111" },
+		{ "F" },
+		{ "W", "2", "0x22222222" },
+		{ "W", "17", "0x77777777" },
+		{ "F" },
+	};
+	PowerLossReport report = compressed.run(twoFlushes, FaultInjector::IMAGE_BEFORE_INDEX_SWITCH);
+
+	EXPECT_TRUE(report.crashed);
+	EXPECT_EQ(4, report.crashedCommand);
+	EXPECT_TRUE(report.consistent);
+}
+
+TEST(FaultInjectorTest, CutProcessLosesWhatStreamsStillBuffer)
+{
+	remove("power_cut.txt");
+	EXPECT_EXIT({
+		ofstream file("power_cut.txt");
+		file << "buffered";
+		FaultInjector::arm(FaultInjector::FLUSH_BEFORE_COMMAND, 0, true);
+		FaultInjector::hit(FaultInjector::FLUSH_BEFORE_COMMAND);
+	}, ExitedWithCode(FaultInjector::POWER_LOSS_EXIT_CODE), "");
+	EXPECT_EQ(0u, file_size("power_cut.txt"));
+	remove("power_cut.txt");
+}
+
+TEST(DirectoryBufferStoreTest, MigratesLegacyFileLayout)
+{
+	remove_all("./legacy_buffer");
+	create_directories("./legacy_buffer");
+	for (string fileName : { "2_W_10_0xAB12CD34", "1_E_9_3", "3_empty", "4_empty", "5_empty" }) {
+		ofstream(path("./legacy_buffer") / fileName);
+	}
+
+	vector<vector<string>> buffer;
+	EXPECT_TRUE(DirectoryBufferStore("./legacy_buffer").load(buffer));
+	vector<vector<string>> expectedBuffer = { { "E", "9", "3" }, { "W", "10", "0xAB12CD34" } };
+	EXPECT_EQ(expectedBuffer, buffer);
+	EXPECT_FALSE(exists("./legacy_buffer/1_E_9_3"));
+
+	buffer.clear();
+	EXPECT_TRUE(DirectoryBufferStore("./legacy_buffer").load(buffer));
+	EXPECT_EQ(expectedBuffer, buffer);
+	remove_all("./legacy_buffer");
+}
+
+TEST_F(PowerLossTestFixture, MeasuresRecoveryForEveryBufferDepth)
+{
+	vector<RecoveryTiming> timings = harness.measureRecovery(3);
+
+	ASSERT_EQ(12, timings.size());
+	for (const RecoveryTiming& timing : timings) EXPECT_GT(timing.recoveryUs, 0);
+	EXPECT_EQ(5, timings.back().bufferEntries);
+}
+
+TEST(DeviceScanTest, Crc32cMatchesKnownVectorAndCombines)
+{
+	const string text = "123456789";
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+
+	EXPECT_EQ(0xE3069283u, Crc32c::compute(bytes, text.size()));
+	EXPECT_EQ(0xE3069283u, Crc32c::combine(Crc32c::compute(bytes, 4), Crc32c::compute(bytes + 4, 5), 5));
+}
+
+TEST(DeviceScanTest, ChecksumDoesNotDependOnWorkerCount)
+{
+	const int lbaCount = 4 * DeviceScanner::MIN_WORKER_LBAS;
+	MemoryNandStorage nand(lbaCount);
+	for (int addr = 0; addr < lbaCount; addr += 7) nand.write(addr, Codec::formatValue(addr * 2654435761u));
+	vector<vector<string>> buffer = { { "W", "3", "0x12345678" }, { "E", "10", "4" } };
+
+	uint32_t single, parallel;
+	DeviceScanner singleScanner(lbaCount, 1);
+	DeviceScanner parallelScanner(lbaCount, 4);
+	ASSERT_TRUE(singleScanner.checksum(nand, buffer, single));
+	ASSERT_TRUE(parallelScanner.checksum(nand, buffer, parallel));
+
+	EXPECT_EQ(4, parallelScanner.getWorkerCount());
+	EXPECT_EQ(single, parallel);
+}
+
+TEST_F(InMemoryDeviceTestFixture, ChecksumIncludesBufferedWrites)
+{
+	run({ "W", "3", "0x12345678" });
+	run({ "E", "20", "5" });
+	run({ "CHECKSUM" });
+	string buffered = output->read();
+
+	run({ "F" });
+	run({ "CHECKSUM" });
+
+	EXPECT_EQ(buffered, output->read());
+	run({ "W", "3", "0x12345679" });
+	run({ "CHECKSUM" });
+	EXPECT_NE(buffered, output->read());
+}
+
+TEST_F(SddDriverTestFixture, CompareReportsDifferingLbas)
+{
+	remove_all("./compare_device");
+	{
+		SSDDriver other(SSDConfig::inDirectory("./compare_device"));
+		other.run(vector<string>{ "W", "5", "0x00000005" });
+		other.run(vector<string>{ "F" });
+		other.run(vector<string>{ "W", "9", "0x00000009" });
+	}
+
+	ssdDriver->run(vector<string>{ "W", "9", "0x00000009" });
+	ssdDriver->run(vector<string>{ "COMPARE", "./compare_device" });
+	EXPECT_EQ("MISMATCH 1 5", readFileAsString("ssd_output.txt"));
+
+	ssdDriver->run(vector<string>{ "W", "5", "0x00000005" });
+	ssdDriver->run(vector<string>{ "COMPARE", "./compare_device" });
+	EXPECT_EQ("MATCH", readFileAsString("ssd_output.txt"));
+
+	ssdDriver->run(vector<string>{ "COMPARE", "./missing_device" });
+	EXPECT_EQ("ERROR", readFileAsString("ssd_output.txt"));
+	remove_all("./compare_device");
+}
+
+class IntegrityTestFixture : public Test {
+public:
+	shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	unique_ptr<SSDDriver> ssdDriver;
+
+	void open(VerifyMode mode, int sampleRate = IntegrityStore::DEFAULT_SAMPLE_RATE)
+	{
+		SSDContext ctx(nand, output);
+		ctx.integrity = make_shared<IntegrityStore>(nand, "", 100, mode, sampleRate);
+		ssdDriver = make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	}
+
+	string run(vector<string> args)
+	{
+		ssdDriver->run(args);
+		return output->read();
+	}
+};
+
+TEST_F(IntegrityTestFixture, EveryReadReportsCorruptionDistinctly)
+{
+	open(VerifyMode::EveryRead);
+	run({ "W", "7", "0x12345678" });
+	run({ "E", "8", "2" });
+	run({ "F" });
+	EXPECT_EQ("0x12345678", run({ "R", "7" }));
+	EXPECT_EQ("0x00000000", run({ "R", "8" }));
+
+	nand->write(7, "0x12345679");
+	EXPECT_EQ("CORRUPT", run({ "R", "7" }));
+	EXPECT_EQ("ERROR", run({ "R", "100" }));
+
+	run({ "W", "7", "0x00000001" });
+	run({ "F" });
+	EXPECT_EQ("0x00000001", run({ "R", "7" }));
+}
+
+TEST_F(IntegrityTestFixture, SampledVerifiesOneReadInRate)
+{
+	open(VerifyMode::Sampled, 4);
+	run({ "W", "7", "0x12345678" });
+	run({ "F" });
+	nand->write(7, "0xDEADBEEF");
+
+	int corrupt = 0;
+	for (int i = 0; i < 8; ++i) {
+		if (run({ "R", "7" }) == "CORRUPT") corrupt++;
+	}
+	EXPECT_EQ(2, corrupt);
+}
+
+TEST_F(IntegrityTestFixture, ScrubFlagsCorruptLbasForLaterReads)
+{
+	open(VerifyMode::Scrub);
+	run({ "W", "7", "0x12345678" });
+	run({ "F" });
+	nand->write(7, "0xDEADBEEF");
+	nand->write(40, "0x00000040");
+
+	EXPECT_EQ("0xDEADBEEF", run({ "R", "7" }));
+	EXPECT_EQ("CORRUPT 2 7", run({ "SCRUB" }));
+	EXPECT_EQ("CORRUPT", run({ "R", "7" }));
+
+	run({ "W", "40", "0x00000041" });
+	run({ "F" });
+	EXPECT_EQ("CORRUPT 1 7", run({ "SCRUB" }));
+	EXPECT_EQ("0x00000041", run({ "R", "40" }));
+}
+
+TEST_F(SddDriverTestFixture, IntegrityCrcsPersistNextToTheImage)
+{
+	remove("ssd_nand.txt.crc");
+	SSDConfig config;
+	config.verifyMode = VerifyMode::EveryRead;
+	{
+		SSDDriver writer(config);
+		writer.run(vector<string>{ "W", "3", "0x00000003" });
+		writer.run(vector<string>{ "F" });
+	}
+	{
+		fstream image("ssd_nand.txt", ios::in | ios::out);
+		image.seekp(30);
+		image << "0x00000004";
+	}
+
+	SSDDriver reader(config);
+	reader.run(vector<string>{ "R", "3" });
+	EXPECT_EQ("CORRUPT", readFileAsString("ssd_output.txt"));
+	reader.run(vector<string>{ "R", "4" });
+	EXPECT_EQ("0x00000000", readFileAsString("ssd_output.txt"));
+	remove("ssd_nand.txt.crc");
+}
+
+TEST_F(SddDriverTestFixture, TornCrcFileLeavesIntegrityUnknown)
+{
+	remove("ssd_nand.txt.crc");
+	SSDConfig config;
+	config.verifyMode = VerifyMode::EveryRead;
+	{
+		SSDDriver writer(config);
+		writer.run(vector<string>{ "W", "3", "0x00000003" });
+		writer.run(vector<string>{ "F" });
+	}
+	resize_file("ssd_nand.txt.crc", 10);
+
+	SSDDriver reader(config);
+	reader.run(vector<string>{ "R", "3" });
+	EXPECT_EQ("CORRUPT", readFileAsString("ssd_output.txt"));
+	reader.run(vector<string>{ "W", "3", "0x00000004" });
+	reader.run(vector<string>{ "F" });
+	reader.run(vector<string>{ "R", "3" });
+	EXPECT_EQ("0x00000004", readFileAsString("ssd_output.txt"));
+	reader.run(vector<string>{ "R", "5" });
+	EXPECT_EQ("CORRUPT", readFileAsString("ssd_output.txt"));
+	remove("ssd_nand.txt.crc");
+}
+
+TEST_F(SddDriverTestFixture, UnverifiedRunsKeepExistingCrcsCurrent)
+{
+	remove("ssd_nand.txt.crc");
+	SSDConfig verified;
+	verified.verifyMode = VerifyMode::EveryRead;
+	SSDConfig unverified;
+	SSDDriver(verified).run(vector<string>{ "W", "3", "0x12345678" });
+	SSDDriver(verified).run(vector<string>{ "F" });
+	SSDDriver(unverified).run(vector<string>{ "W", "3", "0xAAAAAAAA" });
+	SSDDriver(unverified).run(vector<string>{ "F" });
+
+	SSDDriver(verified).run(vector<string>{ "R", "3" });
+	EXPECT_EQ("0xAAAAAAAA", readFileAsString("ssd_output.txt"));
+	remove("ssd_nand.txt.crc");
+}
+
+TEST(SSDHostTest, IdleDeviceScrubsInBackground)
+{
+	shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	shared_ptr<IntegrityStore> integrity = make_shared<IntegrityStore>(nand, "", 100, VerifyMode::Scrub);
+	integrity->record(99, 0x12345678);
+	SSDHost host(1, [&](int) {
+		SSDContext ctx(nand, output);
+		ctx.integrity = integrity;
+		return make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	});
+
+	string value;
+	for (int attempt = 0; attempt < 100 && value != "CORRUPT"; ++attempt) {
+		this_thread::sleep_for(milliseconds(10));
+		host.submit(0, { "R", "99" });
+		host.waitIdle();
+		value = output->read();
+	}
+	EXPECT_EQ("CORRUPT", value);
+}
+
+TEST(IoEngineTest, EnginesShareTheTextImageFormat)
+{
+	for (IoEngine ioEngine : { IoEngine::Mmap, IoEngine::Uring }) {
+		remove_all("./io_engine");
+		create_directories("./io_engine");
+		SSDConfig config = SSDConfig::inDirectory("./io_engine");
+		config.ioEngine = ioEngine;
+		{
+			SSDDriver ssdDriver(config);
+			for (int addr = 0; addr < 12; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr * 8), Codec::formatValue(addr + 1) });
+			ssdDriver.run(vector<string>{ "E", "8", "3" });
+			ssdDriver.run(vector<string>{ "F" });
+			ssdDriver.run(vector<string>{ "R", "16" });
+		}
+		string output;
+		ifstream(config.outputPath) >> output;
+		EXPECT_EQ("0x00000003", output);
+
+		FileNandStorage stream(config.nandPath);
+		string value;
+		stream.read(8, value);
+		EXPECT_EQ("0x00000000", value);
+		stream.read(88, value);
+		EXPECT_EQ("0x0000000C", value);
+		stream.read(89, value);
+		EXPECT_EQ("0x00000000", value);
+	}
+	remove_all("./io_engine");
+}
+
+TEST(IoEngineTest, UringKeepsManyWritesInFlightInOrder)
+{
+	const int lbaCount = 1000;
+	remove("uring_nand.txt");
+	UringNandStorage nand("uring_nand.txt", lbaCount);
+	for (int addr = 0; addr < lbaCount; ++addr) nand.write(addr, Codec::formatValue(addr));
+	for (int addr = 0; addr < lbaCount; addr += 3) nand.write(addr, "0xFFFFFFFF");
+	nand.erase(500, 10);
+	ASSERT_TRUE(nand.commit());
+
+	vector<uint32_t> values(lbaCount);
+	ASSERT_TRUE(nand.readRange(0, lbaCount, values.data()));
+	for (int addr = 0; addr < lbaCount; ++addr) {
+		uint32_t expected = (addr >= 500 && addr < 510) ? 0 : (addr % 3 == 0 ? 0xFFFFFFFF : addr);
+		EXPECT_EQ(expected, values[addr]) << addr;
+	}
+	remove("uring_nand.txt");
+}
+
+TEST(PagedNandStorageTest, FlushWritesEachDirtyPageOnce)
+{
+	const int lbaCount = 3000;
+	remove("paged_nand.img");
+	{
+		PagedNandStorage nand("paged_nand.img", lbaCount);
+		for (int addr = 0; addr < lbaCount; addr += 7) nand.write(addr, Codec::formatValue(addr + 1));
+		nand.erase(1024, 1024);
+		EXPECT_EQ(3, nand.dirtyPageCount());
+		ASSERT_TRUE(nand.commit());
+		EXPECT_EQ(0, nand.dirtyPageCount());
+	}
+	EXPECT_EQ(4 * PagedNandStorage::PAGE_SIZE, file_size("paged_nand.img"));
+	EXPECT_TRUE(PagedNandStorage::isImage("paged_nand.img"));
+
+	PagedNandStorage nand("paged_nand.img", lbaCount);
+	vector<uint32_t> values(lbaCount);
+	ASSERT_TRUE(nand.readRange(0, lbaCount, values.data()));
+	for (int addr = 0; addr < lbaCount; ++addr) {
+		uint32_t expected = (addr % 7 == 0 && (addr < 1024 || addr >= 2048)) ? addr + 1 : 0;
+		EXPECT_EQ(expected, values[addr]) << addr;
+	}
+	remove("paged_nand.img");
+}
+
+TEST(PagedNandStorageTest, RejectsImageOfAnotherGeometry)
+{
+	remove("paged_nand.img");
+	{
+		PagedNandStorage nand("paged_nand.img", 100);
+		nand.write(5, "0x12345678");
+		ASSERT_TRUE(nand.commit());
+	}
+
+	string value;
+	PagedNandStorage larger("paged_nand.img", 200);
+	EXPECT_FALSE(larger.read(5, value));
+	EXPECT_FALSE(larger.write(5, "0x00000001"));
+	PagedNandStorage same("paged_nand.img", 100);
+	EXPECT_TRUE(same.read(5, value));
+	EXPECT_EQ("0x12345678", value);
+	remove("paged_nand.img");
+}
+
+TEST(SddDriver, PagedImageIsDetectedAndKeepsSnapshots)
+{
+	remove_all("./paged");
+	create_directories("./paged");
+	SSDConfig config = SSDConfig::inDirectory("./paged");
+	config.imageFormat = ImageFormat::Paged;
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "5", "0x12345678" });
+		ssdDriver.run(vector<string>{ "F" });
+		ssdDriver.run(vector<string>{ "SNAP", "before" });
+		ssdDriver.run(vector<string>{ "W", "5", "0x0BADF00D" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+	SSDConfig detected = SSDConfig::detectInDirectory("./paged");
+	EXPECT_EQ(ImageFormat::Paged, detected.imageFormat);
+	{
+		SSDDriver ssdDriver(detected);
+		ssdDriver.run(vector<string>{ "R", "5" });
+		string output;
+		ifstream(detected.outputPath) >> output;
+		EXPECT_EQ("0x0BADF00D", output);
+
+		ssdDriver.run(vector<string>{ "ROLLBACK", "before" });
+		ssdDriver.run(vector<string>{ "R", "5" });
+		ifstream(detected.outputPath) >> output;
+		EXPECT_EQ("0x12345678", output);
+	}
+	remove_all("./paged");
+}
+
+TEST(HealthTest, ReportCountsHostCommands)
+{
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	SSDDriver ssdDriver{ SSDContext(make_shared<MemoryNandStorage>(), output), make_shared<MemoryBufferStore>() };
+	ssdDriver.run(vector<string>{ "W", "0", "0x11111111" });
+	ssdDriver.run(vector<string>{ "W", "0", "0x22222222" });
+	ssdDriver.run(vector<string>{ "R", "0" });
+	ssdDriver.run(vector<string>{ "E", "5", "2" });
+	ssdDriver.run(vector<string>{ "F" });
+	ssdDriver.run(vector<string>{ "R", "0" });
+	ssdDriver.run(vector<string>{ "R", "100" });
+	ssdDriver.run(vector<string>{ "S" });
+
+	string report = output->read();
+	EXPECT_THAT(report, StartsWith("reads=2 writes=3 flushes=1 fast_reads=1 merged=1 "));
+	EXPECT_THAT(report, HasSubstr(" errors=1 corrupt=0 used=1/100"));
+}
+
+TEST(HealthTest, CountersPersistWithoutRescanningTheImage)
+{
+	remove_all("./health");
+	create_directories("./health");
+	SSDConfig config = SSDConfig::inDirectory("./health");
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "3", "0x12345678" });
+		ssdDriver.run(vector<string>{ "W", "4", "0x12345678" });
+		ssdDriver.run(vector<string>{ "E", "4", "1" });
+		ssdDriver.run(vector<string>{ "F" });
+		ssdDriver.run(vector<string>{ "S" });
+	}
+	remove(config.nandPath);
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "S" });
+	}
+	string output;
+	getline(ifstream(config.outputPath), output);
+	EXPECT_THAT(output, StartsWith("reads=0 writes=3 flushes=1 "));
+	EXPECT_THAT(output, EndsWith(" used=1/100"));
+	remove_all("./health");
+}
+
+TEST(HealthTest, PowerCutWhileSavingKeepsTheLastCounters)
+{
+	remove_all("./health");
+	create_directories("./health");
+	SSDConfig config = SSDConfig::inDirectory("./health");
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "3", "0x12345678" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+	EXPECT_EXIT({
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "4", "0x12345678" });
+		FaultInjector::arm(FaultInjector::HEALTH_BEFORE_RENAME, 0, true);
+		ssdDriver.run(vector<string>{ "F" });
+	}, ExitedWithCode(FaultInjector::POWER_LOSS_EXIT_CODE), "");
+
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "S" });
+	}
+	string output;
+	getline(ifstream(config.outputPath), output);
+	EXPECT_THAT(output, StartsWith("reads=0 writes=1 flushes=1 "));
+	remove_all("./health");
+}
+
+unique_ptr<SSDDriver> makeBackgroundFlushDriver(microseconds idleDelay, microseconds maxAge)
+{
+	SSDContext ctx(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	unique_ptr<SSDDriver> driver = make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	driver->setBackgroundFlush(idleDelay, maxAge);
+	return driver;
+}
+
+TEST(SSDHostTest, IdleDeviceFlushesBufferInBackground)
+{
+	SSDHost host(1, [](int) { return makeBackgroundFlushDriver(milliseconds(2), microseconds(0)); });
+	host.write(0, 3, "0x12345678").wait();
+
+	string report;
+	for (int attempt = 0; attempt < 100 && report.find("flushes=1") == string::npos; ++attempt) {
+		this_thread::sleep_for(milliseconds(10));
+		report = host.request(0, { "S" }).wait();
+	}
+	EXPECT_THAT(report, HasSubstr("flushes=1 fast_reads=0"));
+	EXPECT_THAT(report, EndsWith("used=1/100"));
+}
+
+TEST(SSDHostTest, OldBufferedWritesFlushWhileCommandsKeepArriving)
+{
+	SSDHost host(1, [](int) { return makeBackgroundFlushDriver(seconds(10), milliseconds(5)); });
+	host.write(0, 3, "0x12345678").wait();
+
+	steady_clock::time_point start = steady_clock::now();
+	while (steady_clock::now() - start < milliseconds(30)) {
+		host.read(0, 3).wait();
+		this_thread::sleep_for(microseconds(200));
+	}
+	EXPECT_THAT(host.request(0, { "S" }).wait(), HasSubstr("flushes=1 "));
+}
+
+// Holds the first write until released, and records how many writes had
+// been applied when each LBA was last read.
+class GatedNandStorage : public MemoryNandStorage {
+public:
+	bool write(int addr, const string& value) override
+	{
+		unique_lock<mutex> guard(lock);
+		if (writes++ == 0) {
+			blocked = true;
+			changed.notify_all();
+			changed.wait(guard, [&]() { return released; });
+		}
+		return MemoryNandStorage::write(addr, value);
+	}
+
+	bool read(int addr, string& value) override
+	{
+		lock_guard<mutex> guard(lock);
+		writesAtRead[addr] = writes;
+		return MemoryNandStorage::read(addr, value);
+	}
+
+	void waitUntilBlocked()
+	{
+		unique_lock<mutex> guard(lock);
+		changed.wait(guard, [&]() { return blocked; });
+	}
+
+	void release()
+	{
+		lock_guard<mutex> guard(lock);
+		released = true;
+		changed.notify_all();
+	}
+
+	map<int, int> writesAtRead;
+
+private:
+	mutex lock;
+	condition_variable changed;
+	int writes = 0;
+	bool blocked = false;
+	bool released = false;
+};
+
+TEST(SSDHostTest, ReadsAreServedBetweenFlushSlices)
+{
+	shared_ptr<GatedNandStorage> nand = make_shared<GatedNandStorage>();
+	IoScheduler scheduler;
+	scheduler.policy = IoSchedule::WeightedFair;
+	SSDHost host(1, [&](int) {
+		SSDContext ctx(nand, make_shared<MemoryOutputSink>());
+		return make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	}, scheduler);
+
+	for (int addr = 0; addr < 5; ++addr) host.write(0, addr, Codec::formatValue(addr + 1));
+	SSDRequest flush = host.flush(0);
+	nand->waitUntilBlocked();
+	SSDRequest buffered = host.read(0, 3);
+	SSDRequest unbuffered = host.read(0, 50);
+	nand->release();
+
+	EXPECT_EQ("0x00000004", buffered.wait());
+	EXPECT_EQ("0x00000000", unbuffered.wait());
+	EXPECT_EQ("", flush.wait());
+	host.waitIdle();
+	EXPECT_LT(nand->writesAtRead[50], 5);
+	EXPECT_EQ("0x00000004", host.read(0, 3).wait());
+}
+
+TEST(SSDHostTest, ReadsNeverOvertakeAQueuedWriteToTheirLba)
+{
+	shared_ptr<GatedNandStorage> nand = make_shared<GatedNandStorage>();
+	IoScheduler scheduler;
+	scheduler.policy = IoSchedule::Deadline;
+	SSDHost host(1, [&](int) {
+		SSDContext ctx(nand, make_shared<MemoryOutputSink>());
+		return make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	}, scheduler);
+
+	host.write(0, 7, "0x11111111");
+	host.flush(0);
+	nand->waitUntilBlocked();
+	host.write(0, 7, "0x22222222");
+	SSDRequest read = host.read(0, 7);
+	nand->release();
+
+	EXPECT_EQ("0x22222222", read.wait());
+}
+
+TEST(SSDHostTest, ReadsNeverOvertakeAQueuedZoneAppendOrResetOfTheirZone)
+{
+	shared_ptr<GatedNandStorage> nand = make_shared<GatedNandStorage>();
+	IoScheduler scheduler;
+	scheduler.policy = IoSchedule::Deadline;
+	SSDHost host(1, [&](int) {
+		SSDContext ctx(nand, make_shared<MemoryOutputSink>());
+		ctx.zones = make_shared<ZoneTable>("", ZoneTable::DEFAULT_ZONE_SIZE);
+		return make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	}, scheduler);
+
+	host.request(0, { "ZAPPEND", "0", "0x11111111" });
+	host.flush(0);
+	nand->waitUntilBlocked();
+	host.request(0, { "ZAPPEND", "0", "0x22222222" });
+	SSDRequest appended = host.read(0, 1);
+	host.request(0, { "ZRESET", "0" });
+	SSDRequest reset = host.read(0, 0);
+	nand->release();
+
+	EXPECT_EQ("0x22222222", appended.wait());
+	EXPECT_EQ("0x00000000", reset.wait());
+}
+
+TEST(SSDHostTest, ReadsNeverOvertakeAQueuedImport)
+{
+	shared_ptr<GatedNandStorage> nand = make_shared<GatedNandStorage>();
+	IoScheduler scheduler;
+	scheduler.policy = IoSchedule::Deadline;
+	SSDHost host(1, [&](int) {
+		SSDContext ctx(nand, make_shared<MemoryOutputSink>());
+		return make_unique<SSDDriver>(ctx, make_shared<MemoryBufferStore>());
+	}, scheduler);
+	{
+		ofstream image("host_import.bin", ios::binary);
+		for (int addr = 0; addr < 100; ++addr) image.write("\x01\0\0\0", 4);
+	}
+
+	host.write(0, 0, "0x11111111");
+	host.flush(0);
+	nand->waitUntilBlocked();
+	host.request(0, { "IMPORT", "host_import.bin", "BIN" });
+	SSDRequest read = host.read(0, 42);
+	nand->release();
+
+	EXPECT_EQ("0x00000001", read.wait());
+	host.waitIdle();
+	remove("host_import.bin");
+}
+
+TEST(DeviceLockTest, ParallelRunsAgainstOneDirectoryLoseNoWrites)
+{
+	remove_all("./shared_device");
+	create_directories("./shared_device");
+	SSDConfig config = SSDConfig::inDirectory("./shared_device");
+
+	vector<thread> processes;
+	for (int process = 0; process < 4; ++process) {
+		processes.emplace_back([&config, process]() {
+			for (int addr = process; addr < 100; addr += 4) {
+				SSDDriver::runOnce(config, { "W", to_string(addr), Codec::formatValue(addr + 1) });
+				SSDDriver::runOnce(config, { "R", to_string(addr) });
+			}
+		});
+	}
+	for (thread& process : processes) process.join();
+	SSDDriver::runOnce(config, { "F" });
+
+	FileNandStorage nand(config.nandPath);
+	for (int addr = 0; addr < 100; ++addr) {
+		string value;
+		nand.read(addr, value);
+		EXPECT_EQ(Codec::formatValue(addr + 1), value) << addr;
+	}
+	SSDDriver::runOnce(config, { "S" });
+	string report;
+	getline(ifstream(config.outputPath), report);
+	EXPECT_THAT(report, StartsWith("reads=100 writes=100 "));
+	remove_all("./shared_device");
+}
+
+TEST(DeviceLockTest, SharedHoldersExcludeOnlyExclusiveOnes)
+{
+	remove("device.lock");
+	atomic<bool> exclusiveHeld = false;
+	thread writer;
+	{
+		DeviceLock first("device.lock", DeviceLock::Mode::Shared);
+		DeviceLock second("device.lock", DeviceLock::Mode::Shared);
+		EXPECT_TRUE(first.isHeld() && second.isHeld());
+
+		writer = thread([&]() {
+			DeviceLock exclusive("device.lock", DeviceLock::Mode::Exclusive);
+			exclusiveHeld = true;
+		});
+		this_thread::sleep_for(milliseconds(20));
+		EXPECT_FALSE(exclusiveHeld);
+	}
+	writer.join();
+	EXPECT_TRUE(exclusiveHeld);
+	remove("device.lock");
+}
+
+TEST(NamespaceTest, BurstInOneNamespaceLeavesAnotherBuffered)
+{
+	vector<SSDNamespace> layout;
+	ASSERT_TRUE(NamespaceLayout::parse("80,20:2", layout));
+	EXPECT_FALSE(NamespaceLayout::parse("80,30", layout));
+	EXPECT_FALSE(NamespaceLayout::parse("80:9", layout));
+
+	shared_ptr<MemoryNandStorage> nand = make_shared<MemoryNandStorage>();
+	shared_ptr<MemoryOutputSink> output = make_shared<MemoryOutputSink>();
+	SSDDriver ssdDriver{ SSDContext(nand, output), make_shared<MemoryBufferStore>(), layout };
+	ssdDriver.run(vector<string>{ "W", "90", "0x12345678" });
+	for (int addr = 0; addr < 12; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x00000001" });
+
+	string value;
+	nand->read(0, value);
+	EXPECT_EQ("0x00000001", value);
+	nand->read(90, value);
+	EXPECT_EQ("0x00000000", value);
+	EXPECT_EQ("0x12345678", ssdDriver.execute({ "R", "90" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "E", "78", "4" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "S", "2" }));
+	EXPECT_EQ("reads=1 writes=1 flushes=0 fast_reads=1 merged=0 flush_avg_us=0 flush_max_us=0 errors=0 corrupt=0 used=0/20",
+		ssdDriver.execute({ "S", "1" }));
+	EXPECT_THAT(ssdDriver.execute({ "S", "0" }), StartsWith("reads=0 writes=12 flushes=2 "));
+}
+
+TEST(NamespaceTest, LayoutAndBuffersPersistNextToTheImage)
+{
+	remove_all("./namespaces");
+	create_directories("./namespaces");
+	SSDConfig config = SSDConfig::inDirectory("./namespaces");
+	config.namespaces = { { 0, 50, 5 }, { 50, 50, 3 } };
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "60", "0x0000ABCD" });
+		ssdDriver.run(vector<string>{ "SNAP", "before" });
+	}
+	config.namespaces.clear();
+	{
+		SSDDriver ssdDriver(config);
+		EXPECT_EQ(2, (int)ssdDriver.getLayout().size());
+		EXPECT_EQ("0x0000ABCD", ssdDriver.execute({ "R", "60" }));
+		ssdDriver.run(vector<string>{ "F" });
+		ssdDriver.run(vector<string>{ "CLONE", "before", "./namespaces/clone" });
+		EXPECT_EQ("MATCH", ssdDriver.execute({ "COMPARE", "./namespaces/clone" }));
+		EXPECT_THAT(ssdDriver.execute({ "S", "1" }), StartsWith("reads=1 writes=1 flushes=1 "));
+		EXPECT_THAT(ssdDriver.execute({ "S", "1" }), EndsWith(" used=1/50"));
+	}
+	{
+		SSDDriver clone(SSDConfig::inDirectory("./namespaces/clone"));
+		EXPECT_EQ(2, (int)clone.getLayout().size());
+		EXPECT_EQ("0x0000ABCD", clone.execute({ "R", "60" }));
+	}
+	remove_all("./namespaces");
+}
+
+TEST(ZoneTest, WritesFollowTheWritePointerUntilReset)
+{
+	SSDContext ctx(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	ctx.zones = make_shared<ZoneTable>("", 10);
+	SSDDriver ssdDriver(ctx, make_shared<MemoryBufferStore>());
+	EXPECT_EQ("", ssdDriver.execute({ "W", "0", "0x00000001" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "W", "5", "0x00000005" }));
+	EXPECT_EQ("", ssdDriver.execute({ "W", "1", "0x00000002" }));
+	EXPECT_EQ("2", ssdDriver.execute({ "ZAPPEND", "0", "0x00000003" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "E", "0", "2" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "ZAPPEND", "10", "0x00000003" }));
+	EXPECT_THAT(ssdDriver.execute({ "ZREPORT" }), StartsWith("0:IOPEN:3 1:EMPTY:10 "));
+
+	EXPECT_EQ("", ssdDriver.execute({ "ZFINISH", "0" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "ZAPPEND", "0", "0x00000004" }));
+	EXPECT_EQ("0x00000003", ssdDriver.execute({ "R", "2" }));
+	EXPECT_EQ("", ssdDriver.execute({ "ZRESET", "0" }));
+	EXPECT_EQ("0x00000000", ssdDriver.execute({ "R", "2" }));
+	EXPECT_EQ("0", ssdDriver.execute({ "ZAPPEND", "0", "0x00000004" }));
+
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "ZCLOSE", "1" }));
+	EXPECT_EQ("", ssdDriver.execute({ "ZOPEN", "1" }));
+	EXPECT_EQ("", ssdDriver.execute({ "ZCLOSE", "1" }));
+	EXPECT_THAT(ssdDriver.execute({ "ZREPORT" }), StartsWith("0:IOPEN:1 1:EMPTY:10 "));
+}
+
+TEST(ZoneTest, ZonedImageAppendsAndPersistsTheZoneTable)
+{
+	remove_all("./zoned");
+	create_directories("./zoned");
+	SSDConfig config = SSDConfig::inDirectory("./zoned");
+	config.imageFormat = ImageFormat::Zoned;
+	{
+		SSDDriver ssdDriver(config);
+		for (int i = 0; i < 12; ++i) ssdDriver.run(vector<string>{ "ZAPPEND", to_string(i % 2), Codec::formatValue(i + 1) });
+		ssdDriver.run(vector<string>{ "F" });
+		ssdDriver.run(vector<string>{ "ZRESET", "1" });
+	}
+	EXPECT_TRUE(ZonedNandStorage::isImage(config.nandPath));
+
+	SSDDriver ssdDriver(SSDConfig::detectInDirectory("./zoned"));
+	EXPECT_THAT(ssdDriver.execute({ "ZREPORT" }), StartsWith("0:IOPEN:6 1:EMPTY:10 2:EMPTY:20 "));
+	EXPECT_EQ("0x0000000B", ssdDriver.execute({ "R", "5" }));
+	EXPECT_EQ("0x00000000", ssdDriver.execute({ "R", "10" }));
+	EXPECT_EQ("10", ssdDriver.execute({ "ZAPPEND", "1", "0x0000BEEF" }));
+	remove_all("./zoned");
+}
+
+TEST(ZonedNandStorageTest, ZonesAreLogsThatOnlyResetFromTheStart)
+{
+	remove("zoned_nand.bin");
+	{
+		ZonedNandStorage nand("zoned_nand.bin", 10);
+		EXPECT_TRUE(nand.write(0, "0x00000001"));
+		EXPECT_TRUE(nand.write(1, "0x00000002"));
+		EXPECT_FALSE(nand.write(3, "0x00000004"));
+		EXPECT_TRUE(nand.write(10, "0x0000000A"));
+		EXPECT_TRUE(nand.commit());
+		EXPECT_FALSE(nand.erase(1, 2));
+		EXPECT_TRUE(nand.erase(5, 5));
+	}
+	ZonedNandStorage nand("zoned_nand.bin", 10);
+	string value;
+	nand.read(1, value);
+	EXPECT_EQ("0x00000002", value);
+	EXPECT_EQ(2, nand.zoneLength(0));
+	EXPECT_TRUE(nand.erase(0, 10));
+	EXPECT_EQ(0, nand.zoneLength(0));
+	nand.read(1, value);
+	EXPECT_EQ("0x00000000", value);
+	EXPECT_TRUE(nand.write(0, "0x00000009"));
+	nand.read(10, value);
+	EXPECT_EQ("0x0000000A", value);
+	remove("zoned_nand.bin");
+}
+
+TEST(ZonedNandStorageTest, RefusedEraseResetsNoZone)
+{
+	remove("zoned_nand.bin");
+	{
+		ZonedNandStorage nand("zoned_nand.bin", 10);
+		nand.write(0, "0x00000001");
+		nand.write(10, "0x0000000A");
+		nand.write(11, "0x0000000B");
+
+		EXPECT_FALSE(nand.erase(0, 11));
+		EXPECT_EQ(1, nand.zoneLength(0));
+		EXPECT_EQ(2, nand.zoneLength(1));
+		string value;
+		nand.read(0, value);
+		EXPECT_EQ("0x00000001", value);
+	}
+	remove("zoned_nand.bin");
+}
+
+TEST(NandTimingTest, ProgramsOverlapAcrossDiesButShareTheChannel)
+{
+	NandTiming timing;
+	for (pair<int, int> geometry : { make_pair(1, 1), make_pair(1, 4), make_pair(2, 2) }) {
+		timing.channels = geometry.first;
+		timing.diesPerChannel = geometry.second;
+		NandTimingModel model(timing);
+		model.beginCommand();
+		for (int addr = 0; addr < 4; ++addr) model.program(addr);
+		model.endCommand();
+		int64_t expected = geometry.second == 1 ? 4 * 610 : (geometry.first == 1 ? 640 : 620);
+		EXPECT_EQ(expected, model.now().count());
+	}
+
+	EXPECT_TRUE(NandTiming::parse("tlc,channels=4,dies=2,xfer=5", timing));
+	EXPECT_EQ(1800, timing.programTime.count());
+	EXPECT_EQ(8, timing.dieCount());
+	EXPECT_FALSE(NandTiming::parse("qlc", timing));
+	EXPECT_FALSE(NandTiming::parse("channels=0", timing));
+}
+
+TEST(NandTimingTest, DriverChargesFlushedWritesAndReadsThatMissTheBuffer)
+{
+	SSDContext context(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	NandTiming timing;
+	timing.channels = 2;
+	timing.diesPerChannel = 2;
+	context.timing = make_shared<NandTimingModel>(timing);
+	SSDDriver ssdDriver(context, make_shared<MemoryBufferStore>());
+
+	for (int addr = 0; addr < 4; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr), "0x00000001" });
+	ssdDriver.run(vector<string>{ "R", "0" });
+	EXPECT_EQ(0, ssdDriver.getTimingModel()->now().count());
+	ssdDriver.run(vector<string>{ "F" });
+	ssdDriver.run(vector<string>{ "R", "50" });
+
+	EXPECT_EQ(620 + 60, ssdDriver.getTimingModel()->now().count());
+	EXPECT_THAT(ssdDriver.getTimingModel()->report(), HasSubstr("simulated commands=7 "));
+	EXPECT_THAT(ssdDriver.getTimingModel()->report(), HasSubstr(" max=620 reads=1 programs=4 erases=0"));
+
+	ssdDriver.run(vector<string>{ "D", "0", "8" });
+	EXPECT_EQ(620 + 60 + 3000, ssdDriver.getTimingModel()->now().count());
+	EXPECT_THAT(ssdDriver.getTimingModel()->report(), HasSubstr(" erases=4 "));
+}
+
+TEST(DedupNandStorageTest, PatternsShareSlotsAndSpillOnceTheDictionaryIsFull)
+{
+	remove("dedup_nand.bin");
+	{
+		DedupNandStorage nand("dedup_nand.bin", 100, 2);
+		for (int addr = 0; addr < 100; ++addr) EXPECT_TRUE(nand.write(addr, addr % 2 ? "0xAAAAAAAA" : "0x55555555"));
+		EXPECT_TRUE(nand.write(7, "0x12345678"));
+		EXPECT_TRUE(nand.commit());
+		EXPECT_EQ(2, nand.patternCount());
+		EXPECT_EQ(1, nand.spilledCount());
+		EXPECT_EQ(20u + 8 + 25 + 8, nand.imageBytes());
+
+		EXPECT_TRUE(nand.erase(1, 99));
+		EXPECT_TRUE(nand.write(3, "0x0000BEEF"));
+		EXPECT_TRUE(nand.commit());
+	}
+	EXPECT_TRUE(DedupNandStorage::isImage("dedup_nand.bin"));
+	EXPECT_EQ(20u + 8 + 25, file_size("dedup_nand.bin"));
+
+	DedupNandStorage nand("dedup_nand.bin", 100, 8);
+	string value;
+	nand.read(0, value);
+	EXPECT_EQ("0x55555555", value);
+	nand.read(3, value);
+	EXPECT_EQ("0x0000BEEF", value);
+	nand.read(7, value);
+	EXPECT_EQ("0x00000000", value);
+	EXPECT_EQ(0, nand.spilledCount());
+	EXPECT_THAT(nand.statistics(), StartsWith("patterns=2/2 spilled=0 dedup=1.00x image=53/400 "));
+	remove("dedup_nand.bin");
+}
+
+TEST(DedupNandStorageTest, DriverReportsDedupStatisticsAndFlushesOnlyChangedBlocks)
+{
+	remove_all("./dedup");
+	create_directories("./dedup");
+	SSDConfig config = SSDConfig::inDirectory("./dedup");
+	config.imageFormat = ImageFormat::Dedup;
+	{
+		SSDDriver ssdDriver(config);
+		for (int addr = 0; addr < 10; ++addr) ssdDriver.run(vector<string>{ "W", to_string(addr), "0xCAFEBABE" });
+		ssdDriver.run(vector<string>{ "F" });
+	}
+
+	SSDDriver ssdDriver(SSDConfig::detectInDirectory("./dedup"));
+	EXPECT_EQ("0xCAFEBABE", ssdDriver.execute({ "R", "9" }));
+	ssdDriver.run(vector<string>{ "W", "10", "0xCAFEBABE" });
+	ssdDriver.run(vector<string>{ "F" });
+	EXPECT_THAT(ssdDriver.execute({ "S" }), EndsWith(" patterns=1/14 spilled=0 dedup=11.00x image=126/400 committed=50"));
+	remove_all("./dedup");
+}
+
+TEST(ImageStreamTest, ExportFoldsInTheBufferAndImportReplacesTheDevice)
+{
+	SSDContext sourceContext(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	SSDDriver source(sourceContext, make_shared<MemoryBufferStore>());
+	source.run(vector<string>{ "W", "0", "0x00000001" });
+	source.run(vector<string>{ "W", "99", "0xCAFEBABE" });
+	source.run(vector<string>{ "F" });
+	source.run(vector<string>{ "W", "1", "0x0000BEEF" });
+	source.run(vector<string>{ "E", "99", "1" });
+
+	EXPECT_EQ("", source.execute({ "EXPORT", "image.txt" }));
+	EXPECT_EQ("", source.execute({ "EXPORT", "image.bin", "BIN" }));
+	EXPECT_EQ(1100u, file_size("image.txt"));
+	EXPECT_EQ(400u, file_size("image.bin"));
+	string lines;
+	{
+		ifstream image("image.txt");
+		lines.assign(istreambuf_iterator<char>(image), istreambuf_iterator<char>());
+	}
+	EXPECT_THAT(lines, StartsWith("0x00000001\n0x0000BEEF\n0x00000000\n"));
+	EXPECT_THAT(lines, EndsWith("0x00000000\n"));
+
+	for (string format : { "", "BIN" }) {
+		SSDContext targetContext(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+		SSDDriver target(targetContext, make_shared<MemoryBufferStore>());
+		target.run(vector<string>{ "W", "1", "0x12345678" });
+		vector<string> import = { "IMPORT", format.empty() ? "image.txt" : "image.bin" };
+		if (!format.empty()) import.push_back(format);
+
+		EXPECT_EQ("", target.execute(import));
+		EXPECT_TRUE(target.bufferedCommands().empty());
+		EXPECT_EQ("0x0000BEEF", target.execute({ "R", "1" }));
+		EXPECT_EQ(source.execute({ "CHECKSUM" }), target.execute({ "CHECKSUM" }));
+	}
+	remove("image.txt");
+	remove("image.bin");
+}
+
+TEST(ImageStreamTest, ImportRejectsShortAndMalformedStreams)
+{
+	SSDContext context(make_shared<MemoryNandStorage>(), make_shared<MemoryOutputSink>());
+	SSDDriver ssdDriver(context, make_shared<MemoryBufferStore>());
+	ofstream("short.bin", ios::binary) << string(396, '\x01');
+	ofstream("long.bin", ios::binary) << string(404, '\x01');
+	ofstream("lower.txt") << "0x0000beef\n";
+
+	ssdDriver.run(vector<string>{ "W", "1", "0x12345678" });
+
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "short.bin", "BIN" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "long.bin", "BIN" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "lower.txt" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "missing.bin" }));
+	EXPECT_EQ("ERROR", ssdDriver.execute({ "EXPORT", "image.bin", "HEX" }));
+	EXPECT_EQ("0x12345678", ssdDriver.execute({ "R", "1" }));
+	remove("short.bin");
+	remove("long.bin");
+	remove("lower.txt");
+}
+
+TEST(ImageStreamTest, TruncatedImportLeavesTheDeviceUnchanged)
+{
+	remove_all("./import_device");
+	create_directories("./import_device");
+	SSDConfig config = SSDConfig::inDirectory("./import_device");
+	config.imageFormat = ImageFormat::Dedup;
+	config.verifyMode = VerifyMode::EveryRead;
+	{
+		SSDDriver ssdDriver(config);
+		ssdDriver.run(vector<string>{ "W", "0", "0x0000AAAA" });
+		ssdDriver.run(vector<string>{ "F" });
+		ssdDriver.run(vector<string>{ "W", "1", "0x0000BBBB" });
+	}
+	{
+		ofstream truncated("truncated.txt");
+		ofstream trailing("trailing.txt");
+		for (int addr = 0; addr < 99; ++addr) truncated << "0x00000007\n";
+		for (int addr = 0; addr < 101; ++addr) trailing << "0x00000007\n";
+	}
+	{
+		SSDDriver ssdDriver(config);
+		EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "truncated.txt" }));
+		EXPECT_EQ("ERROR", ssdDriver.execute({ "IMPORT", "trailing.txt" }));
+	}
+
+	SSDDriver ssdDriver(config);
+	EXPECT_EQ("0x0000AAAA", ssdDriver.execute({ "R", "0" }));
+	EXPECT_EQ("0x0000BBBB", ssdDriver.execute({ "R", "1" }));
+	EXPECT_EQ("0x00000000", ssdDriver.execute({ "R", "2" }));
+	ssdDriver.run(vector<string>{ "F" });
+	EXPECT_EQ("0x0000BBBB", ssdDriver.execute({ "R", "1" }));
+	EXPECT_EQ("0x00000000", ssdDriver.execute({ "R", "2" }));
+	remove("truncated.txt");
+	remove("trailing.txt");
+	remove_all("./import_device");
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "trace.h"
+
+bool TraceFormat::isCanonicalNumber(const string& text) {
+    if (text.empty() || text.size() > 9) return false;
+    if (text.size() > 1 && text[0] == '0') return false;
+    return all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+TraceRecorder::TraceRecorder(const string& fileName) {
+    trace.open(fileName, ios::binary | ios::app);
+    trace.seekp(0, ios::end);
+    if (trace.tellp() == 0) {
+        trace.write(TraceFormat::MAGIC, 4);
+        trace.put((char)TraceFormat::VERSION);
+    }
+
+    string session(1, 'T');
+    uint64_t now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    Codec::putFixed(session, now, 8);
+    trace.write(session.data(), session.size());
+    last = steady_clock::now();
+}
+
+void TraceRecorder::record(const vector<string>& args) {
+    lock_guard<mutex> guard(lock);
+    steady_clock::time_point now = steady_clock::now();
+    uint64_t delta = duration_cast<nanoseconds>(now - last).count();
+    last = now;
+
+    string out;
+    encode(out, delta, args);
+    trace.write(out.data(), out.size());
+    trace.flush();
+}
+
+void TraceRecorder::encode(string& out, uint64_t delta, const vector<string>& args) {
+    string command = args.empty() ? "" : args[0];
+    if (command == "W" && args.size() == 3 &&
+        TraceFormat::isCanonicalNumber(args[1]) && Codec::isValue(args[2])) {
+        out.push_back('W');
+        Codec::putVarint(out, delta);
+        Codec::putVarint(out, stoul(args[1]));
+        Codec::putFixed(out, Codec::parseValue(args[2]), 4);
+    }
+    else if (command == "R" && args.size() == 2 && TraceFormat::isCanonicalNumber(args[1])) {
+        out.push_back('R');
+        Codec::putVarint(out, delta);
+        Codec::putVarint(out, stoul(args[1]));
+    }
+    else if (command == "E" && args.size() == 3 &&
+        TraceFormat::isCanonicalNumber(args[1]) && TraceFormat::isCanonicalNumber(args[2])) {
+        out.push_back('E');
+        Codec::putVarint(out, delta);
+        Codec::putVarint(out, stoul(args[1]));
+        Codec::putVarint(out, stoul(args[2]));
+    }
+    else if (command == "F" && args.size() == 1) {
+        out.push_back('F');
+        Codec::putVarint(out, delta);
+    }
+    else {
+        out.push_back('?');
+        Codec::putVarint(out, delta);
+        out.push_back((char)min<size_t>(args.size(), 255));
+        for (size_t i = 0; i < args.size() && i < 255; ++i) {
+            Codec::putVarint(out, args[i].size());
+            out += args[i];
+        }
+    }
+}
+
+bool TraceReader::load(const string& fileName, vector<TraceRecord>& records) {
+    ifstream trace(fileName, ios::binary);
+    if (!trace.is_open()) return false;
+
+    char magic[4];
+    trace.read(magic, 4);
+    if (trace.gcount() != 4 || !equal(magic, magic + 4, TraceFormat::MAGIC)) return false;
+    if (trace.get() != TraceFormat::VERSION) return false;
+
+    records.clear();
+    uint64_t origin = 0;
+    uint64_t current = 0;
+    bool started = false;
+    int op;
+    while ((op = trace.get()) != EOF) {
+        if (op == 'T') {
+            uint64_t absolute;
+            if (!Codec::getFixed(trace, absolute, 8)) return false;
+            if (!started) origin = absolute;
+            current = absolute > origin ? absolute - origin : current;
+            started = true;
+            continue;
+        }
+
+        uint64_t delta;
+        if (!Codec::getVarint(trace, delta)) return false;
+        current += delta;
+
+        TraceRecord record{ current, {} };
+        if (!decode((char)op, trace, record.args)) return false;
+        records.push_back(record);
+    }
+    return true;
+}
+
+bool TraceReader::decode(char op, istream& trace, vector<string>& args) {
+    uint64_t lba, size;
+    switch (op) {
+    case 'W': {
+        uint64_t value;
+        if (!Codec::getVarint(trace, lba) || !Codec::getFixed(trace, value, 4)) return false;
+        args = { "W", to_string(lba), Codec::formatValue((uint32_t)value) };
+        return true;
+    }
+    case 'R':
+        if (!Codec::getVarint(trace, lba)) return false;
+        args = { "R", to_string(lba) };
+        return true;
+    case 'E':
+        if (!Codec::getVarint(trace, lba) || !Codec::getVarint(trace, size)) return false;
+        args = { "E", to_string(lba), to_string(size) };
+        return true;
+    case 'F':
+        args = { "F" };
+        return true;
+    case '?': {
+        int argc = trace.get();
+        if (argc == EOF) return false;
+        for (int i = 0; i < argc; ++i) {
+            uint64_t length;
+            if (!Codec::getVarint(trace, length)) return false;
+            string arg(length, '\0');
+            trace.read(&arg[0], length);
+            if ((uint64_t)trace.gcount() != length) return false;
+            args.push_back(arg);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+string ReplayReport::toString() const {
+    stringstream ss;
+    ss << fixed << setprecision(2)
+        << "commands=" << commandCount
+        << " elapsed=" << elapsedSec << "s"
+        << " throughput=" << commandsPerSec << "ops/s"
+        << " latency(us) avg=" << avgLatencyUs
+        << " p50=" << p50LatencyUs
+        << " p99=" << p99LatencyUs
+        << " max=" << maxLatencyUs;
+    return ss.str();
+}
+
+ReplayReport TraceReplayer::summarize(vector<double>& latencies, double elapsed) {
+    ReplayReport report;
+    report.commandCount = latencies.size();
+    report.elapsedSec = elapsed;
+    if (latencies.empty()) return report;
+
+    sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies) total += latency;
+
+    report.commandsPerSec = elapsed > 0 ? latencies.size() / elapsed : 0;
+    report.avgLatencyUs = total / latencies.size();
+    report.p50LatencyUs = latencies[(latencies.size() - 1) * 50 / 100];
+    report.p99LatencyUs = latencies[(latencies.size() - 1) * 99 / 100];
+    report.maxLatencyUs = latencies.back();
+    return report;
+}
\ No newline at end of file
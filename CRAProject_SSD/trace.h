@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#include "codec.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Binary trace layout: "SSDT" + version byte, then a stream of records.
+// Every record starts with an opcode byte. 'T' carries an absolute
+// system_clock timestamp in nanoseconds and starts a recording session;
+// all other records start with a varint delta (ns) to the previous record.
+//   'W' varint lba, u32 value   'R' varint lba   'E' varint lba, varint size
+//   'F' (no payload)            '?' u8 argc, argc x (varint length, bytes)
+struct TraceRecord {
+    uint64_t timestampNs;
+    vector<string> args;
+};
+
+class TraceFormat {
+public:
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'T' };
+    static constexpr uint8_t VERSION = 1;
+
+    static bool isCanonicalNumber(const string& text);
+};
+
+class TraceRecorder {
+public:
+    explicit TraceRecorder(const string& fileName);
+
+    ~TraceRecorder() {
+        trace.flush();
+    }
+
+    bool isOpen() const {
+        return trace.is_open();
+    }
+
+    void record(const vector<string>& args);
+
+private:
+    ofstream trace;
+    mutex lock;
+    steady_clock::time_point last;
+
+    static void encode(string& out, uint64_t delta, const vector<string>& args);
+};
+
+class TraceReader {
+public:
+    // Timestamps are returned relative to the first recording session.
+    static bool load(const string& fileName, vector<TraceRecord>& records);
+
+private:
+    static bool decode(char op, istream& trace, vector<string>& args);
+};
+
+enum class ReplayPacing {
+    Original,
+    MaxSpeed,
+};
+
+struct ReplayReport {
+    size_t commandCount = 0;
+    double elapsedSec = 0;
+    double commandsPerSec = 0;
+    double avgLatencyUs = 0;
+    double p50LatencyUs = 0;
+    double p99LatencyUs = 0;
+    double maxLatencyUs = 0;
+
+    string toString() const;
+};
+
+class TraceReplayer {
+public:
+    explicit TraceReplayer(const vector<TraceRecord>& records)
+        : records(records) {
+    }
+
+    // Driver is any type with run(const vector<string>&), so every backend
+    // the driver can be built on is replayable.
+    template <typename Driver>
+    ReplayReport replay(Driver& driver, ReplayPacing pacing) const {
+        vector<double> latencies;
+        latencies.reserve(records.size());
+
+        steady_clock::time_point start = steady_clock::now();
+        for (const TraceRecord& record : records) {
+            if (pacing == ReplayPacing::Original) {
+                this_thread::sleep_until(start + nanoseconds(record.timestampNs));
+            }
+            steady_clock::time_point issued = steady_clock::now();
+            driver.run(record.args);
+            latencies.push_back(duration<double, micro>(steady_clock::now() - issued).count());
+        }
+        double elapsed = duration<double>(steady_clock::now() - start).count();
+
+        return summarize(latencies, elapsed);
+    }
+
+private:
+    vector<TraceRecord> records;
+
+    static ReplayReport summarize(vector<double>& latencies, double elapsed);
+};
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "uringNandStorage.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0) return;
+
+    sqEntries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+    auto mapRing = [&](size_t length, off_t offset) {
+        void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return mapped == MAP_FAILED ? nullptr : mapped;
+    };
+    sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+    if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr) {
+        release();
+        return;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+bool IoUring::registerBuffer(void* base, size_t length) {
+    iovec buffer = { base, length };
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &buffer, 1) != 0) return false;
+
+    bufferBase = static_cast<char*>(base);
+    bufferLength = length;
+    return true;
+}
+
+bool IoUring::registerFile(int fd) {
+    fileFd = fd;
+    fixedFile = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES, &fd, 1) == 0;
+    return fixedFile;
+}
+
+void IoUring::unregisterFile() {
+    if (fixedFile) syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_FILES, nullptr, 0);
+    fixedFile = false;
+    fileFd = -1;
+}
+
+bool IoUring::queue(bool write, uint64_t offset, char* data, uint32_t length, uint64_t userData) {
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return false;
+
+    unsigned index = tail & *sqMask;
+    io_uring_sqe& sqe = sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    bool fixedBuffer = bufferBase != nullptr && data >= bufferBase && data + length <= bufferBase + bufferLength;
+    if (write) sqe.opcode = fixedBuffer ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    else sqe.opcode = fixedBuffer ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.flags = fixedFile ? IOSQE_FIXED_FILE : 0;
+    sqe.fd = fixedFile ? 0 : fileFd;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = length;
+    sqe.buf_index = 0;
+    sqe.user_data = userData;
+    sqArray[index] = index;
+
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+    return true;
+}
+
+bool IoUring::submit(unsigned waitFor) {
+    while (true) {
+        unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, waitFor, flags, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        unsubmitted -= (unsigned)submitted;
+        if (unsubmitted == 0 || waitFor > 0) return true;
+    }
+}
+
+void IoUring::release() {
+    if (sqes != nullptr) munmap(sqes, sqesSize);
+    if (cqRing != nullptr && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != nullptr) munmap(sqRing, sqRingSize);
+    sqes = nullptr;
+    sqRing = cqRing = nullptr;
+    if (ringFd >= 0) close(ringFd);
+    ringFd = -1;
+}
+
+UringNandStorage::UringNandStorage(const string& fileName, int lbaCount)
+    : FileNandStorage(fileName, lbaCount), ring(QUEUE_DEPTH),
+      staging(QUEUE_DEPTH * (size_t)SLOT_BYTES), slots(QUEUE_DEPTH) {
+    for (int slot = QUEUE_DEPTH - 1; slot >= 0; slot--) freeSlots.push_back(slot);
+    if (ring.isOpen()) ring.registerBuffer(staging.data(), staging.size());
+}
+
+UringNandStorage::~UringNandStorage() {
+    if (!usesRing()) return;
+    drain();
+    closeFile();
+}
+
+bool UringNandStorage::read(int addr, string& value) {
+    if (!usesRing()) return FileNandStorage::read(addr, value);
+
+    uint32_t cell;
+    if (!readRange(addr, 1, &cell)) return false;
+    value = Codec::formatValue(cell);
+    return true;
+}
+
+bool UringNandStorage::write(int addr, const string& value) {
+    if (!usesRing()) return FileNandStorage::write(addr, value);
+    if (addr < 0 || addr >= lbaCount || value.size() != CELL_BYTES) return false;
+
+    if (!markAllocated(addr, 1) || !openFile()) return false;
+    return queueWrite(addr, value);
+}
+
+bool UringNandStorage::erase(int addr, int size) {
+    if (!usesRing()) return FileNandStorage::erase(addr, size);
+    if (addr < 0 || addr + size > lbaCount) return false;
+
+    if (!markAllocated(addr, size) || !openFile()) return false;
+    for (int offsetIdx = 0; offsetIdx < size; offsetIdx++) {
+        if (!queueWrite(addr + offsetIdx, "0x00000000")) return false;
+    }
+    return true;
+}
+
+bool UringNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (!usesRing()) return FileNandStorage::readRange(addr, count, values);
+    if (addr < 0 || addr + count > lbaCount) return false;
+
+    loadMap();
+    if (!openFile() || !drain()) return false;
+    readTarget = values;
+    readBase = addr;
+    for (int lba = addr; lba < addr + count; lba += READ_SPAN_LBAS) {
+        int slot;
+        if (!takeSlot(slot)) break;
+        slots[slot] = { lba, min(READ_SPAN_LBAS, addr + count - lba), false, false };
+        if (!queueSlot(slot, CELL_BYTES * slots[slot].count)) break;
+    }
+    bool readAll = drain();
+    readTarget = nullptr;
+    return readAll;
+}
+
+bool UringNandStorage::commit() {
+    if (!usesRing()) return FileNandStorage::commit();
+    return drain();
+}
+
+bool UringNandStorage::sync() {
+    if (usesRing() && !drain()) return false;
+    return FileNandStorage::sync();
+}
+
+bool UringNandStorage::saveSnapshot(const string& name) {
+    if (usesRing() && !drain()) return false;
+    return FileNandStorage::saveSnapshot(name);
+}
+
+bool UringNandStorage::loadSnapshot(const string& name) {
+    if (usesRing()) {
+        if (!drain()) return false;
+        closeFile();
+    }
+    return FileNandStorage::loadSnapshot(name);
+}
+
+bool UringNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    if (usesRing() && !drain()) return false;
+    return FileNandStorage::cloneSnapshot(name, targetPath);
+}
+
+bool UringNandStorage::usesRing() const {
+    return ring.isOpen();
+}
+
+bool UringNandStorage::openFile() {
+    if (fd >= 0) return true;
+
+    fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    ring.registerFile(fd);
+    return true;
+}
+
+void UringNandStorage::closeFile() {
+    if (fd < 0) return;
+    ring.unregisterFile();
+    close(fd);
+    fd = -1;
+}
+
+bool UringNandStorage::queueWrite(int addr, const string& value) {
+    auto pending = pendingWrites.find(addr);
+    if (pending != pendingWrites.end()) {
+        if (!slots[pending->second].submitted) {
+            memcpy(&staging[pending->second * (size_t)SLOT_BYTES], value.data(), CELL_BYTES);
+            return true;
+        }
+        while (pendingWrites.count(addr)) {
+            if (!waitOne()) return false;
+        }
+    }
+
+    int slot;
+    if (!takeSlot(slot)) return false;
+    memcpy(&staging[slot * (size_t)SLOT_BYTES], value.data(), CELL_BYTES);
+    slots[slot] = { addr, 1, true, false };
+    if (!queueSlot(slot, CELL_BYTES)) return false;
+    pendingWrites[addr] = slot;
+    return true;
+}
+
+bool UringNandStorage::queueSlot(int slot, uint32_t length) {
+    const Slot& queued = slots[slot];
+    char* data = &staging[slot * (size_t)SLOT_BYTES];
+    while (!ring.queue(queued.write, CELL_BYTES * (uint64_t)queued.addr, data, length, slot)) {
+        if (submitQueued()) continue;
+        slots[slot] = Slot();
+        freeSlots.push_back(slot);
+        failed = true;
+        return false;
+    }
+    queuedSlots.push_back(slot);
+    inFlight++;
+    return true;
+}
+
+bool UringNandStorage::takeSlot(int& slot) {
+    while (freeSlots.empty()) {
+        if (!waitOne()) return false;
+    }
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+    return true;
+}
+
+bool UringNandStorage::submitQueued() {
+    if (queuedSlots.empty()) return true;
+    if (!ring.submit(0)) return false;
+
+    for (int slot : queuedSlots) slots[slot].submitted = true;
+    queuedSlots.clear();
+    return true;
+}
+
+bool UringNandStorage::waitOne() {
+    if (!submitQueued() || !ring.submit(1)) {
+        failed = true;
+        return false;
+    }
+    ring.reap([this](uint64_t slot, int result) { complete((int)slot, result); });
+    return !failed;
+}
+
+bool UringNandStorage::drain() {
+    while (inFlight > 0 && waitOne()) {
+    }
+    bool succeeded = !failed && inFlight == 0;
+    failed = false;
+    return succeeded;
+}
+
+void UringNandStorage::complete(int slot, int result) {
+    Slot& done = slots[slot];
+    const char* data = &staging[slot * (size_t)SLOT_BYTES];
+    if (done.write) {
+        if (result != CELL_BYTES) failed = true;
+        auto pending = pendingWrites.find(done.addr);
+        if (pending != pendingWrites.end() && pending->second == slot) pendingWrites.erase(pending);
+    }
+    else if (result < 0 || readTarget == nullptr ||
+        !decodeCells(data, (size_t)result, done.addr, done.count, readTarget + (done.addr - readBase))) {
+        failed = true;
+    }
+    done = Slot();
+    freeSlots.push_back(slot);
+    inFlight--;
+}
+#else
+UringNandStorage::UringNandStorage(const string& fileName, int lbaCount)
+    : FileNandStorage(fileName, lbaCount) {
+}
+
+UringNandStorage::~UringNandStorage() = default;
+
+bool UringNandStorage::read(int addr, string& value) { return FileNandStorage::read(addr, value); }
+bool UringNandStorage::write(int addr, const string& value) { return FileNandStorage::write(addr, value); }
+bool UringNandStorage::erase(int addr, int size) { return FileNandStorage::erase(addr, size); }
+bool UringNandStorage::readRange(int addr, int count, uint32_t* values) { return FileNandStorage::readRange(addr, count, values); }
+bool UringNandStorage::commit() { return FileNandStorage::commit(); }
+bool UringNandStorage::sync() { return FileNandStorage::sync(); }
+bool UringNandStorage::saveSnapshot(const string& name) { return FileNandStorage::saveSnapshot(name); }
+bool UringNandStorage::loadSnapshot(const string& name) { return FileNandStorage::loadSnapshot(name); }
+bool UringNandStorage::cloneSnapshot(const string& name, const string& targetPath) { return FileNandStorage::cloneSnapshot(name, targetPath); }
+bool UringNandStorage::usesRing() const { return false; }
+#endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#endif
+
+using namespace std;
+
+#if defined(__linux__)
+// A single io_uring driven through the raw syscalls. One file and one
+// buffer can be registered, both at index 0.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool isOpen() const {
+        return ringFd >= 0;
+    }
+
+    bool registerBuffer(void* base, size_t length);
+    bool registerFile(int fd);
+    void unregisterFile();
+
+    // Queues a read or write of data, which must lie in the registered buffer
+    // if there is one. False when the submission queue is full.
+    bool queue(bool write, uint64_t offset, char* data, uint32_t length, uint64_t userData);
+
+    // Submits everything queued; with waitFor > 0, also waits until that many
+    // completions are ready.
+    bool submit(unsigned waitFor);
+
+    // Hands every ready completion to onComplete(userData, result) and
+    // returns how many there were.
+    template <typename Callback>
+    int reap(Callback onComplete) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        int reaped = 0;
+        for (; head != tail; head++, reaped++) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            onComplete(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return reaped;
+    }
+
+private:
+    int ringFd = -1;
+    int fileFd = -1;
+    bool fixedFile = false;
+    char* bufferBase = nullptr;
+    size_t bufferLength = 0;
+    unsigned unsubmitted = 0;
+
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned sqEntries = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void release();
+};
+#endif
+
+// The text image, with writes queued on an io_uring and submitted together
+// at commit(), so a flush keeps up to QUEUE_DEPTH writes in flight, and range
+// reads split into READ_SPAN_LBAS-sized reads that are all in flight at
+// once. Data moves through one registered staging buffer of QUEUE_DEPTH
+// slots against the registered image file. Queued writes to the same LBA are
+// merged in their slot; a write to an LBA whose write is already in flight
+// waits for it, since io_uring does not order requests. Falls back to
+// FileNandStorage where io_uring is unavailable.
+class UringNandStorage : public FileNandStorage {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 64;
+    static constexpr int READ_SPAN_LBAS = 256;
+
+    explicit UringNandStorage(const string& fileName, int lbaCount = 100);
+    ~UringNandStorage() override;
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+    bool erase(int addr, int size) override;
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool commit() override;
+    bool sync() override;
+    bool saveSnapshot(const string& name) override;
+    bool loadSnapshot(const string& name) override;
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+    bool usesRing() const;
+
+#if defined(__linux__)
+private:
+    static constexpr int SLOT_BYTES = CELL_BYTES * READ_SPAN_LBAS;
+
+    struct Slot {
+        int addr = -1;
+        int count = 0;
+        bool write = false;
+        bool submitted = false;
+    };
+
+    IoUring ring;
+    int fd = -1;
+    vector<char> staging;
+    vector<Slot> slots;
+    vector<int> freeSlots;
+    map<int, int> pendingWrites;
+    vector<int> queuedSlots;
+    int inFlight = 0;
+    bool failed = false;
+    uint32_t* readTarget = nullptr;
+    int readBase = 0;
+
+    bool openFile();
+    void closeFile();
+    bool queueWrite(int addr, const string& value);
+    bool takeSlot(int& slot);
+    bool queueSlot(int slot, uint32_t length);
+    bool submitQueued();
+    bool waitOne();
+    bool drain();
+    void complete(int slot, int result);
+#endif
+};
\ No newline at end of file
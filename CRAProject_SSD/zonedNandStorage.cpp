@@ -0,0 +1,215 @@
+#include "zonedNandStorage.h"
+
+#include <algorithm>
+
+ZonedNandStorage::ZonedNandStorage(const string& fileName, int zoneSize, int lbaCount)
+    : fileName(fileName), zoneSize(max(zoneSize, 1)), lbaCount(lbaCount) {
+}
+
+ZonedNandStorage::~ZonedNandStorage() {
+    commit();
+    close();
+}
+
+bool ZonedNandStorage::read(int addr, string& value) {
+    uint32_t data;
+    if (addr < 0 || addr >= lbaCount || !valueAt(addr, data)) return false;
+
+    value = Codec::formatValue(data);
+    return true;
+}
+
+bool ZonedNandStorage::write(int addr, const string& value) {
+    uint32_t parsed;
+    if (addr < 0 || addr >= lbaCount || !Codec::tryParseValue(value, parsed) || !load()) return false;
+
+    int zone = addr / zoneSize;
+    if (addr - zone * zoneSize != lengths[zone]) return false;
+
+    tails[zone].push_back(parsed);
+    lengths[zone]++;
+    dirty = true;
+    return true;
+}
+
+bool ZonedNandStorage::erase(int addr, int size) {
+    if (addr < 0 || size < 0 || addr + size > lbaCount || !load()) return false;
+
+    // Refuse the whole range before resetting any zone of it.
+    int end = addr + size;
+    for (int offset = addr; offset < end;) {
+        int zone = offset / zoneSize;
+        int first = offset - zone * zoneSize;
+        int last = min(end - zone * zoneSize, zoneSize);
+        if ((first > 0 || last < lengths[zone]) && first < lengths[zone]) return false;
+        offset += last - first;
+    }
+    for (int offset = addr; offset < end;) {
+        int zone = offset / zoneSize;
+        int first = offset - zone * zoneSize;
+        int last = min(end - zone * zoneSize, zoneSize);
+        if (first == 0 && last >= lengths[zone]) {
+            dirty = dirty || lengths[zone] > 0;
+            lengths[zone] = 0;
+            tails[zone].clear();
+        }
+        offset += last - first;
+    }
+    return true;
+}
+
+bool ZonedNandStorage::readRange(int addr, int count, uint32_t* values) {
+    if (addr < 0 || count < 0 || addr + count > lbaCount) return false;
+
+    for (int offset = 0; offset < count; offset++) {
+        if (!valueAt(addr + offset, values[offset])) return false;
+    }
+    return true;
+}
+
+bool ZonedNandStorage::commit() {
+    if (!dirty) return true;
+    if (!openImage()) return false;
+
+    for (int zone = 0; zone < zoneCount(); zone++) {
+        if (tails[zone].empty()) continue;
+
+        string encoded;
+        for (uint32_t value : tails[zone]) Codec::putFixed(encoded, value, 4);
+        int first = zone * zoneSize + lengths[zone] - (int)tails[zone].size();
+        image.clear();
+        image.seekp(headerSize() + 4 * (streamoff)first);
+        image.write(encoded.data(), encoded.size());
+        tails[zone].clear();
+    }
+
+    string header(MAGIC, 4);
+    Codec::putFixed(header, VERSION, 4);
+    Codec::putFixed(header, lbaCount, 4);
+    Codec::putFixed(header, zoneSize, 4);
+    for (int length : lengths) Codec::putFixed(header, length, 4);
+    image.clear();
+    image.seekp(0);
+    image.write(header.data(), header.size());
+    image.flush();
+    if (!image.good()) return false;
+
+    dirty = false;
+    return true;
+}
+
+bool ZonedNandStorage::sync() {
+    if (!commit()) return false;
+    return !exists(fileName) || syncFile(fileName);
+}
+
+bool ZonedNandStorage::saveSnapshot(const string& name) {
+    if (!commit()) return false;
+
+    error_code ec;
+    create_directories(snapshotDir(), ec);
+    if (ec) return false;
+    if (!exists(fileName)) return (bool)ofstream(snapshotDir() / name, ios::trunc);
+    copy_file(fileName, snapshotDir() / name, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool ZonedNandStorage::loadSnapshot(const string& name) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    close();
+    error_code ec;
+    copy_file(snapshotPath, fileName, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool ZonedNandStorage::removeSnapshot(const string& name) {
+    error_code ec;
+    return remove(snapshotDir() / name, ec) && !ec;
+}
+
+bool ZonedNandStorage::cloneSnapshot(const string& name, const string& targetPath) {
+    path snapshotPath = snapshotDir() / name;
+    if (!exists(snapshotPath)) return false;
+
+    error_code ec;
+    copy_file(snapshotPath, targetPath, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+int ZonedNandStorage::zoneLength(int zone) {
+    return load() && zone >= 0 && zone < zoneCount() ? lengths[zone] : 0;
+}
+
+bool ZonedNandStorage::isImage(const string& fileName) {
+    ifstream ifs(fileName, ios::binary);
+    char magic[4];
+    return ifs.read(magic, 4) && equal(magic, magic + 4, MAGIC);
+}
+
+bool ZonedNandStorage::load() {
+    if (loaded) return valid;
+
+    loaded = true;
+    lengths.assign(zoneCount(), 0);
+    tails.assign(zoneCount(), {});
+    ifstream ifs(fileName, ios::binary);
+    if (!ifs.is_open() || ifs.peek() == ifstream::traits_type::eof()) return valid = true;
+
+    string header(headerSize(), '\0');
+    if (!ifs.read(&header[0], header.size()) || header.compare(0, 4, MAGIC, 4) != 0) return valid = false;
+
+    size_t pos = 4;
+    uint64_t version, count, size;
+    Codec::getFixed(header, pos, version, 4);
+    Codec::getFixed(header, pos, count, 4);
+    Codec::getFixed(header, pos, size, 4);
+    if (version != VERSION || (int)count != lbaCount || (int)size != zoneSize) return valid = false;
+
+    for (int zone = 0; zone < zoneCount(); zone++) {
+        uint64_t length;
+        Codec::getFixed(header, pos, length, 4);
+        if ((int)length > min(zoneSize, lbaCount - zone * zoneSize)) return valid = false;
+        lengths[zone] = (int)length;
+    }
+    return valid = true;
+}
+
+void ZonedNandStorage::close() {
+    if (image.is_open()) image.close();
+    loaded = false;
+    dirty = false;
+}
+
+bool ZonedNandStorage::openImage() {
+    if (image.is_open()) return true;
+    if (!load()) return false;
+    if (!exists(fileName)) ofstream(fileName, ios::binary);
+
+    image.open(fileName, ios::in | ios::out | ios::binary);
+    return image.is_open();
+}
+
+bool ZonedNandStorage::valueAt(int addr, uint32_t& value) {
+    if (!load()) return false;
+
+    int zone = addr / zoneSize;
+    int offset = addr - zone * zoneSize;
+    int tailStart = lengths[zone] - (int)tails[zone].size();
+    if (offset >= lengths[zone]) value = 0;
+    else if (offset >= tailStart) value = tails[zone][offset - tailStart];
+    else {
+        if (!openImage()) return false;
+        string cell(4, '\0');
+        image.clear();
+        image.seekg(headerSize() + 4 * (streamoff)addr);
+        if (!image.read(&cell[0], 4)) return false;
+
+        size_t pos = 0;
+        uint64_t parsed;
+        Codec::getFixed(cell, pos, parsed, 4);
+        value = (uint32_t)parsed;
+    }
+    return true;
+}
\ No newline at end of file
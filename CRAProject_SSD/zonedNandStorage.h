@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+
+#include "nandStorage.h"
+
+using namespace std;
+using namespace std::filesystem;
+
+// Image for zoned devices, which only ever append to a zone or reset it:
+//   "SSDL", u32 version, u32 lbaCount, u32 zoneSize,
+//   then u32 written LBAs per zone, then u32 values at 4 * LBA
+// Each zone is a log: writes must land at its end and are kept in memory
+// until commit(), which appends every zone's new values with one write and
+// then rewrites the header. Erasing a zone from its start only sets its
+// length to zero and LBAs past a zone's length read as zero, so a value is
+// never rewritten until its zone has been reset.
+class ZonedNandStorage : public NandStorage {
+public:
+    ZonedNandStorage(const string& fileName, int zoneSize, int lbaCount = 100);
+    ~ZonedNandStorage() override;
+
+    bool read(int addr, string& value) override;
+    bool write(int addr, const string& value) override;
+
+    // Resets every zone the range covers from its start to its end of log;
+    // anything else fails unless it only covers unwritten LBAs.
+    bool erase(int addr, int size) override;
+
+    bool readRange(int addr, int count, uint32_t* values) override;
+    bool commit() override;
+    bool sync() override;
+
+    bool saveSnapshot(const string& name) override;
+    bool loadSnapshot(const string& name) override;
+    bool removeSnapshot(const string& name) override;
+    bool cloneSnapshot(const string& name, const string& targetPath) override;
+
+    // LBAs written to the zone so far, committed or not.
+    int zoneLength(int zone);
+
+    static bool isImage(const string& fileName);
+
+private:
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'L' };
+    static constexpr uint32_t VERSION = 1;
+
+    string fileName;
+    int zoneSize;
+    int lbaCount;
+    fstream image;
+    bool loaded = false;
+    bool valid = false;
+    bool dirty = false;
+    vector<int> lengths;
+    vector<vector<uint32_t>> tails;
+
+    path snapshotDir() const {
+        return path(fileName + ".snapshots");
+    }
+
+    int zoneCount() const {
+        return (lbaCount + zoneSize - 1) / zoneSize;
+    }
+
+    int headerSize() const {
+        return 16 + 4 * zoneCount();
+    }
+
+    bool load();
+    void close();
+    bool openImage();
+    bool valueAt(int addr, uint32_t& value);
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "zones.h"
+#include "codec.h"
+
+#include <fstream>
+#include <algorithm>
+
+ZoneTable::ZoneTable(const string& fileName, int zoneSize, int lbaCount)
+    : fileName(fileName), zoneSize(max(zoneSize, 1)), lbaCount(lbaCount),
+      zones((lbaCount + max(zoneSize, 1) - 1) / max(zoneSize, 1)) {
+    if (!fileName.empty()) load(fileName, zones);
+}
+
+int ZoneTable::zoneCapacity(int zone) const {
+    return min(zoneSize, lbaCount - zoneStart(zone));
+}
+
+bool ZoneTable::write(int addr) {
+    if (addr < 0 || addr >= lbaCount) return false;
+
+    int zone = zoneOf(addr);
+    if (zones[zone].state == ZoneState::Full || addr != writePointer(zone)) return false;
+
+    zones[zone].writePointer++;
+    if (zones[zone].writePointer == zoneCapacity(zone)) zones[zone].state = ZoneState::Full;
+    else if (zones[zone].state != ZoneState::ExplicitOpen) zones[zone].state = ZoneState::ImplicitOpen;
+    return save();
+}
+
+int ZoneTable::append(int zone) {
+    if (zone < 0 || zone >= getZoneCount()) return -1;
+
+    int addr = writePointer(zone);
+    return write(addr) ? addr : -1;
+}
+
+bool ZoneTable::open(int zone) {
+    if (zone < 0 || zone >= getZoneCount() || zones[zone].state == ZoneState::Full) return false;
+
+    zones[zone].state = ZoneState::ExplicitOpen;
+    return save();
+}
+
+bool ZoneTable::close(int zone) {
+    if (zone < 0 || zone >= getZoneCount()) return false;
+    if (zones[zone].state == ZoneState::Closed) return true;
+    if (!isOpen(zone)) return false;
+
+    zones[zone].state = zones[zone].writePointer == 0 ? ZoneState::Empty : ZoneState::Closed;
+    return save();
+}
+
+bool ZoneTable::finish(int zone) {
+    if (zone < 0 || zone >= getZoneCount()) return false;
+
+    zones[zone] = { ZoneState::Full, zoneCapacity(zone) };
+    return save();
+}
+
+bool ZoneTable::reset(int zone) {
+    if (zone < 0 || zone >= getZoneCount()) return false;
+
+    zones[zone] = Zone();
+    return save();
+}
+
+string ZoneTable::report() const {
+    string text;
+    for (int zone = 0; zone < getZoneCount(); zone++) {
+        if (!text.empty()) text += " ";
+        text += to_string(zone) + ":" + toString(zones[zone].state) + ":" + to_string(writePointer(zone));
+    }
+    return text;
+}
+
+bool ZoneTable::saveSnapshot(const string& name) {
+    if (fileName.empty()) {
+        memorySnapshots[name] = zones;
+        return true;
+    }
+
+    error_code ec;
+    create_directories(snapshotDir(), ec);
+    if (ec) return false;
+    ofstream ofs(snapshotDir() / name, ios::binary | ios::trunc);
+    string encoded = encode(zones);
+    ofs.write(encoded.data(), encoded.size());
+    return ofs.good();
+}
+
+bool ZoneTable::hasSnapshot(const string& name) const {
+    vector<Zone> restored;
+    if (fileName.empty()) return memorySnapshots.count(name) > 0;
+    return load((snapshotDir() / name).string(), restored);
+}
+
+bool ZoneTable::loadSnapshot(const string& name) {
+    vector<Zone> restored;
+    if (fileName.empty()) {
+        auto snapshot = memorySnapshots.find(name);
+        if (snapshot == memorySnapshots.end()) return false;
+        restored = snapshot->second;
+    }
+    else if (!load((snapshotDir() / name).string(), restored)) {
+        return false;
+    }
+
+    zones = restored;
+    return save();
+}
+
+bool ZoneTable::cloneSnapshot(const string& name, const string& targetPath) {
+    if (fileName.empty()) return false;
+
+    error_code ec;
+    copy_file(snapshotDir() / name, targetPath, copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool ZoneTable::readZoneSize(const string& fileName, int& zoneSize) {
+    ifstream ifs(fileName, ios::binary);
+    string header(HEADER_SIZE, '\0');
+    if (!ifs.read(&header[0], HEADER_SIZE) || header.compare(0, 4, MAGIC, 4) != 0) return false;
+
+    size_t pos = 8;
+    uint64_t size;
+    if (!Codec::getFixed(header, pos, size, 4) || size == 0) return false;
+    zoneSize = (int)size;
+    return true;
+}
+
+string ZoneTable::toString(ZoneState state) {
+    switch (state) {
+    case ZoneState::ImplicitOpen: return "IOPEN";
+    case ZoneState::ExplicitOpen: return "EOPEN";
+    case ZoneState::Closed: return "CLOSED";
+    case ZoneState::Full: return "FULL";
+    default: return "EMPTY";
+    }
+}
+
+string ZoneTable::encode(const vector<Zone>& table) const {
+    string encoded(MAGIC, 4);
+    Codec::putFixed(encoded, VERSION, 4);
+    Codec::putFixed(encoded, zoneSize, 4);
+    Codec::putFixed(encoded, table.size(), 4);
+    for (const Zone& zone : table) {
+        encoded.push_back((char)zone.state);
+        Codec::putFixed(encoded, zone.writePointer, 4);
+    }
+    return encoded;
+}
+
+bool ZoneTable::decode(const string& encoded, vector<Zone>& table) const {
+    if (encoded.size() != HEADER_SIZE + zones.size() * ZONE_ENTRY_SIZE || encoded.compare(0, 4, MAGIC, 4) != 0) return false;
+
+    size_t pos = 4;
+    uint64_t version, size, count;
+    Codec::getFixed(encoded, pos, version, 4);
+    Codec::getFixed(encoded, pos, size, 4);
+    Codec::getFixed(encoded, pos, count, 4);
+    if (version != VERSION || (int)size != zoneSize || count != zones.size()) return false;
+
+    vector<Zone> decoded(count);
+    for (int zone = 0; zone < (int)count; zone++) {
+        uint64_t writePointer;
+        uint8_t state = (uint8_t)encoded[pos++];
+        Codec::getFixed(encoded, pos, writePointer, 4);
+        if (state > (uint8_t)ZoneState::Full || (int)writePointer > zoneCapacity(zone)) return false;
+        decoded[zone] = { (ZoneState)state, (int)writePointer };
+    }
+    table = decoded;
+    return true;
+}
+
+bool ZoneTable::save() {
+    if (fileName.empty()) return true;
+
+    ofstream ofs(fileName, ios::binary | ios::trunc);
+    string encoded = encode(zones);
+    ofs.write(encoded.data(), encoded.size());
+    return ofs.good();
+}
+
+bool ZoneTable::load(const string& from, vector<Zone>& table) const {
+    ifstream ifs(from, ios::binary);
+    if (!ifs.is_open()) return false;
+
+    string encoded((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    return decode(encoded, table);
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <cstdint>
+
+using namespace std;
+using namespace std::filesystem;
+
+enum class ZoneState : uint8_t {
+    Empty,
+    ImplicitOpen,
+    ExplicitOpen,
+    Closed,
+    Full,
+};
+
+// Zoned mode: the LBAs are split into sequential-write-required zones of
+// zoneSize LBAs (the last one may be shorter). A zone is only written at its
+// write pointer, which W, ZAPPEND and ZFINISH move forward and only ZRESET
+// moves back. The pointers count buffered writes, so the table is ahead of
+// the image until the buffer is flushed.
+//
+// The table is kept in "<image>.zones":
+//   "SSDZ", u32 version, u32 zoneSize, u32 zoneCount, then per zone
+//   { u8 state, u32 write pointer relative to the zone start }
+// or only in memory when fileName is empty.
+class ZoneTable {
+public:
+    static constexpr int DEFAULT_ZONE_SIZE = 10;
+
+    ZoneTable(const string& fileName, int zoneSize, int lbaCount = 100);
+
+    int getZoneSize() const {
+        return zoneSize;
+    }
+
+    int getZoneCount() const {
+        return (int)zones.size();
+    }
+
+    int zoneOf(int addr) const {
+        return addr / zoneSize;
+    }
+
+    int zoneStart(int zone) const {
+        return zone * zoneSize;
+    }
+
+    int zoneCapacity(int zone) const;
+
+    // The next LBA the zone accepts; past the zone once it is full.
+    int writePointer(int zone) const {
+        return zoneStart(zone) + zones[zone].writePointer;
+    }
+
+    ZoneState getState(int zone) const {
+        return zones[zone].state;
+    }
+
+    // A write to addr, accepted only at its zone's write pointer.
+    bool write(int addr);
+
+    // Where an append to the zone lands, or -1 if the zone is full.
+    int append(int zone);
+
+    bool open(int zone);
+    bool close(int zone);
+    bool finish(int zone);
+    bool reset(int zone);
+
+    // "<zone>:<state>:<write pointer>" per zone, separated by spaces.
+    string report() const;
+
+    bool saveSnapshot(const string& name);
+    bool hasSnapshot(const string& name) const;
+    bool loadSnapshot(const string& name);
+    bool cloneSnapshot(const string& name, const string& targetPath);
+
+    // The zone size a saved table was created with.
+    static bool readZoneSize(const string& fileName, int& zoneSize);
+
+    static string toString(ZoneState state);
+
+private:
+    struct Zone {
+        ZoneState state = ZoneState::Empty;
+        int writePointer = 0;
+    };
+
+    static constexpr char MAGIC[4] = { 'S', 'S', 'D', 'Z' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int HEADER_SIZE = 16;
+    static constexpr int ZONE_ENTRY_SIZE = 5;
+
+    string fileName;
+    int zoneSize;
+    int lbaCount;
+    vector<Zone> zones;
+    map<string, vector<Zone>> memorySnapshots;
+
+    path snapshotDir() const {
+        return path(fileName + ".snapshots");
+    }
+
+    bool isOpen(int zone) const {
+        return zones[zone].state == ZoneState::ImplicitOpen || zones[zone].state == ZoneState::ExplicitOpen;
+    }
+
+    string encode(const vector<Zone>& table) const;
+    bool decode(const string& encoded, vector<Zone>& table) const;
+    bool save();
+    bool load(const string& from, vector<Zone>& table) const;
+};
\ No newline at end of file